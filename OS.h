@@ -2,63 +2,98 @@
 #define OS_H
 
 #include "PCB.h"
+#include "buffer_cache.h"
 #include "disk.h"
+#include "cpu_scheduler.h"
+#include "checkpoint.h"
+#include "histogram.h"
+#include "mapped_file.h"
+#include "page_table.h"
+#include "prefetch.h"
+#include "replacement.h"
+#include "stack_distance.h"
+#include "state_log.h"
+#include "metrics.h"
+#include "output_buffer.h"
+#include "process_table.h"
+#include "process_id.h"
+#include "tlb.h"
 
 #include <algorithm>
+#include <functional>
+#include <utility>
 #include <vector>
-#include <list>
-#include <map>
+#include <queue>
+#include <string>
+#include <unordered_map>
 
-class OperatingSystem {
+// The simulated operating system. Replacement is the page replacement policy (see replacement.h); it is chosen at
+// compile time so that memory accesses make no virtual calls.
+template <typename Replacement>
+class BasicOperatingSystem {
     public:
-        OperatingSystem(int & number_of_hard_disks_, unsigned int & RAM_, unsigned int & page_size_) : 
-            CPU(1), 
+        BasicOperatingSystem(int & number_of_hard_disks_, unsigned int & RAM_, unsigned int & page_size_) : 
+            cores(1),
+            current_core(0),
+            affinity(CORE_AFFINITY_LEAST_LOADED),
+            next_spread_core(0),
             number_of_processes(1), 
             timestamp(0), 
             number_of_hard_disks(number_of_hard_disks_), 
             page_size(page_size_), 
             RAM(RAM_),
             number_of_frames(RAM_ / page_size_), 
-            ready_queue(0), 
+            cpu_policy(CPU_ROUND_ROBIN),
+            clock(0),
+            context_switches(0),
+            terminated_processes(0),
             hard_disks(number_of_hard_disks_), 
-            frames(0) {
+            state_log(nullptr),
+            frames(),
+            memory_hits(0),
+            page_faults(0),
+            evictions(0),
+            page_walks(0),
+            page_walk_levels(0),
+            stack_distances(nullptr),
+            copy_on_write(false),
+            cow_shared_pages(0),
+            cow_breaks(0),
+            frames_saved(0) {
+            cores[0].scheduler = new RoundRobinCpuScheduler();
                 
             // Creates initial process
-            PCB* process_1 = new PCB{ number_of_processes };
+            PCB* process_1 = all_processes.Create(number_of_processes);
             process_1->SetParent(1); //First process has no parent
-            all_processes[number_of_processes] = process_1;
 
             // Initialize hard disks
             for (int i = 0; i < number_of_hard_disks; i++) {
-                HardDisk* disk_ = new HardDisk{};
+                HardDisk* disk_ = new HardDisk{ &file_names };
                 hard_disks[i] = disk_;
             }
         }
 
-        ~OperatingSystem() {
+        ~BasicOperatingSystem() {
+            for (Core & core : cores) {
+                delete core.scheduler;
+            }
             // Delete disks
             for (auto disk : hard_disks) {
                 delete disk;
             }
-            // Delete frames
-            for (auto frame : frames) {
-                delete frame;
-            }
-            // Delete all PCBs
-            for (auto PCB : all_processes) {
-                delete PCB.second;
-            }
+            // The frames are stored in place in frames, and the PCBs are owned and freed by all_processes
 
             hard_disks.clear();
-            frames.clear();
-            all_processes.clear();
         }
 
         // Creates a new process and adds it to the ready queue, or the CPU if it is empty.
         // The parent of the new process is process 1.
         void CreateProcess() {
-            PCB* new_process = new PCB{ ++number_of_processes };
-            all_processes[number_of_processes] = new_process;
+            Tick();
+            PCB* new_process = all_processes.Create(++number_of_processes);
+            new_process->Scheduling().created_at = clock;
+            new_process->Scheduling().core = PlaceNewProcess();
+            OS_METRIC(metrics.Increment(METRIC_PROCESSES_CREATED));
             
             // Parent process is 1
             all_processes[1]->AddChildProcess(new_process);
@@ -71,64 +106,213 @@ class OperatingSystem {
         
         // Creates a new process whose parent is the pcb currently using CPU.
         void Fork() {
-            if (CPU == 1) { // If fork called with no process in CPU
+            Tick();
+            ProcessId running = cores[current_core].running;
+            if (running == 1) { // If fork called with no process in CPU
                 std::cout << "There is no process in the CPU to fork" << std::endl;
             }
             else {
-                PCB* new_process = new PCB(++number_of_processes);
+                PCB* new_process = all_processes.Create(++number_of_processes);
+                new_process->Scheduling().created_at = clock;
+                new_process->Scheduling().nice = all_processes[running]->Scheduling().nice;
+                new_process->Scheduling().core = PlaceNewProcess();
+                OS_METRIC(metrics.Increment(METRIC_FORKS));
 
                 // Parent process is the process in the CPU that called fork
-                all_processes[CPU]->AddChildProcess(new_process); 
-                new_process->SetParent(CPU);
+                all_processes[running]->AddChildProcess(new_process); 
+                new_process->SetParent(running);
+                if (copy_on_write) {
+                    ShareWithChild(running, number_of_processes);
+                }
 
                 // Add new process to ready queue
                 AddToReadyQueue(number_of_processes);
-
-                all_processes[number_of_processes] = new_process;
             }
         }
 
-        // Adds the given process to the ready queue, or if the CPU is idle, the process goes straight there instead.
-        void AddToReadyQueue(const int pid) {
+        // Adds the given process to the ready queue of its core, or if that core is idle, the process goes straight there instead.
+        void AddToReadyQueue(const ProcessId pid) {
+            PCB* pcb = all_processes[pid];
+            Core & core = cores[pcb->Scheduling().core];
             // First process goes straight to CPU
-            if (CPU == 1) {
-                CPU = pid;
+            if (core.running == 1) {
+                SwitchTo(core, pid);
             }
-            // Otherwise process added to back of queue
-            else {
-                ready_queue.push_back(pid);
+            // Otherwise the process waits for the CPU in the scheduler
+            else if (!pcb->Scheduling().queued) {
+                pcb->Scheduling().queued = true;
+                pcb->Scheduling().ready_since = clock;
+                core.scheduler->Enqueue(pcb);
+                OS_METRIC(metrics.SampleReadyQueueLength(core.scheduler->Size()));
+                if (state_log != nullptr) {
+                    state_log->ReadyAdd(pcb->Scheduling().core, pid);
+                }
             }
         }
 
         // Shows the process currently using the CPU, and lists any processes in the ready queue.
+        // With several cores, shows each core in turn and marks the one commands act on.
         void Snapshot() const {
-            std::cout << "Process using CPU: " << CPU << std::endl;
-            std::cout << "Ready Queue:  ";
-            for (auto itr = ready_queue.begin(); itr != ready_queue.end(); ++itr) {
-                std::cout <<  " <- " << *itr;
+            for (unsigned int i = 0; i < cores.size(); i++) {
+                if (cores.size() > 1) {
+                    std::cout << "Core " << i << (i == current_core ? " (current)" : "") << ": ";
+                }
+                std::cout << "Process using CPU: " << cores[i].running << std::endl;
+                std::cout << "Ready Queue:  ";
+                std::vector<PCB*> queued;
+                cores[i].scheduler->Collect(queued);
+                for (PCB* itr : queued) {
+                    std::cout <<  " <- " << itr->GetPid();
+                }
+                std::cout << std::endl;
+            }
+        }
+
+        // Shows the CPU scheduling policy and, over the processes that have terminated, how long they waited
+        // for the CPU and how long they took from creation to termination. Times are in clock ticks.
+        void SchedulerStatsSnapshot() const {
+            std::cout << "policy " << CpuSchedulingPolicyName(cpu_policy) << ", clock " << clock << ", " << terminated_processes
+                      << " terminated, " << context_switches << " context switches" << std::endl;
+            std::cout << "  wait:       mean " << wait_ticks.Mean() << "  p50 " << wait_ticks.Percentile(0.5) << "  p95 " << wait_ticks.Percentile(0.95)
+                      << "  p99 " << wait_ticks.Percentile(0.99) << "  max " << wait_ticks.Max() << std::endl;
+            std::cout << "  turnaround: mean " << turnaround_ticks.Mean() << "  p50 " << turnaround_ticks.Percentile(0.5) << "  p95 " << turnaround_ticks.Percentile(0.95)
+                      << "  p99 " << turnaround_ticks.Percentile(0.99) << "  max " << turnaround_ticks.Max() << std::endl;
+            if (cores.size() > 1) {
+                std::cout << "  affinity " << CoreAffinityPolicyName(affinity) << std::endl;
+                for (unsigned int i = 0; i < cores.size(); i++) {
+                    std::cout << "  core " << i << ": " << cores[i].busy_ticks << " busy ticks, " << cores[i].context_switches
+                              << " context switches, " << cores[i].steals << " stolen, " << cores[i].scheduler->Size() << " queued" << std::endl;
+                }
+            }
+        }
+
+        // Sets how ready processes are chosen for the CPU. Processes that are already waiting keep waiting under the new policy.
+        void SetCpuSchedulingPolicy(const CpuSchedulingPolicy policy) {
+            cpu_policy = policy;
+            for (Core & core : cores) {
+                std::vector<PCB*> queued;
+                core.scheduler->Collect(queued);
+                CpuScheduler* new_scheduler = NewCoreScheduler(policy);
+                for (PCB* pcb : queued) {
+                    core.scheduler->Remove(pcb);
+                    new_scheduler->Enqueue(pcb);
+                }
+                delete core.scheduler;
+                core.scheduler = new_scheduler;
+            }
+        }
+
+        // Sets the number of simulated cores, at least 1. Every core starts idle with an empty run queue under the
+        // current CPU scheduling policy, so call it before any process has been created.
+        void SetNumberOfCores(const unsigned int number_of_cores) {
+            for (Core & core : cores) {
+                delete core.scheduler;
+            }
+            Tlb tlb = cores[0].tlb;
+            cores.assign(std::max(1u, number_of_cores), Core());
+            for (Core & core : cores) {
+                core.scheduler = NewCoreScheduler(cpu_policy);
+                core.tlb = tlb;
+            }
+            current_core = 0;
+            next_spread_core = 0;
+        }
+
+        // Gives every core a TLB of entries entries in sets of ways, which must pass Tlb::ValidGeometry, or none if
+        // entries is 0. With asid the entries are tagged with their process and kept across context switches.
+        void SetTlb(const unsigned int entries, const unsigned int ways, const bool asid) {
+            for (Core & core : cores) {
+                core.tlb.Configure(entries, ways, asid);
+            }
+        }
+
+        unsigned int GetNumberOfCores() const {
+            return cores.size();
+        }
+
+        // Sets which core's run queue new processes join.
+        void SetCoreAffinityPolicy(const CoreAffinityPolicy policy) {
+            affinity = policy;
+        }
+
+        // Returns the pid of the process running on core, or 1 if the core is idle.
+        ProcessId GetRunningProcess(const unsigned int core) const {
+            return cores[core].running;
+        }
+
+        int GetNumberOfHardDisks() const {
+            return number_of_hard_disks;
+        }
+
+        // Returns the pid of the process using disk disk_number, or -1 if the disk is idle.
+        ProcessId GetDiskProcess(const int disk_number) const {
+            return hard_disks[disk_number]->GetCurrentProcess();
+        }
+
+        // Returns how long the request disk disk_number is serving takes, in simulated milliseconds.
+        double GetDiskServiceMs(const int disk_number) const {
+            return hard_disks[disk_number]->GetCurrentServiceMs();
+        }
+
+        // Makes core the one the following commands act on: its process is the one that forks, waits, exits, takes
+        // a quantum, changes its nice value and requests disks and memory.
+        void SelectCore(const int core) {
+            if (core < 0 || static_cast<unsigned int>(core) >= cores.size()) {
+                std::cout << "There is no core " << core << std::endl;
+            }
+            else {
+                current_core = core;
+            }
+        }
+
+        // Sets the nice value of the process using the CPU, from -20 (most favoured) to 19. Used by the priority
+        // and fair schedulers and inherited by children forked afterwards.
+        void SetNice(const int nice) {
+            Tick();
+            ProcessId running = cores[current_core].running;
+            if (running == 1) {
+                std::cout << "There is no process in the CPU to renice" << std::endl;
+            }
+            else if (nice < -20 || nice > 19) {
+                std::cout << "Nice values go from -20 to 19" << std::endl;
+            }
+            else {
+                all_processes[running]->Scheduling().nice = nice;
             }
-            std::cout << std::endl;
         }
 
 
         // Moves the process currently running in CPU to the end of the ready queue
         // Also places a new process into the CPU, if there is one in the ready queue
         void CPUToReadyQueue() {    
-            ready_queue.push_back(CPU);
-            CPU = ready_queue.front();
-            ready_queue.pop_front();
+            Tick();
+            OS_METRIC(metrics.Increment(METRIC_QUANTA));
+            Core & core = cores[current_core];
+            if (core.running != 1) {
+                PCB* pcb = all_processes[core.running];
+                pcb->Scheduling().queued = true;
+                pcb->Scheduling().ready_since = clock;
+                core.scheduler->Preempt(pcb);
+                OS_METRIC(metrics.SampleReadyQueueLength(core.scheduler->Size()));
+                if (state_log != nullptr) {
+                    state_log->ReadyAdd(current_core, core.running);
+                }
+            }
+            GetNextFromReadyQueue();
         }
 
         // The process using the CPU calls wait.
         void Wait() {
-            PCB* cpu_process = all_processes[CPU];
+            Tick();
+            PCB* cpu_process = all_processes[cores[current_core].running];
 
             // If the process has no children, nothing to wait for
             if (cpu_process->HasChildren()) {
                 // If the process already has at least one zombie child, child disappears and parent keeps using CPU
-                int PID_of_zombie_child = cpu_process->ProcessHasZombieChild();
+                ProcessId PID_of_zombie_child = cpu_process->ProcessHasZombieChild();
                 if (PID_of_zombie_child > 0) {  ///////////???
                     cpu_process->SetWaitingState(0);
+                    OS_METRIC(metrics.Increment(METRIC_ZOMBIE_REAPS));
 
                     // Delete the zombie child's children
                     DeleteChildren(all_processes[PID_of_zombie_child]);
@@ -138,8 +322,7 @@ class OperatingSystem {
                     PCB* parent = all_processes[zombie->GetParent()];
 
                     parent->RemoveChild(zombie);
-                    all_processes.erase(PID_of_zombie_child);
-                    delete zombie;
+                    all_processes.Destroy(PID_of_zombie_child);
                     zombie = nullptr;
                 }
 
@@ -147,8 +330,8 @@ class OperatingSystem {
                 else {
                     // Set process using CPU to waiting
                     cpu_process->SetWaitingState(1);
-                    CPU = ready_queue.front();
-                    ready_queue.pop_front();
+                    OS_METRIC(metrics.Increment(METRIC_WAITS_BLOCKED));
+                    GetNextFromReadyQueue();
                     // The waiting parent process will be added back to the end of the ready queue when one of its children exits.
                 }
             }
@@ -158,16 +341,18 @@ class OperatingSystem {
 		// goes to the end of the ready queue. If the parent isn't waiting, the process becomes a zombie process. If the parent is process 1, the 
 		// process terminates immediately. All children of the process are terminated.
         void Exit() {
-            PCB* exiting_process = all_processes[CPU];
+            Tick();
+            PCB* exiting_process = all_processes[cores[current_core].running];
             PCB* parent = all_processes[exiting_process->GetParent()];
+            RecordTermination(exiting_process);
+            OS_METRIC(metrics.Increment(METRIC_EXITS));
 
             //If parent is waiting, the process (and all of its children) terminate immediately, and the parent goes to the end of the ready queue.
             if (parent->IsWaiting()) {
                 // Terminate all children and the process
                 DeleteChildren(exiting_process);
-                all_processes.erase(exiting_process->GetPid());
                 parent->RemoveChild(exiting_process);
-                delete exiting_process;
+                all_processes.Destroy(exiting_process->GetPid());
                 exiting_process = nullptr;
 
                 // Parent goes to the end of the ready queue and is no longer waiting, and the process exits the CPU
@@ -181,9 +366,8 @@ class OperatingSystem {
                 DeleteChildren(exiting_process);
 
                 //Terminate process
-                all_processes.erase(exiting_process->GetPid());
                 parent->RemoveChild(exiting_process);
-                delete exiting_process;
+                all_processes.Destroy(exiting_process->GetPid());
                 exiting_process = nullptr;
 
                 // Replace the process in the CPU
@@ -193,7 +377,8 @@ class OperatingSystem {
             // Parent is not waiting, so process becomes a zombie.
             else {
                 // Mark process as a zombie
-                exiting_process->SetZombie(1);
+                parent->AddZombieChild(exiting_process);
+                OS_METRIC(metrics.Increment(METRIC_ZOMBIES));
 
                 // Terminate all children
                 DeleteChildren(exiting_process);
@@ -202,18 +387,24 @@ class OperatingSystem {
         }
 
         // Removes a process from the ready queue, if the ready queue contains the process
-        void RemoveFromReadyQueue(const int pid_) {
-            auto pid_to_delete = std::find(ready_queue.begin(), ready_queue.end(), pid_);
-            // If the item is in the ready queue, removes it
-            if (pid_to_delete != ready_queue.end()) {
-                ready_queue.erase(pid_to_delete);
+        void RemoveFromReadyQueue(PCB* pcb) {
+            SchedulingInfo & info = pcb->Scheduling();
+            if (info.queued) {
+                cores[info.core].scheduler->Remove(pcb);
+                info.queued = false;
+                info.wait_ticks += clock - info.ready_since;
+                if (state_log != nullptr) {
+                    state_log->ReadyRemove(info.core, pcb->GetPid());
+                }
             }
         }
 
-        //Checks each hard disk for the given process. If the process is using any of the disks or is on one of their io queues, it is removed.
-        void RemoveFromDisks(const int & pid_) {
-            for (auto itr = hard_disks.begin(); itr != hard_disks.end(); itr++) {
-                (*itr)->Remove(pid_);
+        //If the given process is using a hard disk or is on its io queue, it is removed. Only the one disk it is on is touched.
+        void RemoveFromDisks(const ProcessId & pid_) {
+            PCB* pcb = all_processes.Find(pid_);
+            if (pcb != nullptr && pcb->GetDisk() >= 0) {
+                hard_disks[pcb->GetDisk()]->Remove(pid_, pcb->GetDiskSlot());
+                pcb->SetDisk(-1, HardDisk::NO_SLOT);
             }
         }
 
@@ -221,58 +412,470 @@ class OperatingSystem {
         //Shows the state of memory.
         //For each used frame, displays the process number that occupies it and the page number stored in it.
         //The enumeration of pages and frames starts from 0.
-        void MemorySnapshot() {
-            std::cout << "Frame   " << "Page Number     " << "pid       " << "ts" << std::endl;
+        void MemorySnapshot() const {
+            OutputBuffer out(std::cout);
+            WriteFrameHeader(out);
+            for (unsigned int i = 0; i < frames.size(); i++) {
+                WriteFrame(out, i);
+            }
+        }
+
+        // Shows the frames from first to last, inclusive, in the same format. Frames not created yet are left out.
+        void MemorySnapshot(const unsigned int first, const unsigned int last) const {
+            OutputBuffer out(std::cout);
+            WriteFrameHeader(out);
+            for (size_t i = first; i <= last && i < frames.size(); i++) {
+                WriteFrame(out, i);
+            }
+        }
+
+        // Shows only the frames that hold a page, in the same format.
+        void OccupiedMemorySnapshot() const {
+            OutputBuffer out(std::cout);
+            WriteFrameHeader(out);
             for (unsigned int i = 0; i < frames.size(); i++) {
-                std::cout << "  " <<  i << "        ";
-                if (frames[i]->pid_ != 0) {
-                    std::cout << "   " << frames[i]->page_ << "          " << frames[i]->pid_ << "         " << frames[i]->timestamp_;
+                if (!frames[i].IsEmpty()) {
+                    WriteFrame(out, i);
+                }
+            }
+        }
+
+        // Shows, for every process holding frames, how many it holds and the oldest and newest timestamp among them.
+        void ResidentSetSnapshot() const {
+            struct Summary {
+                unsigned long long frames;
+                unsigned long long oldest;
+                unsigned long long newest;
+            };
+            std::unordered_map<ProcessId, Summary> summaries;
+            for (const Frame & frame : frames) {
+                if (frame.IsEmpty()) {
+                    continue;
+                }
+                auto found = summaries.find(frame.pid_);
+                if (found == summaries.end()) {
+                    Summary summary = { 1, frame.timestamp_, frame.timestamp_ };
+                    summaries[frame.pid_] = summary;
+                }
+                else {
+                    found->second.frames++;
+                    found->second.oldest = std::min(found->second.oldest, frame.timestamp_);
+                    found->second.newest = std::max(found->second.newest, frame.timestamp_);
+                }
+            }
+            std::vector<ProcessId> pids;
+            for (auto & entry : summaries) {
+                pids.push_back(entry.first);
+            }
+            std::sort(pids.begin(), pids.end());
+
+            OutputBuffer out(std::cout);
+            out << "pid       frames    oldest ts   newest ts\n";
+            for (ProcessId pid : pids) {
+                const Summary & summary = summaries[pid];
+                out << "  " << pid << "        " << summary.frames << "        " << summary.oldest << "        " << summary.newest << '\n';
+            }
+            out << "Frames in use: " << static_cast<unsigned long long>(page_tables.MappedPages()) - frames_saved << " of " << number_of_frames << '\n';
+        }
+
+        // Feeds every memory reference and process termination from now on to analyzer, which the caller owns, or
+        // stops if it is nullptr. The simulation itself is not affected.
+        void SetStackDistanceAnalyzer(StackDistanceAnalyzer* analyzer) {
+            stack_distances = analyzer;
+        }
+
+        // Writes every change to the ready queues, the cores, the frames and the disks from now on to log, which the
+        // caller owns, or stops if it is nullptr. The log starts with the configuration and the current state, so it
+        // is attached once the system is configured or restored. The simulation itself is not affected.
+        void SetStateLog(StateLog* log) {
+            state_log = log;
+            if (state_log != nullptr) {
+                state_log->Begin(RAM, page_size, number_of_hard_disks, cores.size(), clock);
+                for (unsigned int i = 0; i < cores.size(); i++) {
+                    if (cores[i].running != 1) {
+                        state_log->Run(i, cores[i].running);
+                    }
+                    std::vector<PCB*> queued;
+                    cores[i].scheduler->Collect(queued);
+                    for (PCB* pcb : queued) {
+                        state_log->ReadyAdd(i, pcb->GetPid());
+                    }
+                }
+                for (unsigned int i = 0; i < frames.size(); i++) {
+                    if (!frames[i].IsEmpty()) {
+                        state_log->FrameLoad(i, frames[i].pid_, frames[i].page_);
+                    }
                 }
-                std::cout << std::endl;
+            }
+            for (int i = 0; i < number_of_hard_disks; i++) {
+                hard_disks[i]->SetStateLog(state_log, i);
             }
         }
 
         //The process that is currently using the CPU requests a memory operation for the logical address.
-        void RequestMemoryOperation(const int & address) {
+        //A write to a page shared copy-on-write gives the process its own copy of the page.
+        void RequestMemoryOperation(const int & address, const bool write = false) {
+            Tick();
             int page = address / page_size;
-            
-            int oldest_timestamp = timestamp;
-            int index_of_oldest = -1;
 
-            // Adds frames to the vector as needed until the vector is full (size is number_of_frames). Then replaces the least recently used frame
             // If the same process wants to access the same page, just update time stamp
+            Core & core = cores[current_core];
+            ProcessId running = core.running;
+            PageKey key(running, page);
+            if (stack_distances != nullptr) {
+                stack_distances->Reference(key);
+            }
+            unsigned int resident = Translate(core, running, page);
+            if (resident != PageTables::NOT_MAPPED) {
+                Frame & frame = frames[resident];
+                frame.timestamp_ = timestamp;
+                replacement.Touch(resident);
+                memory_hits++;
+                if (frame.prefetched_) {
+                    frame.prefetched_ = false;
+                    prefetcher.CountUsed();
+                }
+                if (write && frame.references_ > 1) {
+                    CopySharedPage(core, key, resident);
+                }
+            }
+            else {
+                page_faults++;
+                unsigned int index = LoadPage(key);
+                if (index != NO_FRAME) {
+                    core.tlb.Insert(running, page, index);
+                }
+            }
+            if (prefetcher.Enabled()) {
+                prefetcher.Access(running, page, [this, running](const int next_page) { Prefetch(running, next_page); });
+            }
+            timestamp++;
+        }
+
+        // Loads pages ahead of their use: up to readahead_pages ahead of every sequential or strided scan, and
+        // the last working_set_pages distinct pages of a process when it gets a core back. Neither ever fetches
+        // more than half the frames at once. 0 turns either off, as they are by default.
+        void SetPrefetch(const unsigned int readahead_pages, const unsigned int working_set_pages) {
+            prefetcher.Configure(std::min(readahead_pages, number_of_frames / 2), std::min(working_set_pages, number_of_frames / 2));
+        }
+
+        // Returns true if either kind of prefetching is on.
+        bool GetPrefetch() const {
+            return prefetcher.ReadaheadPages() > 0 || prefetcher.WorkingSetPages() > 0;
+        }
+
+        // Makes fork share the parent's pages with the child, each frame counting the processes that map it, until
+        // one of them writes the page and gets a copy of its own. Off by default, when a child starts with no pages.
+        void SetCopyOnWrite(const bool enabled) {
+            copy_on_write = enabled;
+        }
+
+        bool GetCopyOnWrite() const {
+            return copy_on_write;
+        }
+
+        // Shows the page replacement policy and how well it has done: accesses, hits, page faults and evictions.
+        void PagingStatsSnapshot() const {
+            unsigned long long accesses = memory_hits + page_faults;
+            std::cout << "policy " << Replacement::Name() << ", " << accesses << " accesses, " << memory_hits << " hits ("
+                      << (accesses > 0 ? 100.0 * memory_hits / accesses : 0) << "%), " << page_faults << " faults, "
+                      << evictions << " evictions" << std::endl;
+            unsigned long long tlb_hits = 0;
+            unsigned long long tlb_flushes = 0;
+            for (const Core & core : cores) {
+                tlb_hits += core.tlb.Hits();
+                tlb_flushes += core.tlb.Flushes();
+            }
+            const Tlb & tlb = cores[0].tlb;
+            if (tlb.Enabled()) {
+                std::cout << "TLB " << tlb.Entries() << " entries, " << tlb.Ways() << "-way, "
+                          << (tlb.TagsAddressSpaces() ? "tagged with pids" : "flushed on switch") << ": " << tlb_hits << " hits ("
+                          << (accesses > 0 ? 100.0 * tlb_hits / accesses : 0) << "%), " << tlb_flushes << " flushes, ";
+            }
+            else {
+                std::cout << "TLB off: ";
+            }
+            std::cout << page_walks << " page walks visiting " << page_walk_levels << " tables, "
+                      << page_tables.Tables() << " tables in use" << std::endl;
+            if (prefetcher.Enabled()) {
+                unsigned long long issued = prefetcher.Issued();
+                unsigned long long used = prefetcher.Used();
+                std::cout << "prefetch: readahead " << prefetcher.ReadaheadPages() << " pages, working set " << prefetcher.WorkingSetPages()
+                          << " pages: " << issued << " prefetched, " << used << " used (" << (issued > 0 ? 100.0 * used / issued : 0)
+                          << "% accuracy), " << prefetcher.Wasted() << " evicted unused, "
+                          << (used + page_faults > 0 ? 100.0 * used / (used + page_faults) : 0) << "% of misses covered" << std::endl;
+            }
+            if (copy_on_write) {
+                std::cout << "copy-on-write: " << cow_shared_pages << " pages shared by fork, " << cow_breaks << " copied on write, "
+                          << sharers.size() << " frames shared now, saving " << frames_saved << " frames" << std::endl;
+            }
+        }
+
+        // Writes every statistic the simulator keeps, as JSON or CSV. The counters and distributions of metrics.h are
+        // only included when they are compiled in.
+        void DumpMetrics(std::ostream & out, const MetricsFormat format) const {
+            MetricsWriter writer(out, format);
+            writer.Flag("metrics_compiled_in", MetricsCompiledIn());
+            writer.Counter("clock", clock);
+            writer.Counter("context_switches", context_switches);
+            writer.Counter("terminated_processes", terminated_processes);
+            writer.Counter("live_processes", all_processes.Size());
+            size_t ready_queue_length = 0;
+            unsigned long long steals = 0;
+            for (const Core & core : cores) {
+                ready_queue_length += core.scheduler->Size();
+                steals += core.steals;
+            }
+            writer.Counter("ready_queue_length", ready_queue_length);
+            writer.Counter("cores", cores.size());
+            writer.Counter("steals", steals);
+            writer.Counter("page_hits", memory_hits);
+            writer.Counter("page_faults", page_faults);
+            writer.Counter("evictions", evictions);
+            unsigned long long tlb_hits = 0;
+            unsigned long long tlb_misses = 0;
+            unsigned long long tlb_flushes = 0;
+            for (const Core & core : cores) {
+                tlb_hits += core.tlb.Hits();
+                tlb_misses += core.tlb.Misses();
+                tlb_flushes += core.tlb.Flushes();
+            }
+            writer.Counter("tlb_hits", tlb_hits);
+            writer.Counter("tlb_misses", tlb_misses);
+            writer.Counter("tlb_flushes", tlb_flushes);
+            writer.Counter("page_walks", page_walks);
+            writer.Counter("page_walk_levels", page_walk_levels);
+            writer.Counter("page_tables", page_tables.Tables());
+            writer.Counter("prefetches", prefetcher.Issued());
+            writer.Counter("prefetch_hits", prefetcher.Used());
+            writer.Counter("prefetch_wasted", prefetcher.Wasted());
+            writer.Counter("cow_shared_pages", cow_shared_pages);
+            writer.Counter("cow_breaks", cow_breaks);
+            writer.Counter("cow_frames_saved", frames_saved);
+            writer.Counter("buffer_cache_hits", buffer_cache.Hits());
+            writer.Counter("buffer_cache_misses", buffer_cache.Misses());
+            writer.Counter("buffer_cache_evictions", buffer_cache.Evictions());
+            writer.Counter("buffer_cache_disk_writes", buffer_cache.DiskWrites());
+            writer.Distribution("wait_ticks", wait_ticks);
+            writer.Distribution("turnaround_ticks", turnaround_ticks);
+#ifdef OS_METRICS
+            for (int id = 0; id < NUMBER_OF_METRIC_COUNTERS; id++) {
+                writer.Counter(MetricCounterName(static_cast<MetricCounterId>(id)), metrics.Get(static_cast<MetricCounterId>(id)));
+            }
+            writer.Distribution("ready_queue_lengths", metrics.GetReadyQueueLengths());
+            metrics.ForEachCommandLatency([&writer](const char* name, const Histogram & latency) {
+                writer.Distribution(std::string("command_latency_ns.") + name, latency);
+            });
+#endif
+            for (int i = 0; i < number_of_hard_disks; i++) {
+                hard_disks[i]->WriteMetrics(writer, "disk" + std::to_string(i) + ".");
+            }
+            writer.Finish();
+        }
+
+        // Writes the whole state of the simulated system to the file at path: the processes, every core and its run
+        // queue and TLB, every disk and its io queue, the buffer cache, the frames and the page replacement policy,
+        // and the statistics. The instrumentation of metrics.h is not included. Returns false if the file cannot be written.
+        bool Checkpoint(const std::string & path) const {
+            CheckpointWriter writer;
+            if (!writer.Open(path)) {
+                return false;
+            }
+            CheckpointHeader header;
+            header.RAM = RAM;
+            header.page_size = page_size;
+            header.number_of_hard_disks = number_of_hard_disks;
+            header.replacement = Replacement::Name();
+            header.number_of_cores = cores.size();
+            header.Save(writer);
+
+            writer.Put(number_of_processes);
+            writer.Put(timestamp);
+            writer.Put(clock);
+            writer.Put(context_switches);
+            writer.Put(terminated_processes);
+            wait_ticks.Save(writer);
+            turnaround_ticks.Save(writer);
+            file_names.Save(writer);
+            all_processes.Save(writer);
+
+            writer.Put(cpu_policy);
+            writer.Put(affinity);
+            writer.Put(current_core);
+            writer.Put(next_spread_core);
+            for (const Core & core : cores) {
+                writer.Put(core.running);
+                writer.Put(core.context_switches);
+                writer.Put(core.steals);
+                writer.Put(core.busy_ticks);
+                core.scheduler->Save(writer);
+                std::vector<PCB*> queued;
+                core.scheduler->Collect(queued);
+                std::vector<ProcessId> queued_pids;
+                queued_pids.reserve(queued.size());
+                for (PCB* pcb : queued) {
+                    queued_pids.push_back(pcb->GetPid());
+                }
+                writer.PutVector(queued_pids);
+            }
+
+            for (auto disk : hard_disks) {
+                disk->Save(writer);
+            }
+
+            writer.PutVector(frames);
+            writer.Put(memory_hits);
+            writer.Put(page_faults);
+            writer.Put(evictions);
+            replacement.Save(writer);
+            writer.Put(page_walks);
+            writer.Put(page_walk_levels);
+            for (const Core & core : cores) {
+                core.tlb.Save(writer);
+            }
+            prefetcher.Save(writer);
+            buffer_cache.Save(writer);
+            writer.Put(copy_on_write);
+            writer.Put(cow_shared_pages);
+            writer.Put(cow_breaks);
+            std::vector<SharedMapping> shared(static_cast<size_t>(frames_saved));
+            size_t next_mapping = 0;
             for (unsigned int i = 0; i < frames.size(); i++) {
-                if ((frames[i]->page_ == page) && (frames[i]->pid_ == CPU)) {
-                    frames[i]->timestamp_ = timestamp;
-                    timestamp++;
-                    return;
+                auto found = sharers.find(i);
+                if (found == sharers.end()) {
+                    continue;
+                }
+                for (ProcessId pid : found->second) {
+                    shared[next_mapping].pid = pid;
+                    shared[next_mapping].frame = i;
+                    next_mapping++;
                 }
             }
+            writer.PutVector(shared);
+            return writer.Close();
+        }
 
-            // If there are empty frames, create a new frame in the vector
-            if (frames.size() < number_of_frames) {
-                Frame* new_frame = new Frame{};
-                new_frame->timestamp_ = timestamp;
-                new_frame->pid_ = CPU;
-                new_frame->page_ = page;
-                frames.push_back(new_frame);
+        // Replaces the state of the simulated system with the checkpoint at path, which must have been taken with the
+        // same RAM, page size, number of disks, number of cores and page replacement policy. The file is mapped and each part is
+        // copied or rebuilt from it in bulk; the page tables, resident sets, free frames and shared frames are derived
+        // from the frames and the processes sharing them. Returns false if the file cannot be read or does not match, and the state is then not usable.
+        bool Restore(const std::string & path) {
+            MappedFile file;
+            if (!file.Open(path)) {
+                return false;
+            }
+            CheckpointReader reader(file.Begin(), file.End());
+            CheckpointHeader header;
+            if (!header.Load(reader) || header.RAM != RAM || header.page_size != page_size
+                || header.number_of_hard_disks != number_of_hard_disks || header.replacement != Replacement::Name()
+                || header.number_of_cores != cores.size()) {
+                return false;
             }
 
-            // Replace the least recently used frame's data
-            else {
-                // Find the frame with the oldest(lowest) timestamp
-                for (unsigned int i = 0; i < frames.size(); i++) {
-                    if (frames[i]->timestamp_ <= oldest_timestamp) {
-                        index_of_oldest = i;
-                        oldest_timestamp = frames[i]->timestamp_;
+            if (!reader.Get(number_of_processes) || !reader.Get(timestamp) || !reader.Get(clock)
+                || !reader.Get(context_switches) || !reader.Get(terminated_processes)
+                || !wait_ticks.Load(reader) || !turnaround_ticks.Load(reader)
+                || !file_names.Load(reader) || !all_processes.Load(reader)) {
+                return false;
+            }
+
+            CpuSchedulingPolicy policy;
+            if (!reader.Get(policy) || policy < CPU_ROUND_ROBIN || policy > CPU_FAIR || !reader.Get(affinity)
+                || affinity < CORE_AFFINITY_LEAST_LOADED || affinity > CORE_AFFINITY_SPREAD || !reader.Get(current_core)
+                || !reader.Get(next_spread_core) || current_core >= cores.size() || next_spread_core >= cores.size()) {
+                return false;
+            }
+            size_t number_of_cores = cores.size();
+            bool placed = true;
+            all_processes.ForEach([number_of_cores, &placed](PCB* pcb) {
+                placed = placed && pcb->Scheduling().core < number_of_cores;
+            });
+            if (!placed) {
+                return false;
+            }
+            cpu_policy = policy;
+            for (unsigned int i = 0; i < cores.size(); i++) {
+                Core & core = cores[i];
+                delete core.scheduler;
+                core.scheduler = NewCoreScheduler(policy);
+                if (!reader.Get(core.running) || !reader.Get(core.context_switches) || !reader.Get(core.steals)
+                    || !reader.Get(core.busy_ticks) || !core.scheduler->Load(reader)) {
+                    return false;
+                }
+                if (core.running != 1 && (all_processes.Find(core.running) == nullptr || all_processes[core.running]->Scheduling().core != i)) {
+                    return false;
+                }
+                size_t number_queued = 0;
+                const ProcessId* queued_pids = reader.GetArray<ProcessId>(number_queued);
+                if (reader.Failed()) {
+                    return false;
+                }
+                for (size_t j = 0; j < number_queued; j++) {
+                    PCB* pcb = all_processes.Find(queued_pids[j]);
+                    if (pcb == nullptr || !pcb->Scheduling().queued || pcb->Scheduling().core != i) {
+                        return false;
                     }
+                    core.scheduler->Enqueue(pcb);
                 }
-                frames[index_of_oldest]->page_ = page;
-                frames[index_of_oldest]->pid_ = CPU;
-                frames[index_of_oldest]->timestamp_ = timestamp;
             }
-            timestamp++;
+
+            for (auto disk : hard_disks) {
+                if (!disk->Load(reader)) {
+                    return false;
+                }
+            }
+
+            if (!reader.GetVector(frames) || frames.size() > number_of_frames || !reader.Get(memory_hits)
+                || !reader.Get(page_faults) || !reader.Get(evictions) || !replacement.Load(reader)
+                || !reader.Get(page_walks) || !reader.Get(page_walk_levels)) {
+                return false;
+            }
+            for (Core & core : cores) {
+                if (!core.tlb.Load(reader)) {
+                    return false;
+                }
+            }
+            if (!prefetcher.Load(reader)) {
+                return false;
+            }
+            int disks = number_of_hard_disks;
+            size_t number_of_files = file_names.Size();
+            bool cached_files_exist = buffer_cache.Load(reader) && buffer_cache.AllFiles([disks, number_of_files](const int disk, const unsigned int file) {
+                return disk >= 0 && disk < disks && file < number_of_files;
+            });
+            if (!cached_files_exist) {
+                return false;
+            }
+            size_t number_of_shared = 0;
+            if (!reader.Get(copy_on_write) || !reader.Get(cow_shared_pages) || !reader.Get(cow_breaks)) {
+                return false;
+            }
+            const SharedMapping* shared = reader.GetArray<SharedMapping>(number_of_shared);
+            if (reader.Failed()) {
+                return false;
+            }
+            if (!RebuildFrameIndexes(shared, number_of_shared)) {
+                return false;
+            }
+            // A TLB entry may be for a process sharing the frame, so entries are checked against the rebuilt page tables
+            PageTables & tables = page_tables;
+            for (Core & core : cores) {
+                bool cached_frames_match = core.tlb.AllEntries([&tables](const ProcessId pid, const int page, const unsigned int frame) {
+                    unsigned long long levels = 0;
+                    return tables.Walk(pid, page, levels) == frame;
+                });
+                if (!cached_frames_match) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+#ifdef OS_METRICS
+        Metrics & GetMetrics() {
+            return metrics;
         }
+#endif
 
         // Shows which processes are currently using the hard disks and what processes are waiting to use them.
         void IOSnapshot() const {
@@ -287,15 +890,53 @@ class OperatingSystem {
                     hard_disks[i]->PrintQueue();
                 }
             }
+            if (buffer_cache.Enabled()) {
+                buffer_cache.PrintStats(std::cout);
+            }
+        }
+
+        // Shows the scheduling policy of each hard disk and how long its requests have waited and taken to serve.
+        void DiskStatsSnapshot() const {
+            for (int i = 0; i < number_of_hard_disks; i++) {
+                std::cout << "Disk " << i << ": ";
+                hard_disks[i]->PrintStats();
+            }
+        }
+
+        // Sets the order in which every hard disk serves its io queue.
+        void SetDiskSchedulingPolicy(const DiskSchedulingPolicy policy) {
+            for (auto disk : hard_disks) {
+                disk->SetSchedulingPolicy(policy);
+            }
+        }
+
+        // Puts a buffer cache of capacity files in front of the disks, replaced by policy and written back or through.
+        // 0 turns it off, as it is by default.
+        void SetBufferCache(const unsigned int capacity, const ReplacementPolicy policy, const bool write_back) {
+            buffer_cache.Configure(capacity, policy, write_back);
         }
 
         // The process using the CPU requests the hard disk disk_number
         // It wants to read or write file file _name.
         void RequestDisk(const int & disk_number, const std::string & file_name) {
+            RequestDisk(disk_number, file_name.data(), file_name.size());
+        }
+
+        // Same as above, for a file name that is not held in a std::string. The name is interned, so repeated names are not copied.
+        void RequestDisk(const int & disk_number, const char* file_name, const size_t file_name_length) {
+            Tick();
             if ((disk_number < number_of_hard_disks) && (disk_number >= 0)) {
                 // Process 1 should not use any disks/be added to any queues
-                if (CPU != 1) {
-                    hard_disks[disk_number]->Request(file_name, CPU);
+                ProcessId running = cores[current_core].running;
+                if (running != 1) {
+                    unsigned int file = file_names.Intern(file_name, file_name_length);
+                    // A cached file is served at once, and the process keeps the CPU
+                    if (buffer_cache.Lookup(disk_number, file)) {
+                        return;
+                    }
+                    unsigned int slot = hard_disks[disk_number]->Request(file, running);
+                    all_processes[running]->SetDisk(disk_number, slot);
+                    OS_METRIC(metrics.Increment(METRIC_DISK_REQUESTS));
                     // Remove from CPU and replace from ready queue
                     GetNextFromReadyQueue();
                 }
@@ -305,58 +946,117 @@ class OperatingSystem {
             }
         }
 
-        // The process at the front of the ready queue is removed and moves to the CPU.
+        // The process chosen by the CPU scheduler is removed from the ready queue and moves to the CPU.
         void GetNextFromReadyQueue() {
-            if (ready_queue.empty()) {
-                CPU = 1;
-            }
-            else {
-                CPU = ready_queue.front();
-                ready_queue.pop_front();
-            }
+            Dispatch(current_core);
         }
 
         // When a process is done using a disk, puts it back onto the ready queue.
         void RemoveProcessFromDisk(const int & disk_number) {
+            Tick();
             if ((disk_number < number_of_hard_disks) && (disk_number >= 0)) {
-                int removed_pcb = hard_disks[disk_number]->RemoveProcess();
-                AddToReadyQueue(removed_pcb);
+                // An idle disk has no process to give back
+                if (!hard_disks[disk_number]->DiskIsIdle()) {
+                    buffer_cache.Insert(disk_number, hard_disks[disk_number]->GetCurrentFileId());
+                    ProcessId removed_pcb = hard_disks[disk_number]->RemoveProcess();
+                    all_processes[removed_pcb]->SetDisk(-1, HardDisk::NO_SLOT);
+                    OS_METRIC(metrics.Increment(METRIC_DISK_COMPLETIONS));
+                    AddToReadyQueue(removed_pcb);
+                }
             }
             else {
                 std::cout << "There is no disk " << disk_number << std::endl;
             }
         }
 
-        //Checks each frame for the given process. If the process is found it is removed.
-        void RemoveFromFrames(const int & pid) {
-            for (auto itr = frames.begin(); itr != frames.end(); itr++) {
-                if ((*itr)->pid_ == pid) {
-                    (*itr)->Clear();
+        //Releases every frame held by the given process. Only the frames in the process's resident set are visited.
+        void RemoveFromFrames(const ProcessId & pid) {
+            if (stack_distances != nullptr) {
+                stack_distances->Release(pid);
+            }
+            prefetcher.Release(pid);
+            auto shared = shared_mappings.find(pid);
+            if (shared != shared_mappings.end()) {
+                for (unsigned int index : shared->second) {
+                    if (MapsShared(pid, index)) {
+                        LeaveSharedFrame(pid, index);
+                    }
                 }
+                shared_mappings.erase(shared);
+            }
+            auto resident = resident_sets.find(pid);
+            if (resident == resident_sets.end()) {
+                return;
+            }
+            unsigned int index = resident->second;
+            resident_sets.erase(resident);
+            while (index != NO_FRAME) {
+                unsigned int next = frames[index].next_resident_;
+                // A frame other processes still share passes to one of them
+                if (frames[index].references_ > 1) {
+                    HandOverFrame(index);
+                }
+                else {
+                    FreeFrame(index);
+                }
+                index = next;
             }
         }
 
     private:
-        int CPU;   								// The pid of the process currently using the CPU
-        int number_of_processes;    			// Not the current number of processes, but keeps track of how many are created while the program runs.
-        int timestamp;							// For keeping track of memory requests
+        // One simulated CPU core: the process running on it and its own run queue.
+        struct Core {
+            ProcessId running;                      // The pid of the process using the core, or 1 if it is idle
+            CpuScheduler* scheduler;                // Holds the processes waiting for this core and picks which one runs next
+            unsigned long long context_switches;    // Processes taken from a run queue, this core's or another's, to run here
+            unsigned long long steals;              // Processes taken from another core's run queue
+            unsigned long long busy_ticks;          // Ticks with a process running
+            Tlb tlb;                                // Caches the frames of pages this core's processes used recently
+
+            Core() : running(1), scheduler(nullptr), context_switches(0), steals(0), busy_ticks(0) {}
+        };
+
+        std::vector<Core> cores;                // Index is the core number
+        unsigned int current_core;              // The core whose process the commands act on
+        CoreAffinityPolicy affinity;            // Which core a new process is placed on
+        unsigned int next_spread_core;          // The core the spread policy places the next process on
+        ProcessId number_of_processes;    		// Not the current number of processes, but keeps track of how many are created while the program runs.
+        unsigned long long timestamp;			// For keeping track of memory requests
         const int number_of_hard_disks;      	
         const unsigned int page_size;
         const unsigned int RAM;
         const unsigned int number_of_frames;                  
-        std::list<int> ready_queue;				// Holds the pids of processes waiting on the ready queue
+        CpuSchedulingPolicy cpu_policy;
+        unsigned long long clock;				// Ticks once for every command that changes the state of the system
+        unsigned long long context_switches;	// Number of times a process was taken from the ready queue to the CPU
+        unsigned long long terminated_processes;
+        Histogram wait_ticks;					// Time each terminated process spent on the ready queue
+        Histogram turnaround_ticks;				// Time from creation to termination of each terminated process
+#ifdef OS_METRICS
+        Metrics metrics;						// Instrumentation that is compiled out unless OS_METRICS is defined
+#endif
         std::vector<HardDisk*> hard_disks; 		// Index of the vector is the disk number (disk 0 to disk n), holding a pointer to that disk
-        std::map<int, PCB*> all_processes;   	// A map of all processes; The key is the pid of the process, the value is the pointer to that process
+        FileNameTable file_names;				// Every file name requested from any disk, shared by all disks
+        BufferCache buffer_cache;               // Serves requests for recently read files without the disk, if turned on
+        StateLog* state_log;                    // Sees every change to the ready queues, cores, frames and disks, if set
+        ProcessTable all_processes;   			// Every live process, stored in place and indexed by pid
+        std::vector<PCB*> teardown_batch;		// Processes being terminated by DeleteChildren; kept to reuse its storage
      
+        static const unsigned int NO_FRAME = static_cast<unsigned int>(-1);   // Marks the end of a resident set
+
+        // One frame of memory. Frames are stored by value, one after another, so a frame costs 32 bytes and no allocation.
         struct Frame {
-            int timestamp_;
+            unsigned long long timestamp_;
+            ProcessId pid_;
             int page_;
-            int pid_;
+            unsigned int prev_resident_;        // Index of the previous frame held by the same process, or NO_FRAME
+            unsigned int next_resident_;        // Index of the next frame held by the same process, or NO_FRAME
+            unsigned int references_;           // Processes mapping the page: 1, or more while it is shared copy-on-write
+            bool prefetched_;                   // Loaded ahead of its use and not used yet
 
-            Frame() : timestamp_(0), page_(0), pid_(0) {}
-            ~Frame() {}
+            Frame() : timestamp_(0), pid_(0), page_(0), prev_resident_(NO_FRAME), next_resident_(NO_FRAME), references_(0), prefetched_(false) {}
 
-            bool IsEmpty() {
+            bool IsEmpty() const {
                 return pid_ == 0;
             }
             
@@ -364,43 +1064,515 @@ class OperatingSystem {
                 timestamp_ = 0;
                 page_ = 0;
                 pid_ = 0;
+                prev_resident_ = NO_FRAME;
+                next_resident_ = NO_FRAME;
+                references_ = 0;
+                prefetched_ = false;
             }
         };
 
-        std::vector<Frame*> frames;
+        // A process other than its owner mapping a shared frame, as stored in a checkpoint.
+        struct SharedMapping {
+            ProcessId pid;
+            unsigned int frame;
+        };
 
-        // Deletes all children of a process, and removes them and the process pcb from all disks, frames, their queues and the ready queue.
-        void DeleteChildren(PCB* pcb) {
-            //Delete all children of the process pcb_to_delete
-            for (auto itr = pcb->GetChildren().begin(); itr != pcb->GetChildren().end(); itr++) {
-                PCB* child = (*itr);
-                if (child->HasChildren()) {
-                    DeleteChildren(child);
+        std::vector<Frame> frames;              // Created as they are first needed, up to number_of_frames
+        PageTables page_tables;                 // Maps each process's pages to the index of the frame holding them
+        Replacement replacement;                // Chooses the frame to give up when every frame is occupied
+        unsigned long long memory_hits;         // Accesses to a page that was already in a frame
+        unsigned long long page_faults;         // Accesses that had to load the page into a frame
+        unsigned long long evictions;           // Page faults that replaced another page
+        unsigned long long page_walks;          // Accesses the TLB could not translate, so the page tables were walked
+        unsigned long long page_walk_levels;    // Page tables visited by those walks
+        std::priority_queue<unsigned int> free_frames;     // Indexes of frames released by terminated processes
+        std::unordered_map<ProcessId, unsigned int> resident_sets;   // Maps a pid to the first frame of the list of frames it holds
+        StackDistanceAnalyzer* stack_distances;     // Sees every reference for the LRU miss-ratio curve, if set
+        Prefetcher prefetcher;                  // Picks the pages to load ahead of their use, if turned on
+        bool copy_on_write;                     // Fork shares the parent's frames with the child instead of leaving it none
+        std::unordered_map<unsigned int, std::vector<ProcessId>> sharers;    // The processes besides its owner mapping each shared frame, longest sharing first
+        std::unordered_map<ProcessId, std::vector<unsigned int>> shared_mappings;   // Frames each process was given by fork; some may since be copied, evicted or owned
+        unsigned long long cow_shared_pages;    // Pages fork mapped into a child instead of leaving it to fault them in
+        unsigned long long cow_breaks;          // Writes to a shared page that copied it
+        unsigned long long frames_saved;        // Mappings of shared frames beyond the first, each a frame not used
+
+        // Picks the frame to hold incoming once every frame has been created, and detaches it from the replacement policy and page table.
+        // Released frames have a timestamp of 0, so they are reused before any occupied frame, highest index first.
+        unsigned int TakeOldestFrame(const PageKey & incoming) {
+            if (!free_frames.empty()) {
+                unsigned int index = free_frames.top();
+                free_frames.pop();
+                return index;
+            }
+            unsigned int index = replacement.PickVictim(incoming);
+            evictions++;
+            if (state_log != nullptr) {
+                state_log->FrameEvict(index, frames[index].pid_, frames[index].page_);
+            }
+            if (frames[index].prefetched_) {
+                prefetcher.CountWasted();
+            }
+            UnlinkResident(index);
+            UnmapFrame(index);
+            return index;
+        }
+
+        // Clears the frame at index and puts it on the free list. The caller has already detached it from its resident set.
+        void FreeFrame(const unsigned int index) {
+            if (frames[index].prefetched_) {
+                prefetcher.CountWasted();
+            }
+            if (state_log != nullptr) {
+                state_log->FrameFree(index, frames[index].pid_, frames[index].page_);
+            }
+            UnmapFrame(index);
+            replacement.Release(index);
+            frames[index].Clear();
+            free_frames.push(index);
+        }
+
+        // Loads the page key into a frame: a new one while there are frames left to create, and then a released one
+        // or the one the replacement policy gives up. Returns the frame, or NO_FRAME if there is no memory at all.
+        unsigned int LoadPage(const PageKey & key) {
+            unsigned int index;
+            // If there are empty frames, create a new frame in the vector
+            if (frames.size() < number_of_frames) {
+                frames.push_back(Frame());
+                index = frames.size() - 1;
+            }
+            // Replace the data of the frame chosen by the replacement policy
+            else if (number_of_frames > 0) {
+                index = TakeOldestFrame(key);
+            }
+            else {
+                return NO_FRAME;
+            }
+            Frame & frame = frames[index];
+            frame.page_ = key.page;
+            frame.pid_ = key.pid;
+            frame.timestamp_ = timestamp;
+            frame.references_ = 1;
+            frame.prefetched_ = false;
+
+            replacement.Insert(index, key);
+            LinkResident(index);
+            page_tables.Map(key.pid, key.page, index);
+            if (state_log != nullptr) {
+                state_log->FrameLoad(index, key.pid, key.page);
+            }
+            return index;
+        }
+
+        // Loads page of pid ahead of its use, unless it is already in memory. It is stamped with the access that
+        // prompted it, and counts as used once the process touches it.
+        void Prefetch(const ProcessId pid, const int page) {
+            unsigned long long levels = 0;
+            if (page_tables.Walk(pid, page, levels) != PageTables::NOT_MAPPED) {
+                return;
+            }
+            unsigned int index = LoadPage(PageKey(pid, page));
+            if (index != NO_FRAME) {
+                frames[index].prefetched_ = true;
+                prefetcher.CountIssued();
+            }
+        }
+
+        // Finds the frame holding page of pid through the TLB of core. On a miss the page tables are walked, and a
+        // page found there is cached in the TLB. Returns PageTables::NOT_MAPPED if the page is in no frame.
+        unsigned int Translate(Core & core, const ProcessId pid, const int page) {
+            unsigned int frame = PageTables::NOT_MAPPED;
+            if (core.tlb.Lookup(pid, page, frame)) {
+                return frame;
+            }
+            page_walks++;
+            frame = page_tables.Walk(pid, page, page_walk_levels);
+            if (frame != PageTables::NOT_MAPPED) {
+                core.tlb.Insert(pid, page, frame);
+            }
+            return frame;
+        }
+
+        // Removes the page held by the frame at index from the page table of every process mapping it and from the TLB
+        // of every core.
+        void UnmapFrame(const unsigned int index) {
+            Frame & frame = frames[index];
+            UnmapPage(frame.pid_, frame.page_);
+            if (frame.references_ > 1) {
+                auto found = sharers.find(index);
+                for (ProcessId pid : found->second) {
+                    UnmapPage(pid, frame.page_);
                 }
-                else {
-                    RemoveFromDisks(child->GetPid());
-                    RemoveFromFrames(child->GetPid());
-                    RemoveFromReadyQueue(child->GetPid());
+                sharers.erase(found);
+                frames_saved -= frame.references_ - 1;
+                frame.references_ = 1;
+            }
+        }
 
-                    // Delete child from all_processes
-                    all_processes.erase(child->GetPid());
-                    delete child;
-                    child = nullptr;
+        void UnmapPage(const ProcessId pid, const int page) {
+            page_tables.Unmap(pid, page);
+            for (Core & core : cores) {
+                core.tlb.Invalidate(pid, page);
+            }
+        }
+
+        // Maps every page the parent has in memory, its own and those it shares, into the page table of its new child.
+        void ShareWithChild(const ProcessId parent, const ProcessId child) {
+            std::vector<unsigned int> & given = shared_mappings[child];
+            auto resident = resident_sets.find(parent);
+            for (unsigned int index = resident != resident_sets.end() ? resident->second : NO_FRAME; index != NO_FRAME; index = frames[index].next_resident_) {
+                given.push_back(index);
+            }
+            auto shared = shared_mappings.find(parent);
+            if (shared != shared_mappings.end()) {
+                for (unsigned int index : shared->second) {
+                    if (MapsShared(parent, index)) {
+                        given.push_back(index);
+                    }
                 }
             }
+            for (unsigned int index : given) {
+                Frame & frame = frames[index];
+                page_tables.Map(child, frame.page_, index);
+                sharers[index].push_back(child);
+                frame.references_++;
+                frames_saved++;
+            }
+            cow_shared_pages += given.size();
+            if (given.empty()) {
+                shared_mappings.erase(child);
+            }
+        }
+
+        // Returns true if pid maps the frame at index without owning it. Frames given by fork are checked this way
+        // because they may since have been copied, evicted or handed over to pid.
+        bool MapsShared(const ProcessId pid, const unsigned int index) {
+            const Frame & frame = frames[index];
+            unsigned long long levels = 0;
+            return frame.references_ > 1 && frame.pid_ != pid && page_tables.Walk(pid, frame.page_, levels) == index;
+        }
+
+        // pid, which shares the frame at index without owning it, stops mapping it.
+        void LeaveSharedFrame(const ProcessId pid, const unsigned int index) {
+            std::vector<ProcessId> & others = sharers[index];
+            others.erase(std::find(others.begin(), others.end(), pid));
+            UnmapPage(pid, frames[index].page_);
+            DropReference(index);
+        }
+
+        // The owner of the shared frame at index stops mapping it, and the process that has shared it longest becomes
+        // the owner. The caller has already taken the frame out of the old owner's resident set.
+        void HandOverFrame(const unsigned int index) {
+            Frame & frame = frames[index];
+            UnmapPage(frame.pid_, frame.page_);
+            std::vector<ProcessId> & others = sharers[index];
+            frame.pid_ = others.front();
+            others.erase(others.begin());
+            if (state_log != nullptr) {
+                state_log->FrameOwner(index, frame.pid_);
+            }
+            LinkResident(index);
+            DropReference(index);
+        }
+
+        void DropReference(const unsigned int index) {
+            frames[index].references_--;
+            frames_saved--;
+            if (frames[index].references_ == 1) {
+                sharers.erase(index);
+            }
+        }
 
+        // The process of key writes its page, which is shared in the frame at index. The other processes keep that
+        // frame, and the writer gets a copy in a frame of its own.
+        void CopySharedPage(Core & core, const PageKey & key, const unsigned int index) {
+            if (frames[index].pid_ == key.pid) {
+                UnlinkResident(index);
+                HandOverFrame(index);
+            }
+            else {
+                LeaveSharedFrame(key.pid, index);
+            }
+            cow_breaks++;
+            unsigned int copy = LoadPage(key);
+            if (copy != NO_FRAME) {
+                core.tlb.Insert(key.pid, key.page, copy);
+            }
+        }
+
+        // Makes pid the process running on core. A different process brings its own address space, so the core's
+        // TLB is switched to it, and in the working set mode the pages it used last are loaded back.
+        void SwitchTo(Core & core, const ProcessId pid) {
+            if (core.running != pid) {
+                core.tlb.SwitchAddressSpace();
+                core.running = pid;
+                if (state_log != nullptr) {
+                    state_log->Run(static_cast<unsigned int>(&core - cores.data()), pid);
+                }
+                if (pid != 1 && prefetcher.WorkingSetPages() > 0) {
+                    prefetcher.Resume(pid, [this, pid](const int page) { Prefetch(pid, page); });
+                }
+            }
+        }
+
+        // Rebuilds the page tables, the heads of the resident sets, the free list and the shared frames from restored
+        // frames and the count processes sharing them. Returns false if a frame links outside the frames or its
+        // sharers do not add up.
+        bool RebuildFrameIndexes(const SharedMapping* shared, const size_t count) {
+            page_tables.Clear();
+            resident_sets.clear();
+            sharers.clear();
+            shared_mappings.clear();
+            frames_saved = 0;
+            std::vector<unsigned int> empty_frames;
+            for (unsigned int i = 0; i < frames.size(); i++) {
+                const Frame & frame = frames[i];
+                if (frame.IsEmpty()) {
+                    empty_frames.push_back(i);
+                    continue;
+                }
+                if ((frame.prev_resident_ != NO_FRAME && frame.prev_resident_ >= frames.size())
+                    || (frame.next_resident_ != NO_FRAME && frame.next_resident_ >= frames.size())) {
+                    return false;
+                }
+                unsigned long long levels = 0;
+                if (page_tables.Walk(frame.pid_, frame.page_, levels) != PageTables::NOT_MAPPED) {
+                    return false;
+                }
+                page_tables.Map(frame.pid_, frame.page_, i);
+                if (frame.prev_resident_ == NO_FRAME) {
+                    resident_sets[frame.pid_] = i;
+                }
+            }
+            for (size_t i = 0; i < count; i++) {
+                const SharedMapping & mapping = shared[i];
+                unsigned long long levels = 0;
+                if (mapping.frame >= frames.size() || frames[mapping.frame].IsEmpty() || all_processes.Find(mapping.pid) == nullptr
+                    || page_tables.Walk(mapping.pid, frames[mapping.frame].page_, levels) != PageTables::NOT_MAPPED) {
+                    return false;
+                }
+                page_tables.Map(mapping.pid, frames[mapping.frame].page_, mapping.frame);
+                sharers[mapping.frame].push_back(mapping.pid);
+                shared_mappings[mapping.pid].push_back(mapping.frame);
+                frames_saved++;
+            }
+            for (unsigned int i = 0; i < frames.size(); i++) {
+                auto found = sharers.find(i);
+                size_t references = frames[i].IsEmpty() ? 0 : 1 + (found != sharers.end() ? found->second.size() : 0);
+                if (frames[i].references_ != references) {
+                    return false;
+                }
+            }
+            free_frames = std::priority_queue<unsigned int>(std::less<unsigned int>(), std::move(empty_frames));
+            return true;
+        }
+
+        // Writes the column headings of the memory snapshots.
+        static void WriteFrameHeader(OutputBuffer & out) {
+            out << "Frame   " << "Page Number     " << "pid       " << "ts" << '\n';
+        }
+
+        // Writes the line for the frame at index in the memory snapshots. Empty frames only show their index.
+        void WriteFrame(OutputBuffer & out, const unsigned int index) const {
+            const Frame & frame = frames[index];
+            out << "  " << index << "        ";
+            if (!frame.IsEmpty()) {
+                out << "   " << frame.page_ << "          " << frame.pid_ << "         " << frame.timestamp_;
+            }
+            out << '\n';
+        }
+
+        // Adds the frame at index to the resident set of the process that now holds it.
+        void LinkResident(const unsigned int index) {
+            Frame* frame = &frames[index];
+            auto head = resident_sets.find(frame->pid_);
+            frame->prev_resident_ = NO_FRAME;
+            if (head == resident_sets.end()) {
+                frame->next_resident_ = NO_FRAME;
+                resident_sets[frame->pid_] = index;
+            }
+            else {
+                frame->next_resident_ = head->second;
+                frames[head->second].prev_resident_ = index;
+                head->second = index;
+            }
+        }
+
+        // Takes the frame at index out of the resident set of the process that holds it.
+        void UnlinkResident(const unsigned int index) {
+            Frame* frame = &frames[index];
+            if (frame->prev_resident_ != NO_FRAME) {
+                frames[frame->prev_resident_].next_resident_ = frame->next_resident_;
+            }
+            else if (frame->next_resident_ != NO_FRAME) {
+                resident_sets[frame->pid_] = frame->next_resident_;
+            }
+            else {
+                resident_sets.erase(frame->pid_);
+            }
+            if (frame->next_resident_ != NO_FRAME) {
+                frames[frame->next_resident_].prev_resident_ = frame->prev_resident_;
+            }
+            frame->prev_resident_ = NO_FRAME;
+            frame->next_resident_ = NO_FRAME;
+        }
+
+        // Advances the clock by one tick, charged to the process using each core. Then every idle core looks for work.
+        void Tick() {
+            clock++;
+            if (state_log != nullptr) {
+                state_log->SetClock(clock);
+            }
+            for (Core & core : cores) {
+                PCB* running = nullptr;
+                if (core.running != 1) {
+                    running = all_processes[core.running];
+                    running->Scheduling().cpu_ticks++;
+                    core.busy_ticks++;
+                }
+                core.scheduler->Tick(running);
+            }
+            if (cores.size() > 1) {
+                for (unsigned int i = 0; i < cores.size(); i++) {
+                    if (cores[i].running == 1) {
+                        Dispatch(i);
+                    }
+                }
+            }
+        }
+
+        // Creates the run queue of one core. Several cores take round robin processes from lock-free deques, which
+        // other cores can steal from.
+        CpuScheduler* NewCoreScheduler(const CpuSchedulingPolicy policy) {
+            if (policy == CPU_ROUND_ROBIN && cores.size() > 1) {
+                return new WorkStealingCpuScheduler(&all_processes);
+            }
+            return NewCpuScheduler(policy);
+        }
+
+        // Chooses the core a new process is placed on, by the affinity policy.
+        unsigned int PlaceNewProcess() {
+            switch (affinity) {
+                case CORE_AFFINITY_PARENT:
+                    return current_core;
+                case CORE_AFFINITY_SPREAD: {
+                    unsigned int core = next_spread_core;
+                    next_spread_core = (next_spread_core + 1) % cores.size();
+                    return core;
+                }
+                case CORE_AFFINITY_LEAST_LOADED:
+                    break;
+            }
+            unsigned int least = 0;
+            for (unsigned int i = 1; i < cores.size(); i++) {
+                if (Load(i) < Load(least)) {
+                    least = i;
+                }
+            }
+            return least;
+        }
+
+        // The number of processes running on or queued for a core.
+        size_t Load(const unsigned int index) const {
+            return (cores[index].running != 1 ? 1 : 0) + cores[index].scheduler->Size();
+        }
+
+        // The process chosen by the core's scheduler is removed from its run queue and runs on the core. A core whose
+        // run queue is empty steals the next process of the core with the most queued, so no core idles while another
+        // has processes waiting.
+        void Dispatch(const unsigned int index) {
+            Core & core = cores[index];
+            PCB* next = core.scheduler->PickNext();
+            if (next == nullptr && cores.size() > 1) {
+                next = Steal(index);
+            }
+            if (next == nullptr) {
+                SwitchTo(core, 1);
+            }
+            else {
+                SchedulingInfo & info = next->Scheduling();
+                if (state_log != nullptr) {
+                    state_log->ReadyRemove(info.core, next->GetPid());
+                }
+                info.queued = false;
+                info.wait_ticks += clock - info.ready_since;
+                info.core = index;
+                context_switches++;
+                core.context_switches++;
+                SwitchTo(core, next->GetPid());
+            }
+        }
+
+        // Takes a process for the core at index from the run queue of the core with the most processes queued.
+        // Returns nullptr if no other core has any.
+        PCB* Steal(const unsigned int index) {
+            unsigned int victim = index;
+            size_t most = 0;
+            for (unsigned int i = 0; i < cores.size(); i++) {
+                if (i != index && cores[i].scheduler->Size() > most) {
+                    victim = i;
+                    most = cores[i].scheduler->Size();
+                }
+            }
+            if (most == 0) {
+                return nullptr;
+            }
+            cores[index].steals++;
+            return cores[victim].scheduler->PickNext();
+        }
+
+        // Adds a terminating process to the wait and turnaround statistics.
+        void RecordTermination(PCB* pcb) {
+            SchedulingInfo & info = pcb->Scheduling();
+            terminated_processes++;
+            wait_ticks.Add(info.wait_ticks);
+            turnaround_ticks.Add(clock - info.created_at);
+        }
+
+        // Deletes all descendants of a process, and removes them and the process pcb from all disks, frames, their queues and the ready queue.
+        // The subtree is torn down iteratively, one level of children at a time, so a fork chain of any depth cannot overflow the stack.
+        // The process pcb itself is destroyed by the caller, or kept around if it is a zombie.
+        void DeleteChildren(PCB* pcb) {
+            teardown_batch.clear();
+            for (PCB* child = pcb->GetFirstChild(); child != nullptr; child = child->GetNextSibling()) {
+                teardown_batch.push_back(child);
+            }
             pcb->ClearChildren();
 
-            // Keep zombies around and delete later
-            if (!pcb->IsZombieProcess()) {
-                all_processes.erase(pcb->GetPid());
+            // The batch grows as each process's children are appended behind it
+            for (size_t i = 0; i < teardown_batch.size(); i++) {
+                PCB* descendant = teardown_batch[i];
+                for (PCB* child = descendant->GetFirstChild(); child != nullptr; child = child->GetNextSibling()) {
+                    teardown_batch.push_back(child);
+                }
+                RemoveFromDisks(descendant->GetPid());
+                RemoveFromFrames(descendant->GetPid());
+                RemoveFromReadyQueue(descendant);
+                // With several cores a descendant may be running on another core, which is then left idle
+                Core & core = cores[descendant->Scheduling().core];
+                if (core.running == descendant->GetPid()) {
+                    SwitchTo(core, 1);
+                }
+                RecordTermination(descendant);
+                OS_METRIC(metrics.Increment(METRIC_CASCADE_TERMINATIONS));
+            }
+            for (size_t i = 0; i < teardown_batch.size(); i++) {
+                all_processes.Destroy(teardown_batch[i]->GetPid());
+            }
+            teardown_batch.clear();
+            for (unsigned int i = 0; i < cores.size(); i++) {
+                if (cores[i].running == 1 && i != current_core) {
+                    Dispatch(i);
+                }
             }
 
             RemoveFromDisks(pcb->GetPid());
             RemoveFromFrames(pcb->GetPid());
-            RemoveFromReadyQueue(pcb->GetPid());
+            RemoveFromReadyQueue(pcb);
         }
 };
 
 
+// The operating system with exact LRU page replacement, as the simulator has always had.
+typedef BasicOperatingSystem<LruReplacement> OperatingSystem;
+
 #endif //OS_H
@@ -1,28 +1,76 @@
 #ifndef PCB_H
 #define PCB_H
 
-#include <vector>
+#include "process_id.h"
 
+#include <cstddef>
+
+// What the CPU schedulers and the scheduling statistics keep about each process. Times are in ticks of the
+// operating system's clock, which advances once for every command that changes the state of the system.
+struct SchedulingInfo {
+    static const size_t NOT_IN_HEAP = static_cast<size_t>(-1);
+
+    int nice;                               // -20 (most favoured) to 19 (least), inherited from the parent on fork
+    bool queued;                            // True while the process is waiting for the CPU in the scheduler
+    unsigned int level;                     // Multilevel feedback queue the process belongs to
+    unsigned long long level_epoch;         // level is only valid while this matches the scheduler's boost epoch
+    size_t heap_index;                      // Position in the priority heap, or NOT_IN_HEAP
+    unsigned long long sequence;            // When the process was last queued, for breaking ties in arrival order
+    unsigned long long vruntime;            // Weighted CPU time used, for the fair scheduler
+    unsigned int core;                      // Core the process runs on, or whose run queue it waits on when ready
+
+    unsigned long long created_at;          // Clock when the process was created
+    unsigned long long ready_since;         // Clock when the process last became ready
+    unsigned long long wait_ticks;          // Total time spent ready but not running
+    unsigned long long cpu_ticks;           // Total time spent running
+
+    SchedulingInfo() : nice(0), queued(false), level(0), level_epoch(0), heap_index(NOT_IN_HEAP), sequence(0), vruntime(0), core(0),
+        created_at(0), ready_since(0), wait_ticks(0), cpu_ticks(0) {}
+};
 
 class PCB {
     public:
 
-        PCB(int & pid_) : pid(pid_), child_processes(0), parent_process(0), process_is_zombie(0), waiting(0) {}
+        PCB(const ProcessId pid_) : pid(pid_), parent_process(0), process_is_zombie(0), waiting(0),
+            first_child(nullptr), last_child(nullptr), prev_sibling(nullptr), next_sibling(nullptr), number_of_children(0),
+            first_zombie(nullptr), last_zombie(nullptr), prev_zombie(nullptr), next_zombie(nullptr),
+            ready_prev(nullptr), ready_next(nullptr), in_ready_queue(false), disk_number(-1), disk_slot(0) {}
         
+        // Children are owned by the operating system's process table, not by their parent.
         ~PCB() {
-            for (auto child : child_processes) {
-                delete child;
-            }
             ClearChildren();
         }
         
-        int GetPid() const {
+        ProcessId GetPid() const {
             return pid;
         }
 
         // Adds a pointer to a child process of this pcb
         void AddChildProcess(PCB* child_process) {
-            child_processes.push_back(child_process);
+            child_process->prev_sibling = last_child;
+            child_process->next_sibling = nullptr;
+            if (last_child != nullptr) {
+                last_child->next_sibling = child_process;
+            }
+            else {
+                first_child = child_process;
+            }
+            last_child = child_process;
+            number_of_children++;
+        }
+
+        // Marks the given child as a zombie and remembers it, so that wait can find it without searching the children.
+        void AddZombieChild(PCB* child) {
+            child->SetZombie(1);
+            child->prev_zombie = last_zombie;
+            child->next_zombie = nullptr;
+            if (last_zombie != nullptr) {
+                last_zombie->next_zombie = child;
+            }
+            else {
+                first_zombie = child;
+            }
+            last_zombie = child;
         }
 
         // Sets the process to waiting or not waiting
@@ -45,58 +93,140 @@ class PCB {
             return process_is_zombie;
         }
 
-        // If the process has a child that is a zombie, returns the pid of that child. If it does not, returns 0.
-        int ProcessHasZombieChild() const {
-            for (auto itr = child_processes.begin(); itr != child_processes.end(); itr++) {
-                if ((*itr)->process_is_zombie) {
-                    return (*itr)->pid;
-                }
-            }
-            return 0;
+        // If the process has a child that is a zombie, returns the pid of the oldest such child. If it does not, returns 0.
+        ProcessId ProcessHasZombieChild() const {
+            return first_zombie != nullptr ? first_zombie->pid : 0;
         }
 
         //Returns true if the process has children.
         bool HasChildren() const {
-            return !child_processes.empty();
+            return first_child != nullptr;
+        }
+
+        // Returns the number of children of the process
+        size_t GetNumberOfChildren() const {
+            return number_of_children;
         }
         
-        // When called on a process, removes the given child if it is found in child_processes.
-        void RemoveChild(PCB* & child) {
-            for (auto itr = child_processes.begin(); itr != child_processes.end(); itr++) {
-                if ((*itr) == child) {
-                    child_processes.erase(itr);
-                    return;
+        // When called on a process, removes the given child, which must be one of its children.
+        void RemoveChild(PCB* child) {
+            if (child->prev_sibling != nullptr) {
+                child->prev_sibling->next_sibling = child->next_sibling;
+            }
+            else {
+                first_child = child->next_sibling;
+            }
+            if (child->next_sibling != nullptr) {
+                child->next_sibling->prev_sibling = child->prev_sibling;
+            }
+            else {
+                last_child = child->prev_sibling;
+            }
+            child->prev_sibling = nullptr;
+            child->next_sibling = nullptr;
+            number_of_children--;
+
+            if (child->process_is_zombie) {
+                if (child->prev_zombie != nullptr) {
+                    child->prev_zombie->next_zombie = child->next_zombie;
+                }
+                else {
+                    first_zombie = child->next_zombie;
+                }
+                if (child->next_zombie != nullptr) {
+                    child->next_zombie->prev_zombie = child->prev_zombie;
                 }
+                else {
+                    last_zombie = child->prev_zombie;
+                }
+                child->prev_zombie = nullptr;
+                child->next_zombie = nullptr;
             }
         }
 
         // Sets the parent pid of a process
-        void SetParent(const int parent_pid) {
+        void SetParent(const ProcessId parent_pid) {
             parent_process = parent_pid;
         }
 
         // Returns the parent pid of a process
-        int GetParent() {
+        ProcessId GetParent() {
             return parent_process;
         }
 
-        // Returns a constant reference to the vector of child processes.
-        const std::vector<PCB*> & GetChildren() const {
-            return child_processes;
+        // Records that the process is using or waiting for disk disk_number, in the given io queue slot. -1 means no disk.
+        void SetDisk(const int disk_number_, const unsigned int disk_slot_) {
+            disk_number = disk_number_;
+            disk_slot = disk_slot_;
+        }
+
+        // Returns the disk the process is using or waiting for, or -1 if there is none
+        int GetDisk() const {
+            return disk_number;
+        }
+
+        // Returns the io queue slot the process was given when it requested its disk
+        unsigned int GetDiskSlot() const {
+            return disk_slot;
+        }
+
+        // Returns the oldest child of the process, or nullptr if it has none. The rest follow through GetNextSibling().
+        PCB* GetFirstChild() const {
+            return first_child;
         }
 
-        // Clears the vector of child processes.
+        // Returns the next younger child of this process's parent, or nullptr if this is the youngest.
+        PCB* GetNextSibling() const {
+            return next_sibling;
+        }
+
+        // Returns the scheduling state and statistics of the process
+        SchedulingInfo & Scheduling() {
+            return scheduling;
+        }
+
+        // Forgets all children of the process. Used once they have all been terminated.
         void ClearChildren() {
-            child_processes.clear();
+            first_child = nullptr;
+            last_child = nullptr;
+            number_of_children = 0;
+            first_zombie = nullptr;
+            last_zombie = nullptr;
         }
         
         
     private:
-        int pid;                                // Unique id of the process
-        std::vector<PCB*> child_processes;      // Pointers of all children of the process
-        int parent_process;                     // The pid of the parent of the process
+        ProcessId pid;                          // Unique id of the process
+        ProcessId parent_process;               // The pid of the parent of the process
         bool process_is_zombie;                 // True is process is a zombie process, false otherwise
         bool waiting;                           // True if this process is waiting for a child process to terminate.
+
+        // The children form a doubly linked list through their sibling links, so removing one is O(1)
+        PCB* first_child;                       // Oldest child of the process
+        PCB* last_child;                        // Youngest child of the process
+        PCB* prev_sibling;                      // Next older child of this process's parent
+        PCB* next_sibling;                      // Next younger child of this process's parent
+        size_t number_of_children;
+
+        // Zombie children are also linked in a second list, so wait reaps one in O(1)
+        PCB* first_zombie;                      // Zombie child that exited first
+        PCB* last_zombie;                       // Zombie child that exited most recently
+        PCB* prev_zombie;                       // Previous zombie child of this process's parent
+        PCB* next_zombie;                       // Next zombie child of this process's parent
+
+        // The process table writes and restores every field of a PCB for checkpoints
+        friend class ProcessTable;
+
+        // Links used by the ready queue, so that queueing never allocates and any process can be removed in O(1)
+        friend class ReadyQueue;
+        PCB* ready_prev;                        // Process queued ahead of this one
+        PCB* ready_next;                        // Process queued behind this one
+        bool in_ready_queue;                    // True while this process is on the ready queue
+
+        int disk_number;                        // Disk the process is using or waiting for, or -1
+        unsigned int disk_slot;                 // Its slot in that disk's io queue, if it is waiting
+
+        SchedulingInfo scheduling;
 };
 
 #endif // PCB_H
@@ -0,0 +1,481 @@
+// Benchmarks for the OperatingSystem methods on synthetic workloads.
+// Results are printed as CSV on stdout, one row per (workload, configuration, method):
+//   workload,ram,page_size,disks,method,ops,total_ns,ns_per_op,ops_per_sec
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "OS.h"
+#include "clock_sweep.h"
+#include "event_simulation.h"
+#include "spsc_ring.h"
+#include "work_stealing_deque.h"
+
+// The machine being simulated.
+struct Configuration {
+    unsigned int RAM;
+    unsigned int page_size;
+    int number_of_hard_disks;
+};
+
+// Returns the nanoseconds taken to run work.
+template <typename Work>
+long long TimeNs(Work work) {
+    auto start = std::chrono::steady_clock::now();
+    work();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Prints one result row.
+void Report(const std::string & workload, const Configuration & config, const std::string & method, const unsigned long long ops, const long long total_ns) {
+    double ns_per_op = ops > 0 ? static_cast<double>(total_ns) / ops : 0;
+    double ops_per_sec = total_ns > 0 ? ops * 1e9 / total_ns : 0;
+    std::cout << workload << ',' << config.RAM << ',' << config.page_size << ',' << config.number_of_hard_disks << ','
+              << method << ',' << ops << ',' << total_ns << ',' << ns_per_op << ',' << ops_per_sec << '\n';
+}
+
+// Builds an operating system for config. The constructor takes its arguments by reference, so they are copied first.
+template <typename Replacement = LruReplacement>
+struct BasicSimulator {
+    Configuration config;
+    BasicOperatingSystem<Replacement> OS;
+
+    explicit BasicSimulator(Configuration config_) : config(config_), OS(config.number_of_hard_disks, config.RAM, config.page_size) {}
+};
+
+typedef BasicSimulator<> Simulator;
+
+// A chain of processes where every process forks one child and waits for it, then the chain unwinds one exit at a time.
+void DeepForkTree(const Configuration & config, const unsigned long long depth) {
+    Simulator sim(config);
+    sim.OS.CreateProcess();
+
+    long long fork_ns = 0;
+    long long wait_ns = 0;
+    for (unsigned long long i = 0; i < depth; i++) {
+        fork_ns += TimeNs([&sim]() { sim.OS.Fork(); });
+        wait_ns += TimeNs([&sim]() { sim.OS.Wait(); });
+    }
+    // Each exit wakes the waiting parent, which is next on the CPU
+    long long exit_ns = TimeNs([&sim, depth]() {
+        for (unsigned long long i = 0; i <= depth; i++) {
+            sim.OS.Exit();
+        }
+    });
+    Report("fork_tree_deep", config, "Fork", depth, fork_ns);
+    Report("fork_tree_deep", config, "Wait", depth, wait_ns);
+    Report("fork_tree_deep", config, "Exit", depth + 1, exit_ns);
+}
+
+// One process forks many children, then exits and takes all of them with it through cascading termination.
+void WideForkTree(const Configuration & config, const unsigned long long width) {
+    Simulator sim(config);
+    sim.OS.CreateProcess();
+
+    long long fork_ns = TimeNs([&sim, width]() {
+        for (unsigned long long i = 0; i < width; i++) {
+            sim.OS.Fork();
+        }
+    });
+    long long exit_ns = TimeNs([&sim]() { sim.OS.Exit(); });
+    Report("fork_tree_wide", config, "Fork", width, fork_ns);
+    Report("fork_tree_wide", config, "Exit(cascade)", width + 1, exit_ns);
+}
+
+// Many independent processes taking round-robin time quanta. With several cores the quanta go to each core in turn,
+// and rows have the number of cores appended to the workload.
+void RoundRobin(const Configuration & config, const unsigned long long processes, const unsigned long long quanta, const unsigned int cores = 1) {
+    Simulator sim(config);
+    sim.OS.SetNumberOfCores(cores);
+    std::string workload = "round_robin";
+    if (cores > 1) {
+        workload += "/" + std::to_string(cores) + "cores";
+    }
+    long long create_ns = TimeNs([&sim, processes]() {
+        for (unsigned long long i = 0; i < processes; i++) {
+            sim.OS.CreateProcess();
+        }
+    });
+    long long quantum_ns = TimeNs([&sim, quanta, cores]() {
+        for (unsigned long long i = 0; i < quanta; i++) {
+            if (cores > 1) {
+                sim.OS.SelectCore(i % cores);
+            }
+            sim.OS.CPUToReadyQueue();
+        }
+    });
+    long long exit_ns = TimeNs([&sim, processes, cores]() {
+        for (unsigned long long i = 0; i < processes; i++) {
+            if (cores > 1) {
+                sim.OS.SelectCore(i % cores);
+            }
+            sim.OS.Exit();
+        }
+    });
+    Report(workload, config, "CreateProcess", processes, create_ns);
+    Report(workload, config, "CPUToReadyQueue", quanta, quantum_ns);
+    Report(workload, config, "Exit", processes, exit_ns);
+}
+
+// Steps cores on real host threads, each owning a work-stealing deque. Every task of depth d spawns two of depth
+// d - 1 on its own thread's deque, so all the work starts on one thread and only spreads by stealing. Reports the
+// tasks run per second, and fails if any task ran twice or never.
+bool HostWorkStealing(const unsigned int threads, const unsigned int depth) {
+    std::vector<WorkStealingDeque<unsigned long long>*> deques;
+    for (unsigned int i = 0; i < threads; i++) {
+        deques.push_back(new WorkStealingDeque<unsigned long long>());
+    }
+    std::atomic<long long> pending(1);                  // Tasks pushed and not run yet
+    std::atomic<unsigned long long> executed(0);
+    deques[0]->Push(depth);
+
+    auto worker = [&deques, &pending, &executed, threads](const unsigned int self) {
+        unsigned long long local = 0;
+        while (pending.load(std::memory_order_acquire) > 0) {
+            unsigned long long task = 0;
+            bool found = deques[self]->Pop(task);
+            for (unsigned int i = 1; !found && i < threads; i++) {
+                found = deques[(self + i) % threads]->Steal(task);
+            }
+            if (!found) {
+                std::this_thread::yield();
+                continue;
+            }
+            if (task > 0) {
+                pending.fetch_add(2, std::memory_order_relaxed);
+                deques[self]->Push(task - 1);
+                deques[self]->Push(task - 1);
+            }
+            local++;
+            pending.fetch_sub(1, std::memory_order_release);
+        }
+        executed.fetch_add(local);
+    };
+    long long ns = TimeNs([&worker, threads]() {
+        std::vector<std::thread> pool;
+        for (unsigned int i = 0; i < threads; i++) {
+            pool.push_back(std::thread(worker, i));
+        }
+        for (std::thread & thread : pool) {
+            thread.join();
+        }
+    });
+    for (WorkStealingDeque<unsigned long long>* deque : deques) {
+        delete deque;
+    }
+
+    unsigned long long expected = (2ULL << depth) - 1;
+    Configuration none = { 0, 0, 0 };
+    Report("host_work_stealing/" + std::to_string(threads) + "threads", none, "Steal", expected, ns);
+    if (executed.load() != expected) {
+        std::cerr << "host_work_stealing: " << executed.load() << " tasks ran instead of " << expected << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Passes count values from one host thread to another through the ring that feeds a pipelined replay, in batches of
+// batch values. Reports the values passed per second, and fails if any arrived out of order.
+bool HostSpscRing(const unsigned long long count, const size_t batch) {
+    SpscRing<unsigned long long> ring(64 * batch);
+    bool in_order = true;
+    long long ns = TimeNs([&ring, &in_order, count, batch]() {
+        std::thread producer([&ring, count, batch]() {
+            std::vector<unsigned long long> values(batch);
+            for (unsigned long long next = 0; next < count;) {
+                size_t n = static_cast<size_t>(std::min<unsigned long long>(batch, count - next));
+                for (size_t i = 0; i < n; i++) {
+                    values[i] = next + i;
+                }
+                size_t pushed = 0;
+                while (pushed < n) {
+                    size_t now = ring.TryPush(values.data() + pushed, n - pushed);
+                    if (now == 0) {
+                        std::this_thread::yield();
+                    }
+                    pushed += now;
+                }
+                next += n;
+            }
+            ring.Close();
+        });
+        std::vector<unsigned long long> values(batch);
+        unsigned long long expected = 0;
+        while (true) {
+            bool closed = ring.Closed();
+            size_t popped = ring.TryPop(values.data(), batch);
+            if (popped == 0) {
+                if (closed) {
+                    break;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+            for (size_t i = 0; i < popped; i++) {
+                in_order = in_order && values[i] == expected++;
+            }
+        }
+        in_order = in_order && expected == count;
+        producer.join();
+    });
+
+    Configuration none = { 0, 0, 0 };
+    Report("host_spsc_ring/batch" + std::to_string(batch), none, "Push+Pop", count, ns);
+    if (!in_order) {
+        std::cerr << "host_spsc_ring: values arrived out of order or went missing" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// The CLOCK hand's worst case: every frame is occupied and referenced, so each sweep passes the whole table and clears
+// every bit. Runs each kernel the host supports and reports the frames it passed per second; fails if a kernel leaves
+// the table in a different state than the scalar loop.
+bool ClockSweep(const size_t frames, const unsigned long long sweeps) {
+    const char* kernels[] = { "scalar", "sse2", "avx2" };
+    std::vector<unsigned char> occupied(frames, 1);
+    for (const char* name : kernels) {
+        ClockSweepKernel sweep = FindClockSweepKernel(name);
+        if (sweep == nullptr) {
+            continue;
+        }
+        std::vector<unsigned char> referenced(frames);
+        size_t victim = 0;
+        long long ns = TimeNs([&referenced, &occupied, &victim, sweep, frames, sweeps]() {
+            for (unsigned long long i = 0; i < sweeps; i++) {
+                std::memset(referenced.data(), 1, frames);
+                victim = sweep(referenced.data(), occupied.data(), 0, frames);
+            }
+        });
+        Configuration none = { 0, 0, 0 };
+        Report(std::string("clock_sweep/") + name, none, "Sweep", sweeps * frames, ns);
+        if (victim != frames || std::count(referenced.begin(), referenced.end(), 0) != static_cast<long>(frames)) {
+            std::cerr << "clock_sweep: the " << name << " kernel did not clear every frame" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Address streams for the memory workloads. All of them span more pages than there are frames, so replacement happens.
+std::vector<int> SequentialAddresses(const Configuration & config, const unsigned long long count) {
+    std::vector<int> addresses(count);
+    unsigned long long span = static_cast<unsigned long long>(config.RAM) * 2;
+    const unsigned long long stride = 8;
+    for (unsigned long long i = 0; i < count; i++) {
+        addresses[i] = static_cast<int>((i * stride) % span);
+    }
+    return addresses;
+}
+
+std::vector<int> LoopingAddresses(const Configuration & config, const unsigned long long count) {
+    // Cycle over a working set slightly larger than RAM, the classic worst case for LRU
+    std::vector<int> addresses(count);
+    unsigned long long pages = config.RAM / config.page_size + config.RAM / config.page_size / 4 + 1;
+    for (unsigned long long i = 0; i < count; i++) {
+        addresses[i] = static_cast<int>((i % pages) * config.page_size);
+    }
+    return addresses;
+}
+
+std::vector<int> ZipfianAddresses(const Configuration & config, const unsigned long long count, std::mt19937_64 & random) {
+    // Page popularity follows a Zipf distribution with exponent 0.99 over twice as many pages as frames
+    unsigned long long pages = std::min<unsigned long long>(2ULL * (config.RAM / config.page_size) + 1, 1ULL << 22);
+    pages = std::min<unsigned long long>(pages, INT_MAX / config.page_size);
+    std::vector<double> cumulative(pages);
+    double total = 0;
+    for (unsigned long long i = 0; i < pages; i++) {
+        total += 1.0 / std::pow(static_cast<double>(i + 1), 0.99);
+        cumulative[i] = total;
+    }
+    std::uniform_real_distribution<double> uniform(0, total);
+    std::vector<int> addresses(count);
+    for (unsigned long long i = 0; i < count; i++) {
+        unsigned long long page = std::lower_bound(cumulative.begin(), cumulative.end(), uniform(random)) - cumulative.begin();
+        page = std::min(page, pages - 1);
+        addresses[i] = static_cast<int>(page * config.page_size + random() % config.page_size);
+    }
+    return addresses;
+}
+
+// Replays an address stream from a handful of processes that take turns on the CPU, with the page replacement policy
+// Replacement and readahead of up to readahead pages. Rows for policies other than LRU have the policy name appended
+// to the workload, and rows with readahead the window.
+template <typename Replacement>
+void MemoryStream(const std::string & stream, const Configuration & config, const std::vector<int> & addresses, const unsigned int readahead = 0) {
+    const unsigned long long processes = 4;
+    const unsigned long long burst = 1024;
+    std::string workload = stream;
+    if (std::strcmp(Replacement::Name(), LruReplacement::Name()) != 0) {
+        workload += std::string("/") + Replacement::Name();
+    }
+    if (readahead > 0) {
+        workload += "/readahead" + std::to_string(readahead);
+    }
+    BasicSimulator<Replacement> sim(config);
+    sim.OS.SetPrefetch(readahead, 0);
+    for (unsigned long long i = 0; i < processes; i++) {
+        sim.OS.CreateProcess();
+    }
+    long long memory_ns = 0;
+    for (unsigned long long start = 0; start < addresses.size(); start += burst) {
+        unsigned long long end = std::min<unsigned long long>(start + burst, addresses.size());
+        memory_ns += TimeNs([&sim, &addresses, start, end]() {
+            for (unsigned long long i = start; i < end; i++) {
+                sim.OS.RequestMemoryOperation(addresses[i]);
+            }
+        });
+        sim.OS.CPUToReadyQueue();
+    }
+    long long exit_ns = TimeNs([&sim, processes]() {
+        for (unsigned long long i = 0; i < processes; i++) {
+            sim.OS.Exit();
+        }
+    });
+    Report(workload, config, "RequestMemoryOperation", addresses.size(), memory_ns);
+    Report(workload, config, "Exit(resident)", processes, exit_ns);
+}
+
+// Replays the same address stream under every page replacement policy, and under LRU with readahead.
+void MemoryStreams(const std::string & stream, const Configuration & config, const std::vector<int> & addresses) {
+    MemoryStream<LruReplacement>(stream, config, addresses);
+    MemoryStream<LruReplacement>(stream, config, addresses, 16);
+    MemoryStream<ClockReplacement>(stream, config, addresses);
+    MemoryStream<TwoQueueReplacement>(stream, config, addresses);
+    MemoryStream<ArcReplacement>(stream, config, addresses);
+}
+
+// Processes spread requests over every disk, the disks complete them, then processes exit while the queues are full.
+void DiskMix(const Configuration & config, const unsigned long long processes) {
+    static const char* const file_names[] = { "a.txt", "b.txt", "log", "data.bin", "swap", "index" };
+    const unsigned long long number_of_files = sizeof(file_names) / sizeof(file_names[0]);
+    Simulator sim(config);
+    for (unsigned long long i = 0; i < processes; i++) {
+        sim.OS.CreateProcess();
+    }
+    std::vector<std::string> names(file_names, file_names + number_of_files);
+    const int disks = config.number_of_hard_disks;
+
+    // Every process asks for a disk, leaving the CPU idle
+    long long request_ns = TimeNs([&sim, &names, processes, disks]() {
+        for (unsigned long long i = 0; i < processes; i++) {
+            sim.OS.RequestDisk(static_cast<int>(i % disks), names[i % names.size()]);
+        }
+    });
+    // Every request completes, returning all processes to the ready queue
+    long long done_ns = TimeNs([&sim, processes, disks]() {
+        for (unsigned long long i = 0; i < processes; i++) {
+            sim.OS.RemoveProcessFromDisk(static_cast<int>(i % disks));
+        }
+    });
+    // Half of the processes go back to the disks, then the other half exit with the disk queues full
+    for (unsigned long long i = 0; i < processes / 2; i++) {
+        sim.OS.RequestDisk(static_cast<int>(i % disks), names[i % names.size()]);
+    }
+    unsigned long long exits = processes - processes / 2;
+    long long exit_ns = TimeNs([&sim, exits]() {
+        for (unsigned long long i = 0; i < exits; i++) {
+            sim.OS.Exit();
+        }
+    });
+    Report("disk_mix", config, "RequestDisk", processes, request_ns);
+    Report("disk_mix", config, "RemoveProcessFromDisk", processes, done_ns);
+    Report("disk_mix", config, "Exit(disk_queues)", exits, exit_ns);
+}
+
+// The discrete-event engine drives a system kept busy but stable: each event is one arrival, quantum expiry, burst end
+// or disk completion, with the operating system method it calls.
+void DiscreteEvents(const Configuration & config, const double seconds, const unsigned int cores) {
+    Simulator sim(config);
+    sim.OS.SetNumberOfCores(cores);
+    SimulationSettings settings;
+    settings.duration_s = seconds;
+    settings.arrival = Distribution(DISTRIBUTION_EXPONENTIAL, 100.0 / cores);
+    settings.burst = Distribution(DISTRIBUTION_EXPONENTIAL, 50);
+    settings.quantum = Distribution(DISTRIBUTION_CONSTANT, 20);
+    settings.disk = Distribution(DISTRIBUTION_EXPONENTIAL, 10);
+    EventSimulation<LruReplacement> simulation(sim.OS, settings);
+    unsigned long long events = 0;
+    long long run_ns = TimeNs([&simulation, &events]() {
+        events = simulation.Run();
+    });
+    Report(cores > 1 ? "discrete_events/" + std::to_string(cores) + "cores" : "discrete_events", config, "Event", events, run_ns);
+}
+
+int main(int argc, char* argv[]) {
+    // --scale multiplies every workload size, so a quick run can use 0.1 and a long one 10
+    double scale = 1;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+            scale = std::atof(argv[++i]);
+        }
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--scale factor]" << std::endl;
+            return 1;
+        }
+    }
+    auto scaled = [scale](const double n) { return static_cast<unsigned long long>(std::max(1.0, n * scale)); };
+
+    std::ios::sync_with_stdio(false);
+    std::cout << "workload,ram,page_size,disks,method,ops,total_ns,ns_per_op,ops_per_sec\n";
+
+    const unsigned int RAM_sizes[] = { 1u << 20, 64u << 20, 1u << 30 };
+    const unsigned int page_sizes[] = { 256, 4096 };
+    const int disk_counts[] = { 1, 8, 64 };
+
+    // Process workloads do not touch memory, so they only sweep the disk count
+    for (int disks : disk_counts) {
+        Configuration config = { 1u << 20, 4096, disks };
+        DeepForkTree(config, scaled(20000));
+        WideForkTree(config, scaled(20000));
+        RoundRobin(config, scaled(10000), scaled(1000000));
+        RoundRobin(config, scaled(10000), scaled(1000000), 4);
+        DiskMix(config, scaled(20000));
+        DiscreteEvents(config, scale * 10, 1);
+        DiscreteEvents(config, scale * 10, 4);
+    }
+
+    // The run queue deques on real threads, from one thread up to twice the host's cores
+    unsigned int depth = static_cast<unsigned int>(std::max(1.0, std::log2(scaled(1 << 20))));
+    unsigned int host_cores = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int threads = 1; threads <= 2 * host_cores; threads *= 2) {
+        if (!HostWorkStealing(threads, depth)) {
+            return 1;
+        }
+    }
+
+    // The ring between the parser and simulator threads of a pipelined replay, one value at a time and in batches
+    for (size_t batch : { static_cast<size_t>(1), static_cast<size_t>(256) }) {
+        if (!HostSpscRing(scaled(10000000), batch)) {
+            return 1;
+        }
+    }
+
+    // The CLOCK hand over a table of 64K frames with every SIMD kernel
+    if (!ClockSweep(1 << 16, scaled(10000))) {
+        return 1;
+    }
+
+    std::mt19937_64 random(12345);
+    for (unsigned int RAM : RAM_sizes) {
+        for (unsigned int page_size : page_sizes) {
+            Configuration config = { RAM, page_size, 1 };
+            const unsigned long long count = scaled(1000000);
+            MemoryStreams("memory_sequential", config, SequentialAddresses(config, count));
+            MemoryStreams("memory_looping", config, LoopingAddresses(config, count));
+            MemoryStreams("memory_zipfian", config, ZipfianAddresses(config, count, random));
+        }
+    }
+    std::cout.flush();
+    return 0;
+}
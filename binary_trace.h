@@ -0,0 +1,416 @@
+#ifndef BINARY_TRACE_H
+#define BINARY_TRACE_H
+
+#include "command.h"
+#include "varint.h"
+
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Binary trace layout:
+//   header:  the 4 bytes "OSBT", a version byte, then RAM, page size and number of hard disks as varints
+//   events:  a one byte opcode followed by its operands
+//
+// Unsigned operands are LEB128 varints. Disk numbers and addresses are zigzag encoded first, so small negative
+// values stay short. File names are stored once in a string table: OPCODE_DEFINE_STRING carries the length and
+// bytes of the next string, which gets the next id (starting at 0), and d events refer to names by that id.
+//
+// The version grows with the set of opcodes: version 1 has opcodes 1 to 12 and version 2 adds 13 to 23. A reader
+// refuses a trace newer than it knows at Open, rather than failing partway through on an opcode it cannot decode, and
+// treats an opcode beyond the trace's own version as corruption.
+
+const char BINARY_TRACE_MAGIC[4] = { 'O', 'S', 'B', 'T' };
+const unsigned char BINARY_TRACE_VERSION = 2;
+
+// Opcodes written to the trace. These values are part of the file format and must never be renumbered.
+enum TraceOpcode {
+    OPCODE_CREATE = 1,              // A
+    OPCODE_QUANTUM = 2,             // Q
+    OPCODE_FORK = 3,                // fork
+    OPCODE_EXIT = 4,                // exit
+    OPCODE_WAIT = 5,                // wait
+    OPCODE_REQUEST_DISK = 6,        // d: disk number, string id
+    OPCODE_DISK_DONE = 7,           // D: disk number
+    OPCODE_MEMORY = 8,              // m: address
+    OPCODE_SNAPSHOT_READY = 9,      // S r
+    OPCODE_SNAPSHOT_IO = 10,        // S i
+    OPCODE_SNAPSHOT_MEMORY = 11,    // S m
+    OPCODE_DEFINE_STRING = 12,      // length, bytes
+    OPCODE_SNAPSHOT_DISK_STATS = 13, // S d
+    OPCODE_NICE = 14,               // nice: value
+    OPCODE_SNAPSHOT_SCHEDULER = 15, // S c
+    OPCODE_SNAPSHOT_PAGING = 16,    // S p
+    OPCODE_METRICS = 17,            // metrics: MetricsFormat
+    OPCODE_SNAPSHOT_MEMORY_RANGE = 18, // S m first last: first, last
+    OPCODE_SNAPSHOT_MEMORY_USED = 19, // S m used
+    OPCODE_SNAPSHOT_MEMORY_PIDS = 20, // S m pids
+    OPCODE_CHECKPOINT = 21,         // checkpoint: string id
+    OPCODE_SELECT_CORE = 22,        // core: number
+    OPCODE_MEMORY_WRITE = 23        // m address w: address
+};
+
+// Returns the highest opcode a trace of version may contain, or 0 for a version this build does not know.
+inline unsigned char LastOpcodeOfVersion(const unsigned char version) {
+    switch (version) {
+        case 1: return OPCODE_DEFINE_STRING;
+        case 2: return OPCODE_MEMORY_WRITE;
+        default: return 0;
+    }
+}
+
+// Encodes commands into the binary trace format and writes them to a file.
+class BinaryTraceWriter {
+    public:
+        BinaryTraceWriter() : number_of_events(0) {}
+
+        ~BinaryTraceWriter() {
+            Close();
+        }
+
+        // Creates the file at path and writes the header. Returns false if the file cannot be created.
+        bool Open(const std::string & path, const unsigned int RAM, const unsigned int page_size, const int number_of_hard_disks) {
+            out.open(path.c_str(), std::ios::binary | std::ios::trunc);
+            if (!out) {
+                return false;
+            }
+            buffer.assign(BINARY_TRACE_MAGIC, sizeof(BINARY_TRACE_MAGIC));
+            buffer.push_back(static_cast<char>(BINARY_TRACE_VERSION));
+            AppendVarint(buffer, RAM);
+            AppendVarint(buffer, page_size);
+            AppendVarint(buffer, ZigZagEncode(number_of_hard_disks));
+            return Flush();
+        }
+
+        // Appends one command. Lines that are not commands are not recorded.
+        void Write(const Command & command) {
+            switch (command.type) {
+                case COMMAND_NONE:
+                    return;
+                case COMMAND_CREATE:
+                    buffer.push_back(OPCODE_CREATE);
+                    break;
+                case COMMAND_QUANTUM:
+                    buffer.push_back(OPCODE_QUANTUM);
+                    break;
+                case COMMAND_FORK:
+                    buffer.push_back(OPCODE_FORK);
+                    break;
+                case COMMAND_EXIT:
+                    buffer.push_back(OPCODE_EXIT);
+                    break;
+                case COMMAND_WAIT:
+                    buffer.push_back(OPCODE_WAIT);
+                    break;
+                case COMMAND_REQUEST_DISK: {
+                    unsigned long long id = StringId(command.file);
+                    buffer.push_back(OPCODE_REQUEST_DISK);
+                    AppendVarint(buffer, ZigZagEncode(command.number));
+                    AppendVarint(buffer, id);
+                    break;
+                }
+                case COMMAND_DISK_DONE:
+                    buffer.push_back(OPCODE_DISK_DONE);
+                    AppendVarint(buffer, ZigZagEncode(command.number));
+                    break;
+                case COMMAND_MEMORY:
+                    buffer.push_back(OPCODE_MEMORY);
+                    AppendVarint(buffer, ZigZagEncode(command.number));
+                    break;
+                case COMMAND_MEMORY_WRITE:
+                    buffer.push_back(OPCODE_MEMORY_WRITE);
+                    AppendVarint(buffer, ZigZagEncode(command.number));
+                    break;
+                case COMMAND_NICE:
+                    buffer.push_back(OPCODE_NICE);
+                    AppendVarint(buffer, ZigZagEncode(command.number));
+                    break;
+                case COMMAND_SELECT_CORE:
+                    buffer.push_back(OPCODE_SELECT_CORE);
+                    AppendVarint(buffer, ZigZagEncode(command.number));
+                    break;
+                case COMMAND_METRICS:
+                    buffer.push_back(OPCODE_METRICS);
+                    AppendVarint(buffer, command.number);
+                    break;
+                case COMMAND_CHECKPOINT: {
+                    unsigned long long id = StringId(command.file);
+                    buffer.push_back(OPCODE_CHECKPOINT);
+                    AppendVarint(buffer, id);
+                    break;
+                }
+                case COMMAND_SNAPSHOT_MEMORY_RANGE:
+                    buffer.push_back(OPCODE_SNAPSHOT_MEMORY_RANGE);
+                    AppendVarint(buffer, command.number);
+                    AppendVarint(buffer, command.last);
+                    break;
+                case NUMBER_OF_COMMAND_TYPES:
+                    return;
+                case COMMAND_SNAPSHOT_READY:
+                    buffer.push_back(OPCODE_SNAPSHOT_READY);
+                    break;
+                case COMMAND_SNAPSHOT_IO:
+                    buffer.push_back(OPCODE_SNAPSHOT_IO);
+                    break;
+                case COMMAND_SNAPSHOT_MEMORY:
+                    buffer.push_back(OPCODE_SNAPSHOT_MEMORY);
+                    break;
+                case COMMAND_SNAPSHOT_DISK_STATS:
+                    buffer.push_back(OPCODE_SNAPSHOT_DISK_STATS);
+                    break;
+                case COMMAND_SNAPSHOT_SCHEDULER:
+                    buffer.push_back(OPCODE_SNAPSHOT_SCHEDULER);
+                    break;
+                case COMMAND_SNAPSHOT_PAGING:
+                    buffer.push_back(OPCODE_SNAPSHOT_PAGING);
+                    break;
+                case COMMAND_SNAPSHOT_MEMORY_USED:
+                    buffer.push_back(OPCODE_SNAPSHOT_MEMORY_USED);
+                    break;
+                case COMMAND_SNAPSHOT_MEMORY_PIDS:
+                    buffer.push_back(OPCODE_SNAPSHOT_MEMORY_PIDS);
+                    break;
+            }
+            number_of_events++;
+            if (buffer.size() >= FLUSH_THRESHOLD) {
+                Flush();
+            }
+        }
+
+        // Writes everything buffered so far to the file. Returns false if the write failed.
+        bool Flush() {
+            if (!buffer.empty()) {
+                out.write(buffer.data(), buffer.size());
+                buffer.clear();
+            }
+            out.flush();
+            return static_cast<bool>(out);
+        }
+
+        // Flushes and closes the file.
+        bool Close() {
+            if (!out.is_open()) {
+                return true;
+            }
+            bool ok = Flush();
+            out.close();
+            return ok;
+        }
+
+        // Returns how many commands have been written
+        unsigned long long GetNumberOfEvents() const {
+            return number_of_events;
+        }
+
+    private:
+        static const size_t FLUSH_THRESHOLD = 1 << 16;
+
+        std::ofstream out;
+        std::string buffer;                                         // Encoded bytes not yet written to the file
+        std::unordered_map<std::string, unsigned long long> string_ids;   // File names already in the string table
+        unsigned long long number_of_events;
+
+        // Returns the string table id of name, defining it in the trace the first time it is seen.
+        unsigned long long StringId(const TextSlice & name) {
+            std::string key = name.ToString();
+            auto found = string_ids.find(key);
+            if (found != string_ids.end()) {
+                return found->second;
+            }
+            unsigned long long id = string_ids.size();
+            string_ids[key] = id;
+            buffer.push_back(OPCODE_DEFINE_STRING);
+            AppendVarint(buffer, key.size());
+            buffer.append(key);
+            return id;
+        }
+};
+
+// Decodes a binary trace held in memory, such as a mapped file. File names in the decoded commands point into that memory.
+class BinaryTraceReader {
+    public:
+        BinaryTraceReader() : pos(nullptr), end(nullptr), version(0), last_opcode(0), RAM(0), page_size(0), number_of_hard_disks(0),
+            failed(false) {}
+
+        // Returns true if [begin, end) starts with the binary trace magic.
+        static bool IsBinaryTrace(const char* begin, const char* end) {
+            return static_cast<size_t>(end - begin) >= sizeof(BINARY_TRACE_MAGIC) &&
+                   std::memcmp(begin, BINARY_TRACE_MAGIC, sizeof(BINARY_TRACE_MAGIC)) == 0;
+        }
+
+        // Reads the header. Returns false if it is missing, malformed, from an unknown version or describes a machine that
+        // cannot be built: a page size of 0, a negative number of disks or a value that does not fit in 32 bits.
+        bool Open(const char* begin, const char* end_) {
+            pos = begin;
+            end = end_;
+            strings.clear();
+            failed = true;
+            if (!IsBinaryTrace(begin, end)) {
+                return false;
+            }
+            pos += sizeof(BINARY_TRACE_MAGIC);
+            if (pos == end) {
+                return false;
+            }
+            version = static_cast<unsigned char>(*pos++);
+            last_opcode = LastOpcodeOfVersion(version);
+            if (last_opcode == 0) {
+                return false;
+            }
+            unsigned long long RAM_value, page_size_value, disks_value;
+            if (!ReadVarint(pos, end, RAM_value) || !ReadVarint(pos, end, page_size_value) || !ReadVarint(pos, end, disks_value)) {
+                return false;
+            }
+            // The configuration must fit the operating system's constructor, as the command line's must
+            long long disks = ZigZagDecode(disks_value);
+            if (RAM_value > UINT_MAX || page_size_value == 0 || page_size_value > UINT_MAX || disks < 0 || disks > INT_MAX) {
+                return false;
+            }
+            RAM = static_cast<unsigned int>(RAM_value);
+            page_size = static_cast<unsigned int>(page_size_value);
+            number_of_hard_disks = static_cast<int>(disks);
+            failed = false;
+            return true;
+        }
+
+        // Decodes the next command. Returns false at the end of the trace, or if the trace is corrupt (see Failed()).
+        bool Next(Command & command) {
+            command = Command();
+            while (pos != end) {
+                unsigned char opcode = static_cast<unsigned char>(*pos++);
+                unsigned long long operand = 0;
+                if (opcode > last_opcode) {
+                    return Fail();
+                }
+                switch (opcode) {
+                    case OPCODE_CREATE: command.type = COMMAND_CREATE; return true;
+                    case OPCODE_QUANTUM: command.type = COMMAND_QUANTUM; return true;
+                    case OPCODE_FORK: command.type = COMMAND_FORK; return true;
+                    case OPCODE_EXIT: command.type = COMMAND_EXIT; return true;
+                    case OPCODE_WAIT: command.type = COMMAND_WAIT; return true;
+                    case OPCODE_SNAPSHOT_READY: command.type = COMMAND_SNAPSHOT_READY; return true;
+                    case OPCODE_SNAPSHOT_IO: command.type = COMMAND_SNAPSHOT_IO; return true;
+                    case OPCODE_SNAPSHOT_MEMORY: command.type = COMMAND_SNAPSHOT_MEMORY; return true;
+                    case OPCODE_SNAPSHOT_DISK_STATS: command.type = COMMAND_SNAPSHOT_DISK_STATS; return true;
+                    case OPCODE_SNAPSHOT_SCHEDULER: command.type = COMMAND_SNAPSHOT_SCHEDULER; return true;
+                    case OPCODE_SNAPSHOT_PAGING: command.type = COMMAND_SNAPSHOT_PAGING; return true;
+                    case OPCODE_SNAPSHOT_MEMORY_USED: command.type = COMMAND_SNAPSHOT_MEMORY_USED; return true;
+                    case OPCODE_SNAPSHOT_MEMORY_PIDS: command.type = COMMAND_SNAPSHOT_MEMORY_PIDS; return true;
+                    case OPCODE_CHECKPOINT:
+                        if (!ReadVarint(pos, end, operand) || operand >= strings.size()) {
+                            return Fail();
+                        }
+                        command.type = COMMAND_CHECKPOINT;
+                        command.file = strings[operand];
+                        return true;
+                    case OPCODE_SNAPSHOT_MEMORY_RANGE: {
+                        unsigned long long last = 0;
+                        if (!ReadVarint(pos, end, operand) || !ReadVarint(pos, end, last) || last < operand || last > INT_MAX) {
+                            return Fail();
+                        }
+                        command.type = COMMAND_SNAPSHOT_MEMORY_RANGE;
+                        command.number = static_cast<int>(operand);
+                        command.last = static_cast<int>(last);
+                        return true;
+                    }
+                    case OPCODE_METRICS:
+                        if (!ReadVarint(pos, end, operand) || operand > METRICS_CSV) {
+                            return Fail();
+                        }
+                        command.type = COMMAND_METRICS;
+                        command.number = static_cast<int>(operand);
+                        return true;
+                    case OPCODE_REQUEST_DISK: {
+                        unsigned long long id = 0;
+                        if (!ReadVarint(pos, end, operand) || !ReadVarint(pos, end, id) || id >= strings.size()) {
+                            return Fail();
+                        }
+                        command.type = COMMAND_REQUEST_DISK;
+                        command.number = static_cast<int>(ZigZagDecode(operand));
+                        command.file = strings[id];
+                        return true;
+                    }
+                    case OPCODE_DISK_DONE:
+                    case OPCODE_MEMORY:
+                    case OPCODE_MEMORY_WRITE:
+                    case OPCODE_NICE:
+                    case OPCODE_SELECT_CORE:
+                        if (!ReadVarint(pos, end, operand)) {
+                            return Fail();
+                        }
+                        if (opcode == OPCODE_DISK_DONE) {
+                            command.type = COMMAND_DISK_DONE;
+                        }
+                        else if (opcode == OPCODE_MEMORY) {
+                            command.type = COMMAND_MEMORY;
+                        }
+                        else if (opcode == OPCODE_MEMORY_WRITE) {
+                            command.type = COMMAND_MEMORY_WRITE;
+                        }
+                        else if (opcode == OPCODE_NICE) {
+                            command.type = COMMAND_NICE;
+                        }
+                        else {
+                            command.type = COMMAND_SELECT_CORE;
+                        }
+                        command.number = static_cast<int>(ZigZagDecode(operand));
+                        return true;
+                    case OPCODE_DEFINE_STRING:
+                        if (!ReadVarint(pos, end, operand) || operand > static_cast<unsigned long long>(end - pos)) {
+                            return Fail();
+                        }
+                        strings.push_back(TextSlice(pos, operand));
+                        pos += operand;
+                        break;
+                    default:
+                        return Fail();
+                }
+            }
+            return false;
+        }
+
+        // Returns the format version in the header, once Open has read that far
+        unsigned char GetVersion() const {
+            return version;
+        }
+
+        unsigned int GetRAM() const {
+            return RAM;
+        }
+
+        unsigned int GetPageSize() const {
+            return page_size;
+        }
+
+        int GetNumberOfHardDisks() const {
+            return number_of_hard_disks;
+        }
+
+        // Returns true if decoding stopped because the trace was corrupt rather than because it ended
+        bool Failed() const {
+            return failed;
+        }
+
+    private:
+        const char* pos;                    // Next byte to decode
+        const char* end;                    // One past the last byte of the trace
+        unsigned char version;              // Format version of the trace
+        unsigned char last_opcode;          // Highest opcode that version allows
+        unsigned int RAM;
+        unsigned int page_size;
+        int number_of_hard_disks;
+        bool failed;
+        std::vector<TextSlice> strings;     // The string table, indexed by id
+
+        bool Fail() {
+            failed = true;
+            pos = end;
+            return false;
+        }
+};
+
+#endif // BINARY_TRACE_H
@@ -0,0 +1,252 @@
+#ifndef BUFFER_CACHE_H
+#define BUFFER_CACHE_H
+
+#include "checkpoint.h"
+#include "replacement.h"
+
+#include <cstddef>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+// A page replacement policy chosen when the program runs. The buffer cache is configured from the command line after
+// the operating system is built, so it reaches its policy through this interface instead of a template parameter.
+class CacheReplacement {
+    public:
+        virtual ~CacheReplacement() {}
+        virtual const char* Name() const = 0;
+        virtual unsigned int PickVictim(const PageKey & incoming) = 0;
+        virtual void Insert(const unsigned int slot, const PageKey & key) = 0;
+        virtual void Touch(const unsigned int slot) = 0;
+        virtual void Save(CheckpointWriter & writer) const = 0;
+        virtual bool Load(CheckpointReader & reader) = 0;
+};
+
+// Runs one of the page replacement policies of replacement.h over the slots of the buffer cache.
+template <typename Policy>
+class CacheReplacementOf : public CacheReplacement {
+    public:
+        const char* Name() const {
+            return Policy::Name();
+        }
+
+        unsigned int PickVictim(const PageKey & incoming) {
+            return policy.PickVictim(incoming);
+        }
+
+        void Insert(const unsigned int slot, const PageKey & key) {
+            policy.Insert(slot, key);
+        }
+
+        void Touch(const unsigned int slot) {
+            policy.Touch(slot);
+        }
+
+        void Save(CheckpointWriter & writer) const {
+            policy.Save(writer);
+        }
+
+        bool Load(CheckpointReader & reader) {
+            return policy.Load(reader);
+        }
+
+    private:
+        Policy policy;
+};
+
+inline CacheReplacement* NewCacheReplacement(const ReplacementPolicy policy) {
+    switch (policy) {
+        case REPLACEMENT_CLOCK: return new CacheReplacementOf<ClockReplacement>();
+        case REPLACEMENT_2Q: return new CacheReplacementOf<TwoQueueReplacement>();
+        case REPLACEMENT_ARC: return new CacheReplacementOf<ArcReplacement>();
+        case REPLACEMENT_LRU: break;
+    }
+    return new CacheReplacementOf<LruReplacement>();
+}
+
+// A buffer cache of whole files in front of the hard disks, keyed by disk and interned file name. A request for a
+// cached file is served from memory and its process keeps the CPU; any other request goes to the disk, and the file
+// is cached once the disk completes it. When every slot is full, the replacement policy picks the file to drop.
+//
+// A request does not say whether it reads or writes, so a hit is taken to possibly modify the file. Written through,
+// every hit sends its write to the disk straight away, without making the process wait. Written back, a hit only
+// marks the file dirty, and the disk gets one write when a dirty file leaves the cache.
+class BufferCache {
+    public:
+        BufferCache() : capacity(0), policy(REPLACEMENT_LRU), write_back(false), replacement(NewCacheReplacement(REPLACEMENT_LRU)),
+            hits(0), misses(0), evictions(0), disk_writes(0) {}
+
+        ~BufferCache() {
+            delete replacement;
+        }
+
+        // Empties the cache and gives it capacity files, replaced by policy and written through or back. 0 turns it
+        // off, so every request goes to its disk.
+        void Configure(const unsigned int capacity_, const ReplacementPolicy policy_, const bool write_back_) {
+            capacity = capacity_;
+            policy = policy_;
+            write_back = write_back_;
+            delete replacement;
+            replacement = NewCacheReplacement(policy);
+            slots.clear();
+            index.clear();
+        }
+
+        bool Enabled() const {
+            return capacity > 0;
+        }
+
+        // A process asks disk for file. Returns true, counting a hit, if the file is cached; otherwise counts a miss.
+        bool Lookup(const int disk, const unsigned int file) {
+            if (!Enabled()) {
+                return false;
+            }
+            auto found = index.find(PageKey(disk, file));
+            if (found == index.end()) {
+                misses++;
+                return false;
+            }
+            replacement->Touch(found->second);
+            if (write_back) {
+                slots[found->second].dirty = true;
+            }
+            else {
+                disk_writes++;
+            }
+            hits++;
+            return true;
+        }
+
+        // disk has finished a request for file, which is now cached.
+        void Insert(const int disk, const unsigned int file) {
+            if (!Enabled()) {
+                return;
+            }
+            PageKey key(disk, file);
+            auto found = index.find(key);
+            if (found != index.end()) {
+                replacement->Touch(found->second);
+                return;
+            }
+            unsigned int slot;
+            if (slots.size() < capacity) {
+                slot = slots.size();
+                slots.push_back(Slot());
+            }
+            else {
+                slot = replacement->PickVictim(key);
+                index.erase(slots[slot].key);
+                if (slots[slot].dirty) {
+                    disk_writes++;
+                }
+                evictions++;
+            }
+            slots[slot].key = key;
+            slots[slot].dirty = false;
+            index[key] = slot;
+            replacement->Insert(slot, key);
+        }
+
+        // Shows the configuration and how well the cache has done.
+        void PrintStats(std::ostream & out) const {
+            unsigned long long requests = hits + misses;
+            size_t dirty = 0;
+            for (const Slot & slot : slots) {
+                dirty += slot.dirty ? 1 : 0;
+            }
+            out << "Buffer cache: policy " << replacement->Name() << ", " << slots.size() << " of " << capacity << " files, "
+                << (write_back ? "write-back" : "write-through") << ": " << hits << " hits, " << misses << " misses ("
+                << (requests > 0 ? 100.0 * hits / requests : 0) << "% hit ratio), " << evictions << " evictions, "
+                << disk_writes << " writes to disk";
+            if (write_back) {
+                out << ", " << dirty << " dirty";
+            }
+            out << std::endl;
+        }
+
+        unsigned long long Hits() const {
+            return hits;
+        }
+
+        unsigned long long Misses() const {
+            return misses;
+        }
+
+        unsigned long long Evictions() const {
+            return evictions;
+        }
+
+        unsigned long long DiskWrites() const {
+            return disk_writes;
+        }
+
+        // Returns true if check(disk, file) holds for every cached file.
+        template <typename Check>
+        bool AllFiles(Check check) const {
+            for (const Slot & slot : slots) {
+                if (!check(static_cast<int>(slot.key.pid), static_cast<unsigned int>(slot.key.page))) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void Save(CheckpointWriter & writer) const {
+            writer.Put(capacity);
+            writer.Put(policy);
+            writer.Put(write_back);
+            writer.Put(hits);
+            writer.Put(misses);
+            writer.Put(evictions);
+            writer.Put(disk_writes);
+            writer.PutVector(slots);
+            replacement->Save(writer);
+        }
+
+        // Replaces the cache, including its configuration, with one written by Save.
+        bool Load(CheckpointReader & reader) {
+            ReplacementPolicy saved_policy;
+            if (!reader.Get(capacity) || !reader.Get(saved_policy) || saved_policy < REPLACEMENT_LRU || saved_policy > REPLACEMENT_ARC) {
+                return false;
+            }
+            Configure(capacity, saved_policy, false);
+            if (!reader.Get(write_back) || !reader.Get(hits) || !reader.Get(misses) || !reader.Get(evictions)
+                || !reader.Get(disk_writes) || !reader.GetVector(slots) || !replacement->Load(reader)) {
+                return false;
+            }
+            if (slots.size() > capacity) {
+                return reader.Fail();
+            }
+            for (unsigned int slot = 0; slot < slots.size(); slot++) {
+                if (!index.insert(std::make_pair(slots[slot].key, slot)).second) {
+                    return reader.Fail();
+                }
+            }
+            return true;
+        }
+
+    private:
+        // A cached file: its disk in the pid of the key and its file id in the page, as the policies see it.
+        struct Slot {
+            PageKey key;
+            bool dirty;                         // Written since it was read, and not yet written back
+
+            Slot() : dirty(false) {}
+        };
+
+        unsigned int capacity;                  // Most files cached, 0 when the cache is off
+        ReplacementPolicy policy;
+        bool write_back;
+        CacheReplacement* replacement;
+        unsigned long long hits;
+        unsigned long long misses;
+        unsigned long long evictions;
+        unsigned long long disk_writes;         // Writes the cache sent to the disks: one per hit written through, one per dirty eviction written back
+        std::vector<Slot> slots;                // Filled in order until the cache is full; index is the slot the policy sees
+        std::unordered_map<PageKey, unsigned int, PageKeyHash> index;    // Slot of every cached file
+
+        BufferCache(const BufferCache &);
+        BufferCache & operator=(const BufferCache &);
+};
+
+#endif // BUFFER_CACHE_H
@@ -0,0 +1,221 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "mapped_file.h"
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Checkpoint layout:
+//   header:  the 4 bytes "OSCP", a 32-bit version, a 32-bit byte order mark, then RAM, page size, number of hard
+//            disks, the name of the page replacement policy and the number of cores
+//   body:    the state of the operating system, written by its Checkpoint method and its parts' Save methods
+//
+// Values are stored in the byte order of the machine that wrote them, which the byte order mark checks. Arrays are
+// stored as their element count and element size followed by the elements themselves, starting on an 8 byte
+// boundary, so a restore copies each one straight out of the mapped file instead of decoding it element by element.
+
+const char CHECKPOINT_MAGIC[4] = { 'O', 'S', 'C', 'P' };
+const unsigned int CHECKPOINT_VERSION = 6;
+const unsigned int CHECKPOINT_BYTE_ORDER = 0x01020304;
+
+// Writes a checkpoint file. Check Failed() once everything has been written.
+class CheckpointWriter {
+    public:
+        CheckpointWriter() : offset(0) {}
+
+        // Creates the file at path. Returns false if it cannot be created.
+        bool Open(const std::string & path) {
+            out.open(path.c_str(), std::ios::binary | std::ios::trunc);
+            offset = 0;
+            return static_cast<bool>(out);
+        }
+
+        // Writes one value whose bytes are its whole state.
+        template <typename T>
+        void Put(const T & value) {
+            static_assert(std::is_trivially_copyable<T>::value, "only plain values can be written as bytes");
+            Write(&value, sizeof(T));
+        }
+
+        // Writes count elements starting at data as one array.
+        template <typename T>
+        void PutArray(const T* data, const size_t count) {
+            static_assert(std::is_trivially_copyable<T>::value, "only plain values can be written as bytes");
+            static_assert(alignof(T) <= ALIGNMENT, "array elements must fit the file's alignment");
+            Put(static_cast<unsigned long long>(count));
+            Put(static_cast<unsigned long long>(sizeof(T)));
+            Pad();
+            Write(data, count * sizeof(T));
+        }
+
+        template <typename T>
+        void PutVector(const std::vector<T> & values) {
+            PutArray(values.data(), values.size());
+        }
+
+        void PutString(const std::string & text) {
+            PutArray(text.data(), text.size());
+        }
+
+        // Flushes and closes the file. Returns false if anything failed to be written.
+        bool Close() {
+            out.flush();
+            bool ok = static_cast<bool>(out);
+            out.close();
+            return ok;
+        }
+
+        bool Failed() const {
+            return !out;
+        }
+
+    private:
+        static const size_t ALIGNMENT = 8;
+
+        std::ofstream out;
+        unsigned long long offset;          // Bytes written so far
+
+        void Write(const void* data, const size_t size) {
+            out.write(static_cast<const char*>(data), size);
+            offset += size;
+        }
+
+        void Pad() {
+            static const char zeros[ALIGNMENT] = {};
+            Write(zeros, (ALIGNMENT - offset % ALIGNMENT) % ALIGNMENT);
+        }
+};
+
+// Reads a checkpoint file out of memory, usually a mapping of the whole file. Every Get returns false, and leaves
+// the reader failed, if the data ends early or does not have the expected shape.
+class CheckpointReader {
+    public:
+        CheckpointReader(const char* begin_, const char* end_) : begin(begin_), pos(begin_), end(end_), failed(false) {}
+
+        template <typename T>
+        bool Get(T & value) {
+            static_assert(std::is_trivially_copyable<T>::value, "only plain values can be read as bytes");
+            if (failed || static_cast<size_t>(end - pos) < sizeof(T)) {
+                return Fail();
+            }
+            std::memcpy(&value, pos, sizeof(T));
+            pos += sizeof(T);
+            return true;
+        }
+
+        // Returns a pointer to the elements of the next array, inside the reader's memory, and sets count.
+        // Returns nullptr, with count 0, if the array is empty or the reader failed.
+        template <typename T>
+        const T* GetArray(size_t & count) {
+            static_assert(std::is_trivially_copyable<T>::value, "only plain values can be read as bytes");
+            count = 0;
+            unsigned long long stored_count = 0;
+            unsigned long long element_size = 0;
+            if (!Get(stored_count) || !Get(element_size) || element_size != sizeof(T)) {
+                Fail();
+                return nullptr;
+            }
+            size_t padding = (ALIGNMENT - (pos - begin) % ALIGNMENT) % ALIGNMENT;
+            if (padding > static_cast<size_t>(end - pos) || stored_count > (static_cast<size_t>(end - pos) - padding) / sizeof(T)) {
+                Fail();
+                return nullptr;
+            }
+            pos += padding;
+            const T* data = reinterpret_cast<const T*>(pos);
+            pos += stored_count * sizeof(T);
+            count = stored_count;
+            return count > 0 ? data : nullptr;
+        }
+
+        // Replaces the contents of values with the next array.
+        template <typename T>
+        bool GetVector(std::vector<T> & values) {
+            size_t count = 0;
+            const T* data = GetArray<T>(count);
+            if (failed) {
+                return false;
+            }
+            values.assign(data, data + count);
+            return true;
+        }
+
+        bool GetString(std::string & text) {
+            size_t count = 0;
+            const char* data = GetArray<char>(count);
+            if (failed) {
+                return false;
+            }
+            text.assign(data, count);
+            return true;
+        }
+
+        // Marks the reader failed, for checks made by the caller. Always returns false.
+        bool Fail() {
+            failed = true;
+            return false;
+        }
+
+        bool Failed() const {
+            return failed;
+        }
+
+    private:
+        static const size_t ALIGNMENT = 8;
+
+        const char* begin;
+        const char* pos;
+        const char* end;
+        bool failed;
+};
+
+// The configuration a checkpoint was taken with. The simulator restoring it must be built the same way.
+struct CheckpointHeader {
+    unsigned int RAM;
+    unsigned int page_size;
+    int number_of_hard_disks;
+    std::string replacement;            // Name() of the page replacement policy
+    unsigned int number_of_cores;
+
+    CheckpointHeader() : RAM(0), page_size(0), number_of_hard_disks(0), number_of_cores(1) {}
+
+    void Save(CheckpointWriter & writer) const {
+        writer.Put(CHECKPOINT_MAGIC);
+        writer.Put(CHECKPOINT_VERSION);
+        writer.Put(CHECKPOINT_BYTE_ORDER);
+        writer.Put(RAM);
+        writer.Put(page_size);
+        writer.Put(number_of_hard_disks);
+        writer.PutString(replacement);
+        writer.Put(number_of_cores);
+    }
+
+    // Reads the header. Returns false if this is not a checkpoint this version of the simulator can restore.
+    bool Load(CheckpointReader & reader) {
+        char magic[4];
+        unsigned int version = 0;
+        unsigned int byte_order = 0;
+        if (!reader.Get(magic) || std::memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0
+            || !reader.Get(version) || version != CHECKPOINT_VERSION || !reader.Get(byte_order) || byte_order != CHECKPOINT_BYTE_ORDER) {
+            return reader.Fail();
+        }
+        return reader.Get(RAM) && reader.Get(page_size) && reader.Get(number_of_hard_disks) && reader.GetString(replacement)
+            && reader.Get(number_of_cores) && number_of_cores > 0;
+    }
+};
+
+// Reads only the header of the checkpoint at path. Returns false if it cannot be opened or is not a checkpoint.
+inline bool ReadCheckpointHeader(const std::string & path, CheckpointHeader & header) {
+    MappedFile file;
+    if (!file.Open(path)) {
+        return false;
+    }
+    CheckpointReader reader(file.Begin(), file.End());
+    return header.Load(reader);
+}
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,107 @@
+#ifndef CLOCK_SWEEP_H
+#define CLOCK_SWEEP_H
+
+#include <cstddef>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CLOCK_SWEEP_X86 1
+#include <immintrin.h>
+#endif
+
+// The sweep of the CLOCK hand over the frame table, which keeps the reference bit and the occupied flag of every frame
+// in two parallel byte arrays. Starting at from, it clears the reference bit of every occupied frame it passes and
+// stops at the first occupied frame whose bit is already clear, returning its index, or end if there is none before
+// end. Frames that are not occupied are skipped untouched. A byte counts as set if it is not zero.
+//
+// Under pressure the hand can pass most of the table on every fault, so besides the scalar loop there are SSE2 and
+// AVX2 kernels that test 16 or 32 frames at a time. ClockSweepFunction picks the widest one the host supports the first
+// time it is called; all of them leave the arrays in exactly the state the scalar loop would.
+typedef size_t (*ClockSweepKernel)(unsigned char* referenced, const unsigned char* occupied, size_t from, size_t end);
+
+inline size_t ClockSweepScalar(unsigned char* referenced, const unsigned char* occupied, size_t from, const size_t end) {
+    for (; from < end; from++) {
+        if (!occupied[from]) {
+            continue;
+        }
+        if (!referenced[from]) {
+            return from;
+        }
+        referenced[from] = 0;
+    }
+    return end;
+}
+
+#ifdef CLOCK_SWEEP_X86
+
+__attribute__((target("sse2")))
+inline size_t ClockSweepSse2(unsigned char* referenced, const unsigned char* occupied, size_t from, const size_t end) {
+    const __m128i zero = _mm_setzero_si128();
+    for (; from + 16 <= end; from += 16) {
+        __m128i bits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(referenced + from));
+        __m128i empty = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(occupied + from)), zero);
+        // Occupied frames whose bit is clear are victims
+        int victims = _mm_movemask_epi8(_mm_andnot_si128(empty, _mm_cmpeq_epi8(bits, zero)));
+        if (victims != 0) {
+            return ClockSweepScalar(referenced, occupied, from, end);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(referenced + from), _mm_and_si128(bits, empty));
+    }
+    return ClockSweepScalar(referenced, occupied, from, end);
+}
+
+__attribute__((target("avx2")))
+inline size_t ClockSweepAvx2(unsigned char* referenced, const unsigned char* occupied, size_t from, const size_t end) {
+    const __m256i zero = _mm256_setzero_si256();
+    for (; from + 32 <= end; from += 32) {
+        __m256i bits = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(referenced + from));
+        __m256i empty = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(occupied + from)), zero);
+        int victims = _mm256_movemask_epi8(_mm256_andnot_si256(empty, _mm256_cmpeq_epi8(bits, zero)));
+        if (victims != 0) {
+            return ClockSweepScalar(referenced, occupied, from, end);
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(referenced + from), _mm256_and_si256(bits, empty));
+    }
+    return ClockSweepSse2(referenced, occupied, from, end);
+}
+
+#endif // CLOCK_SWEEP_X86
+
+// Returns the name of the kernel ClockSweepFunction uses on this host: avx2, sse2 or scalar.
+inline const char* ClockSweepKernelName() {
+#ifdef CLOCK_SWEEP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return "avx2";
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return "sse2";
+    }
+#endif
+    return "scalar";
+}
+
+// Returns the kernel called name, or nullptr if this build or host does not have it.
+inline ClockSweepKernel FindClockSweepKernel(const char* name) {
+    if (std::strcmp(name, "scalar") == 0) {
+        return ClockSweepScalar;
+    }
+#ifdef CLOCK_SWEEP_X86
+    __builtin_cpu_init();
+    if (std::strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+        return ClockSweepSse2;
+    }
+    if (std::strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        return ClockSweepAvx2;
+    }
+#endif
+    return nullptr;
+}
+
+// Returns the widest kernel the host supports, chosen once.
+inline ClockSweepKernel ClockSweepFunction() {
+    static const ClockSweepKernel kernel = FindClockSweepKernel(ClockSweepKernelName());
+    return kernel;
+}
+
+#endif // CLOCK_SWEEP_H
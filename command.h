@@ -0,0 +1,333 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include "OS.h"
+
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// The commands understood by the simulator. See the README for what each one does.
+enum CommandType {
+    COMMAND_NONE,               // Blank or unrecognized line
+    COMMAND_CREATE,             // A
+    COMMAND_QUANTUM,            // Q
+    COMMAND_FORK,               // fork
+    COMMAND_EXIT,               // exit
+    COMMAND_WAIT,               // wait
+    COMMAND_REQUEST_DISK,       // d number file_name
+    COMMAND_DISK_DONE,          // D number
+    COMMAND_MEMORY,             // m address
+    COMMAND_SNAPSHOT_READY,     // S r
+    COMMAND_SNAPSHOT_IO,        // S i
+    COMMAND_SNAPSHOT_MEMORY,    // S m
+    COMMAND_SNAPSHOT_DISK_STATS, // S d
+    COMMAND_NICE,               // nice value
+    COMMAND_SNAPSHOT_SCHEDULER, // S c
+    COMMAND_SNAPSHOT_PAGING,    // S p
+    COMMAND_METRICS,            // metrics json|csv
+    COMMAND_SNAPSHOT_MEMORY_RANGE, // S m first last
+    COMMAND_SNAPSHOT_MEMORY_USED, // S m used
+    COMMAND_SNAPSHOT_MEMORY_PIDS, // S m pids
+    COMMAND_CHECKPOINT,         // checkpoint file_name
+    COMMAND_SELECT_CORE,        // core number
+    COMMAND_MEMORY_WRITE,       // m address w
+    NUMBER_OF_COMMAND_TYPES
+};
+
+// Returns a short name for the command type, used to label its latency timer.
+inline const char* CommandTypeName(const CommandType type) {
+    static const char* const names[NUMBER_OF_COMMAND_TYPES] = {
+        "none", "A", "Q", "fork", "exit", "wait", "d", "D", "m", "S_r", "S_i", "S_m", "S_d", "nice", "S_c", "S_p", "metrics",
+        "S_m_range", "S_m_used", "S_m_pids", "checkpoint", "core", "m_w"
+    };
+    return names[type];
+}
+
+// A view of characters that live somewhere else, such as inside a mapped trace file. Nothing is copied.
+struct TextSlice {
+    const char* data;
+    size_t size;
+
+    TextSlice() : data(nullptr), size(0) {}
+    TextSlice(const char* data_, size_t size_) : data(data_), size(size_) {}
+
+    bool Equals(const char* text) const {
+        return std::strlen(text) == size && std::memcmp(data, text, size) == 0;
+    }
+
+    std::string ToString() const {
+        return std::string(data, size);
+    }
+};
+
+// One decoded command. number is the disk number, address, nice value, MetricsFormat, core or first frame of a range;
+// file is only set for d and checkpoint, and last only for S m first last.
+struct Command {
+    CommandType type;
+    int number;
+    int last;
+    TextSlice file;
+
+    Command() : type(COMMAND_NONE), number(0), last(0), file() {}
+};
+
+// Returns true for the characters that separate words on a command line.
+inline bool IsBlank(const char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Returns the next whitespace-separated word in [pos, end) and advances pos past it. The word is empty at the end of the line.
+inline TextSlice NextWord(const char* & pos, const char* end) {
+    while (pos != end && IsBlank(*pos)) {
+        pos++;
+    }
+    const char* start = pos;
+    while (pos != end && !IsBlank(*pos)) {
+        pos++;
+    }
+    return TextSlice(start, pos - start);
+}
+
+// Converts a word to an int the way operator>> would for a well formed number. Returns false if it is not a number or
+// does not fit an int.
+inline bool ParseNumber(const TextSlice & word, int & value) {
+    size_t i = 0;
+    bool negative = false;
+    if (i < word.size && (word.data[i] == '-' || word.data[i] == '+')) {
+        negative = word.data[i] == '-';
+        i++;
+    }
+    if (i == word.size) {
+        return false;
+    }
+    // A negative number can go one further than a positive one
+    const long long limit = negative ? static_cast<long long>(INT_MAX) + 1 : INT_MAX;
+    long long result = 0;
+    for (; i < word.size; i++) {
+        char c = word.data[i];
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        result = result * 10 + (c - '0');
+        if (result > limit) {
+            return false;
+        }
+    }
+    value = static_cast<int>(negative ? -result : result);
+    return true;
+}
+
+// Decodes what follows S m: nothing, used, pids, or the first and last frame to show.
+inline void ParseMemorySnapshot(const char* & pos, const char* end, Command & command) {
+    TextSlice third = NextWord(pos, end);
+    if (third.size == 0) {
+        command.type = COMMAND_SNAPSHOT_MEMORY;
+    }
+    else if (third.Equals("used")) {
+        command.type = COMMAND_SNAPSHOT_MEMORY_USED;
+    }
+    else if (third.Equals("pids")) {
+        command.type = COMMAND_SNAPSHOT_MEMORY_PIDS;
+    }
+    else if (ParseNumber(third, command.number) && ParseNumber(NextWord(pos, end), command.last)
+             && command.number >= 0 && command.last >= command.number) {
+        command.type = COMMAND_SNAPSHOT_MEMORY_RANGE;
+    }
+    else {
+        command.number = 0;
+        command.last = 0;
+    }
+}
+
+// Decodes the single line [begin, end) into command. Unrecognized lines decode to COMMAND_NONE.
+inline void ParseCommand(const char* begin, const char* end, Command & command) {
+    command = Command();
+    const char* pos = begin;
+    TextSlice first = NextWord(pos, end);
+
+    switch (first.size) {
+        case 1:
+            switch (first.data[0]) {
+                case 'A':
+                    command.type = COMMAND_CREATE;
+                    break;
+                case 'Q':
+                    command.type = COMMAND_QUANTUM;
+                    break;
+                case 'S': {
+                    TextSlice second = NextWord(pos, end);
+                    if (second.size == 1) {
+                        switch (second.data[0]) {
+                            case 'r': command.type = COMMAND_SNAPSHOT_READY; break;
+                            case 'i': command.type = COMMAND_SNAPSHOT_IO; break;
+                            case 'm': ParseMemorySnapshot(pos, end, command); break;
+                            case 'd': command.type = COMMAND_SNAPSHOT_DISK_STATS; break;
+                            case 'c': command.type = COMMAND_SNAPSHOT_SCHEDULER; break;
+                            case 'p': command.type = COMMAND_SNAPSHOT_PAGING; break;
+                            default: break;
+                        }
+                    }
+                    break;
+                }
+                case 'd':
+                    if (ParseNumber(NextWord(pos, end), command.number)) {
+                        command.type = COMMAND_REQUEST_DISK;
+                        command.file = NextWord(pos, end);
+                    }
+                    break;
+                case 'D':
+                    if (ParseNumber(NextWord(pos, end), command.number)) {
+                        command.type = COMMAND_DISK_DONE;
+                    }
+                    break;
+                case 'm':
+                    if (ParseNumber(NextWord(pos, end), command.number)) {
+                        command.type = NextWord(pos, end).Equals("w") ? COMMAND_MEMORY_WRITE : COMMAND_MEMORY;
+                    }
+                    break;
+                default:
+                    break;
+            }
+            break;
+        case 4:
+            if (first.Equals("fork")) {
+                command.type = COMMAND_FORK;
+            }
+            else if (first.Equals("exit")) {
+                command.type = COMMAND_EXIT;
+            }
+            else if (first.Equals("wait")) {
+                command.type = COMMAND_WAIT;
+            }
+            else if (first.Equals("nice") && ParseNumber(NextWord(pos, end), command.number)) {
+                command.type = COMMAND_NICE;
+            }
+            else if (first.Equals("core") && ParseNumber(NextWord(pos, end), command.number)) {
+                command.type = COMMAND_SELECT_CORE;
+            }
+            break;
+        case 10:
+            if (first.Equals("checkpoint")) {
+                command.file = NextWord(pos, end);
+                if (command.file.size > 0) {
+                    command.type = COMMAND_CHECKPOINT;
+                }
+            }
+            break;
+        case 7:
+            if (first.Equals("metrics")) {
+                TextSlice format = NextWord(pos, end);
+                if (format.Equals("json")) {
+                    command.type = COMMAND_METRICS;
+                    command.number = METRICS_JSON;
+                }
+                else if (format.Equals("csv")) {
+                    command.type = COMMAND_METRICS;
+                    command.number = METRICS_CSV;
+                }
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Carries out a decoded command on the simulated operating system, without timing it.
+template <typename Replacement>
+inline void RunCommandUntimed(BasicOperatingSystem<Replacement> & OS, const Command & command) {
+    switch (command.type) {
+        case COMMAND_CREATE:
+            OS.CreateProcess();
+            break;
+        case COMMAND_QUANTUM:
+            OS.CPUToReadyQueue();
+            break;
+        case COMMAND_FORK:
+            OS.Fork();
+            break;
+        case COMMAND_EXIT:
+            OS.Exit();
+            break;
+        case COMMAND_WAIT:
+            OS.Wait();
+            break;
+        case COMMAND_REQUEST_DISK:
+            OS.RequestDisk(command.number, command.file.data, command.file.size);
+            break;
+        case COMMAND_DISK_DONE:
+            OS.RemoveProcessFromDisk(command.number);
+            break;
+        case COMMAND_MEMORY:
+            OS.RequestMemoryOperation(command.number);
+            break;
+        case COMMAND_MEMORY_WRITE:
+            OS.RequestMemoryOperation(command.number, true);
+            break;
+        case COMMAND_SNAPSHOT_READY:
+            OS.Snapshot();
+            break;
+        case COMMAND_SNAPSHOT_IO:
+            OS.IOSnapshot();
+            break;
+        case COMMAND_SNAPSHOT_MEMORY:
+            OS.MemorySnapshot();
+            break;
+        case COMMAND_SNAPSHOT_MEMORY_RANGE:
+            OS.MemorySnapshot(command.number, command.last);
+            break;
+        case COMMAND_SNAPSHOT_MEMORY_USED:
+            OS.OccupiedMemorySnapshot();
+            break;
+        case COMMAND_SNAPSHOT_MEMORY_PIDS:
+            OS.ResidentSetSnapshot();
+            break;
+        case COMMAND_SNAPSHOT_DISK_STATS:
+            OS.DiskStatsSnapshot();
+            break;
+        case COMMAND_NICE:
+            OS.SetNice(command.number);
+            break;
+        case COMMAND_SNAPSHOT_SCHEDULER:
+            OS.SchedulerStatsSnapshot();
+            break;
+        case COMMAND_SNAPSHOT_PAGING:
+            OS.PagingStatsSnapshot();
+            break;
+        case COMMAND_METRICS:
+            OS.DumpMetrics(std::cout, static_cast<MetricsFormat>(command.number));
+            break;
+        case COMMAND_SELECT_CORE:
+            OS.SelectCore(command.number);
+            break;
+        case COMMAND_CHECKPOINT:
+            if (!OS.Checkpoint(command.file.ToString())) {
+                std::cout << "Could not write checkpoint " << command.file.ToString() << std::endl;
+            }
+            break;
+        case COMMAND_NONE:
+        case NUMBER_OF_COMMAND_TYPES:
+            break;
+    }
+}
+
+// Carries out a decoded command on the simulated operating system. When the metrics are compiled in and their timers
+// are enabled, the time the command took is recorded under its type.
+template <typename Replacement>
+inline void RunCommand(BasicOperatingSystem<Replacement> & OS, const Command & command) {
+#ifdef OS_METRICS
+    if (OS.GetMetrics().TimersEnabled()) {
+        auto start = std::chrono::steady_clock::now();
+        RunCommandUntimed(OS, command);
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        OS.GetMetrics().RecordCommandLatency(command.type, CommandTypeName(command.type), elapsed.count());
+        return;
+    }
+#endif
+    RunCommandUntimed(OS, command);
+}
+
+#endif // COMMAND_H
@@ -0,0 +1,125 @@
+#ifndef COMMAND_PIPELINE_H
+#define COMMAND_PIPELINE_H
+
+#include <thread>
+#include <vector>
+
+#include "command.h"
+#include "spsc_ring.h"
+
+// Hands decoded commands from a parser thread to the simulation thread, so that reading and decoding the trace
+// overlaps with running it. The parser collects commands into batches of BATCH_SIZE and pushes each through a
+// lock-free single-producer, single-consumer ring; the simulator pops them a batch at a time and runs them in the
+// order they were pushed, so the replay is exactly the serial one. A full ring makes the parser wait for the
+// simulator, which bounds the memory in flight however far ahead the parser gets.
+//
+// A Command is a fixed-size record whose file name points into the mapped trace, so the trace must stay mapped until
+// the simulator has drained the pipeline.
+class CommandPipeline {
+    public:
+        static const size_t BATCH_SIZE = 256;
+        static const size_t DEFAULT_CAPACITY = 64 * BATCH_SIZE;
+
+        explicit CommandPipeline(const size_t capacity = DEFAULT_CAPACITY) : ring(capacity), batches(0), parser_waits(0),
+            simulator_waits(0) {
+            pending.reserve(BATCH_SIZE);
+        }
+
+        // Queues command for the simulator. Parser thread only.
+        void Emit(const Command & command) {
+            pending.push_back(command);
+            if (pending.size() == BATCH_SIZE) {
+                Flush();
+            }
+        }
+
+        // Pushes the last partial batch and tells the simulator there is nothing more. Parser thread only.
+        void Finish() {
+            Flush();
+            ring.Close();
+        }
+
+        // Calls visit on every command, in order, until the parser has finished and the ring is empty. Simulator thread
+        // only. Returns the number of commands.
+        template <typename Visitor>
+        unsigned long long Drain(Visitor visit) {
+            unsigned long long number_of_commands = 0;
+            Command batch[BATCH_SIZE];
+            unsigned int spins = 0;
+            while (true) {
+                // Closed is read before the pop, so a ring that was closed and then found empty has nothing left
+                bool closed = ring.Closed();
+                size_t popped = ring.TryPop(batch, BATCH_SIZE);
+                if (popped == 0) {
+                    if (closed) {
+                        return number_of_commands;
+                    }
+                    Wait(spins, simulator_waits);
+                    continue;
+                }
+                spins = 0;
+                for (size_t i = 0; i < popped; i++) {
+                    visit(batch[i]);
+                }
+                number_of_commands += popped;
+            }
+        }
+
+        // The batches the parser pushed, and how often the parser found the ring full and the simulator found it empty.
+        // Read them after both threads are done.
+        unsigned long long GetBatches() const {
+            return batches;
+        }
+
+        unsigned long long GetParserWaits() const {
+            return parser_waits;
+        }
+
+        unsigned long long GetSimulatorWaits() const {
+            return simulator_waits;
+        }
+
+    private:
+        // Spins this many times before yielding the processor to the other thread
+        static const unsigned int SPINS_BEFORE_YIELD = 64;
+
+        SpscRing<Command> ring;
+        std::vector<Command> pending;           // The batch the parser is filling
+        unsigned long long batches;             // Written by the parser only
+        unsigned long long parser_waits;        // Written by the parser only
+        unsigned long long simulator_waits;     // Written by the simulator only
+
+        // Pushes the pending batch, waiting while the ring is full.
+        void Flush() {
+            size_t pushed = 0;
+            unsigned int spins = 0;
+            while (pushed < pending.size()) {
+                size_t now = ring.TryPush(pending.data() + pushed, pending.size() - pushed);
+                if (now == 0) {
+                    Wait(spins, parser_waits);
+                    continue;
+                }
+                spins = 0;
+                pushed += now;
+            }
+            if (!pending.empty()) {
+                batches++;
+            }
+            pending.clear();
+        }
+
+        // Backs off after a failed push or pop, counting the first failure of every wait.
+        static void Wait(unsigned int & spins, unsigned long long & waits) {
+            if (spins == 0) {
+                waits++;
+            }
+            if (++spins > SPINS_BEFORE_YIELD) {
+                std::this_thread::yield();
+            }
+        }
+
+        CommandPipeline(const CommandPipeline &);
+        CommandPipeline & operator=(const CommandPipeline &);
+};
+
+#endif // COMMAND_PIPELINE_H
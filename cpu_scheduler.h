@@ -0,0 +1,487 @@
+#ifndef CPU_SCHEDULER_H
+#define CPU_SCHEDULER_H
+
+#include "PCB.h"
+#include "checkpoint.h"
+#include "process_table.h"
+#include "ready_queue.h"
+#include "work_stealing_deque.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <vector>
+
+// The order in which ready processes get the CPU.
+enum CpuSchedulingPolicy {
+    CPU_ROUND_ROBIN,    // One queue, served in turn
+    CPU_MLFQ,           // Multilevel feedback queue: processes that use up their quantum drop to a lower level
+    CPU_PRIORITY,       // Lowest nice value first, round robin within a nice value
+    CPU_FAIR            // Least weighted CPU time first, like Linux's completely fair scheduler
+};
+
+inline const char* CpuSchedulingPolicyName(const CpuSchedulingPolicy policy) {
+    switch (policy) {
+        case CPU_ROUND_ROBIN: return "rr";
+        case CPU_MLFQ: return "mlfq";
+        case CPU_PRIORITY: return "priority";
+        case CPU_FAIR: return "cfs";
+    }
+    return "?";
+}
+
+// Converts a policy name as printed by CpuSchedulingPolicyName. Returns false if the name is unknown.
+inline bool ParseCpuSchedulingPolicy(const char* name, CpuSchedulingPolicy & policy) {
+    const CpuSchedulingPolicy policies[] = { CPU_ROUND_ROBIN, CPU_MLFQ, CPU_PRIORITY, CPU_FAIR };
+    for (CpuSchedulingPolicy candidate : policies) {
+        if (std::strcmp(name, CpuSchedulingPolicyName(candidate)) == 0) {
+            policy = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Which core's run queue a new process joins, when there are several cores.
+enum CoreAffinityPolicy {
+    CORE_AFFINITY_LEAST_LOADED,     // The core with the fewest processes running or queued, lowest number first
+    CORE_AFFINITY_PARENT,           // The core of the process that forked it, or the current core for A
+    CORE_AFFINITY_SPREAD            // Each core in turn
+};
+
+inline const char* CoreAffinityPolicyName(const CoreAffinityPolicy policy) {
+    switch (policy) {
+        case CORE_AFFINITY_LEAST_LOADED: return "least-loaded";
+        case CORE_AFFINITY_PARENT: return "parent";
+        case CORE_AFFINITY_SPREAD: return "spread";
+    }
+    return "?";
+}
+
+// Converts a policy name as printed by CoreAffinityPolicyName. Returns false if the name is unknown.
+inline bool ParseCoreAffinityPolicy(const char* name, CoreAffinityPolicy & policy) {
+    const CoreAffinityPolicy policies[] = { CORE_AFFINITY_LEAST_LOADED, CORE_AFFINITY_PARENT, CORE_AFFINITY_SPREAD };
+    for (CoreAffinityPolicy candidate : policies) {
+        if (std::strcmp(name, CoreAffinityPolicyName(candidate)) == 0) {
+            policy = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Holds the processes that are ready to run and decides which one gets the CPU next. The process using the CPU is
+// never held by the scheduler, and the operating system never queues a process twice.
+// With several cores, each core has a scheduler of its own, and a core that runs out of processes takes another
+// core's next one through PickNext.
+class CpuScheduler {
+    public:
+        virtual ~CpuScheduler() {}
+
+        // The process became ready: it is new, came back from a disk, or stopped waiting for its children.
+        virtual void Enqueue(PCB* pcb) = 0;
+
+        // The process using the CPU used up its time quantum and goes back to wait for the CPU.
+        virtual void Preempt(PCB* pcb) {
+            Enqueue(pcb);
+        }
+
+        // Removes and returns the process that gets the CPU next, or nullptr if none is ready.
+        virtual PCB* PickNext() = 0;
+
+        // Removes a queued process, because it has terminated.
+        virtual void Remove(PCB* pcb) = 0;
+
+        // One tick of the clock has passed with running on the CPU, or nullptr if the CPU was idle.
+        virtual void Tick(PCB*) {}
+
+        // Appends the queued processes to out, in the order they would get the CPU if nothing changed.
+        virtual void Collect(std::vector<PCB*> & out) const = 0;
+
+        virtual size_t Size() const = 0;
+
+        // Write and read the scheduler's own state, not counting its queued processes. To restore a scheduler, Load
+        // it and then Enqueue the processes in the order Collect gave them, with their saved SchedulingInfo.
+        virtual void Save(CheckpointWriter &) const {}
+
+        virtual bool Load(CheckpointReader &) {
+            return true;
+        }
+};
+
+// Serves the ready processes in turn.
+class RoundRobinCpuScheduler : public CpuScheduler {
+    public:
+        void Enqueue(PCB* pcb) {
+            queue.PushBack(pcb);
+        }
+
+        PCB* PickNext() {
+            return queue.Empty() ? nullptr : queue.PopFront();
+        }
+
+        void Remove(PCB* pcb) {
+            queue.Remove(pcb);
+        }
+
+        void Collect(std::vector<PCB*> & out) const {
+            for (PCB* itr = queue.Front(); itr != nullptr; itr = ReadyQueue::Next(itr)) {
+                out.push_back(itr);
+            }
+        }
+
+        size_t Size() const {
+            return queue.Size();
+        }
+
+    private:
+        ReadyQueue queue;
+};
+
+// Round robin over a work-stealing deque (see work_stealing_deque.h): the run queue of one core when there are
+// several. The core takes its next process from the top, the oldest end, which is also where other cores steal from,
+// so its processes are still served in turn. The deque holds pids and cannot give up a process from the middle, so a
+// removed process is left in place and skipped when it reaches the top. That is safe because only terminated
+// processes are removed, and they are never queued again.
+class WorkStealingCpuScheduler : public CpuScheduler {
+    public:
+        explicit WorkStealingCpuScheduler(const ProcessTable* processes_) : processes(processes_), size(0) {}
+
+        // A process that has already left the process table, as process 1 does if exit is called with the CPU idle,
+        // is not queued, since its entry could never be told apart from a removed one.
+        void Enqueue(PCB* pcb) {
+            if (!InTable(pcb)) {
+                return;
+            }
+            queue.Push(pcb->GetPid());
+            size++;
+        }
+
+        PCB* PickNext() {
+            ProcessId pid;
+            while (queue.Steal(pid)) {
+                PCB* pcb = processes->Find(pid);
+                if (IsQueued(pcb)) {
+                    size--;
+                    return pcb;
+                }
+            }
+            return nullptr;
+        }
+
+        // The operating system marks the process as no longer queued, which is what leaves its entry behind.
+        void Remove(PCB* pcb) {
+            if (InTable(pcb)) {
+                size--;
+            }
+        }
+
+        void Collect(std::vector<PCB*> & out) const {
+            std::vector<ProcessId> pids;
+            queue.Collect(pids);
+            for (ProcessId pid : pids) {
+                PCB* pcb = processes->Find(pid);
+                if (IsQueued(pcb)) {
+                    out.push_back(pcb);
+                }
+            }
+        }
+
+        size_t Size() const {
+            return size;
+        }
+
+    private:
+        const ProcessTable* processes;          // Turns the pids in the deque back into processes
+        WorkStealingDeque<ProcessId> queue;
+        size_t size;                            // Processes queued, not counting the entries left by removed ones
+
+        bool InTable(PCB* pcb) const {
+            return processes->Find(pcb->GetPid()) == pcb;
+        }
+
+        static bool IsQueued(PCB* pcb) {
+            return pcb != nullptr && pcb->Scheduling().queued;
+        }
+};
+
+// A round robin queue per level. New processes start at the top level and drop a level each time they use up a
+// quantum, so short and I/O-bound processes stay ahead of CPU-bound ones. Every BOOST_TICKS ticks everything is
+// moved back to the top level so nothing starves. The boost splices the lower queues onto the top one and bumps an
+// epoch instead of visiting every process: a process whose level_epoch is out of date is on the top level.
+class MlfqCpuScheduler : public CpuScheduler {
+    public:
+        static const unsigned int LEVELS = 3;
+        static const unsigned int BOOST_TICKS = 100;
+
+        MlfqCpuScheduler() : epoch(0), ticks_since_boost(0), size(0) {}
+
+        void Enqueue(PCB* pcb) {
+            Queue(pcb, LevelOf(pcb));
+        }
+
+        void Preempt(PCB* pcb) {
+            unsigned int level = LevelOf(pcb);
+            if (level + 1 < LEVELS) {
+                level++;
+            }
+            Queue(pcb, level);
+        }
+
+        PCB* PickNext() {
+            for (unsigned int level = 0; level < LEVELS; level++) {
+                if (!levels[level].Empty()) {
+                    size--;
+                    return levels[level].PopFront();
+                }
+            }
+            return nullptr;
+        }
+
+        void Remove(PCB* pcb) {
+            levels[LevelOf(pcb)].Remove(pcb);
+            size--;
+        }
+
+        void Tick(PCB*) {
+            if (++ticks_since_boost < BOOST_TICKS) {
+                return;
+            }
+            ticks_since_boost = 0;
+            epoch++;
+            for (unsigned int level = 1; level < LEVELS; level++) {
+                levels[0].Splice(levels[level]);
+            }
+        }
+
+        void Collect(std::vector<PCB*> & out) const {
+            for (unsigned int level = 0; level < LEVELS; level++) {
+                for (PCB* itr = levels[level].Front(); itr != nullptr; itr = ReadyQueue::Next(itr)) {
+                    out.push_back(itr);
+                }
+            }
+        }
+
+        size_t Size() const {
+            return size;
+        }
+
+        void Save(CheckpointWriter & writer) const {
+            writer.Put(epoch);
+            writer.Put(ticks_since_boost);
+        }
+
+        bool Load(CheckpointReader & reader) {
+            return reader.Get(epoch) && reader.Get(ticks_since_boost);
+        }
+
+    private:
+        ReadyQueue levels[LEVELS];              // Index 0 is served first
+        unsigned long long epoch;               // Number of boosts so far
+        unsigned int ticks_since_boost;
+        size_t size;
+
+        unsigned int LevelOf(PCB* pcb) const {
+            SchedulingInfo & info = pcb->Scheduling();
+            return info.level_epoch == epoch ? info.level : 0;
+        }
+
+        void Queue(PCB* pcb, const unsigned int level) {
+            SchedulingInfo & info = pcb->Scheduling();
+            info.level = level;
+            info.level_epoch = epoch;
+            levels[level].PushBack(pcb);
+            size++;
+        }
+};
+
+// A binary min-heap ordered by nice value, then by when the process was queued. Each process remembers its position
+// in the heap, so a terminated process is removed in O(log n) without searching for it.
+class PriorityCpuScheduler : public CpuScheduler {
+    public:
+        PriorityCpuScheduler() : next_sequence(0) {}
+
+        void Enqueue(PCB* pcb) {
+            SchedulingInfo & info = pcb->Scheduling();
+            info.sequence = next_sequence++;
+            info.heap_index = heap.size();
+            heap.push_back(pcb);
+            SiftUp(info.heap_index);
+        }
+
+        PCB* PickNext() {
+            if (heap.empty()) {
+                return nullptr;
+            }
+            PCB* top = heap[0];
+            RemoveAt(0);
+            return top;
+        }
+
+        void Remove(PCB* pcb) {
+            RemoveAt(pcb->Scheduling().heap_index);
+        }
+
+        void Collect(std::vector<PCB*> & out) const {
+            size_t first = out.size();
+            out.insert(out.end(), heap.begin(), heap.end());
+            std::sort(out.begin() + first, out.end(), Before);
+        }
+
+        size_t Size() const {
+            return heap.size();
+        }
+
+        void Save(CheckpointWriter & writer) const {
+            writer.Put(next_sequence);
+        }
+
+        bool Load(CheckpointReader & reader) {
+            return reader.Get(next_sequence);
+        }
+
+    private:
+        std::vector<PCB*> heap;
+        unsigned long long next_sequence;
+
+        // Returns true if a gets the CPU before b
+        static bool Before(PCB* a, PCB* b) {
+            SchedulingInfo & x = a->Scheduling();
+            SchedulingInfo & y = b->Scheduling();
+            return x.nice < y.nice || (x.nice == y.nice && x.sequence < y.sequence);
+        }
+
+        void Place(PCB* pcb, const size_t index) {
+            heap[index] = pcb;
+            pcb->Scheduling().heap_index = index;
+        }
+
+        void SiftUp(size_t index) {
+            PCB* pcb = heap[index];
+            while (index > 0 && Before(pcb, heap[(index - 1) / 2])) {
+                Place(heap[(index - 1) / 2], index);
+                index = (index - 1) / 2;
+            }
+            Place(pcb, index);
+        }
+
+        void SiftDown(size_t index) {
+            PCB* pcb = heap[index];
+            while (2 * index + 1 < heap.size()) {
+                size_t child = 2 * index + 1;
+                if (child + 1 < heap.size() && Before(heap[child + 1], heap[child])) {
+                    child++;
+                }
+                if (!Before(heap[child], pcb)) {
+                    break;
+                }
+                Place(heap[child], index);
+                index = child;
+            }
+            Place(pcb, index);
+        }
+
+        void RemoveAt(const size_t index) {
+            PCB* removed = heap[index];
+            PCB* last = heap.back();
+            heap.pop_back();
+            if (index < heap.size()) {
+                Place(last, index);
+                SiftDown(index);
+                SiftUp(last->Scheduling().heap_index);
+            }
+            removed->Scheduling().heap_index = SchedulingInfo::NOT_IN_HEAP;
+        }
+};
+
+// Gives each process a share of the CPU in proportion to its weight. A process's virtual runtime grows by one tick
+// scaled by NICE_0_WEIGHT / weight while it runs, and the process with the smallest virtual runtime runs next.
+// The ready processes are kept in a red-black tree (std::map) ordered by virtual runtime.
+class FairCpuScheduler : public CpuScheduler {
+    public:
+        FairCpuScheduler() : min_vruntime(0), next_sequence(0) {}
+
+        // A process that has been away (new, or back from a disk) starts no further behind than the most starved
+        // ready process, so it cannot hold the CPU for as long as it was gone.
+        void Enqueue(PCB* pcb) {
+            SchedulingInfo & info = pcb->Scheduling();
+            info.vruntime = std::max(info.vruntime, min_vruntime);
+            info.sequence = next_sequence++;
+            timeline[Key(info.vruntime, info.sequence)] = pcb;
+        }
+
+        PCB* PickNext() {
+            if (timeline.empty()) {
+                return nullptr;
+            }
+            std::map<Key, PCB*>::iterator leftmost = timeline.begin();
+            PCB* pcb = leftmost->second;
+            min_vruntime = std::max(min_vruntime, leftmost->first.first);
+            timeline.erase(leftmost);
+            return pcb;
+        }
+
+        void Remove(PCB* pcb) {
+            SchedulingInfo & info = pcb->Scheduling();
+            timeline.erase(Key(info.vruntime, info.sequence));
+        }
+
+        void Tick(PCB* running) {
+            if (running != nullptr) {
+                running->Scheduling().vruntime += VruntimePerTick(running->Scheduling().nice);
+            }
+        }
+
+        void Collect(std::vector<PCB*> & out) const {
+            for (std::map<Key, PCB*>::const_iterator itr = timeline.begin(); itr != timeline.end(); ++itr) {
+                out.push_back(itr->second);
+            }
+        }
+
+        size_t Size() const {
+            return timeline.size();
+        }
+
+        void Save(CheckpointWriter & writer) const {
+            writer.Put(min_vruntime);
+            writer.Put(next_sequence);
+        }
+
+        bool Load(CheckpointReader & reader) {
+            return reader.Get(min_vruntime) && reader.Get(next_sequence);
+        }
+
+    private:
+        typedef std::pair<unsigned long long, unsigned long long> Key;     // (vruntime, sequence)
+        static const unsigned long long NICE_0_WEIGHT = 1024;
+
+        std::map<Key, PCB*> timeline;
+        unsigned long long min_vruntime;        // Never decreases; the vruntime of the last process picked, at least
+        unsigned long long next_sequence;
+
+        // Each step of nice changes the share of the CPU by about 10%, as in Linux.
+        static unsigned long long VruntimePerTick(const int nice) {
+            static const unsigned long long weights[40] = {
+                88761, 71755, 56483, 46273, 36291, 29154, 23254, 18705, 14949, 11916,
+                9548, 7620, 6100, 4904, 3906, 3121, 2501, 1991, 1586, 1277,
+                1024, 820, 655, 526, 423, 335, 272, 215, 172, 137,
+                110, 87, 70, 56, 45, 36, 29, 23, 18, 15
+            };
+            return NICE_0_WEIGHT * NICE_0_WEIGHT / weights[nice + 20];
+        }
+};
+
+// Creates the scheduler for policy. The caller owns it.
+inline CpuScheduler* NewCpuScheduler(const CpuSchedulingPolicy policy) {
+    switch (policy) {
+        case CPU_MLFQ: return new MlfqCpuScheduler();
+        case CPU_PRIORITY: return new PriorityCpuScheduler();
+        case CPU_FAIR: return new FairCpuScheduler();
+        case CPU_ROUND_ROBIN: break;
+    }
+    return new RoundRobinCpuScheduler();
+}
+
+#endif // CPU_SCHEDULER_H
@@ -1,75 +1,139 @@
 #ifndef DISK_H
 #define DISK_H
 
-#include <list>
+#include "process_id.h"
+#include "file_names.h"
+#include "disk_scheduler.h"
+#include "histogram.h"
+#include "metrics.h"
+#include "checkpoint.h"
+#include "state_log.h"
+
+#include <iostream>
 #include <string>
+#include <vector>
 
 class HardDisk {
     public:
-        HardDisk() : current_process(-1), current_file(""), io_queue(0) {}
+        static const unsigned int NO_SLOT = static_cast<unsigned int>(-1);      // Returned by Request when the process goes straight to the disk
+
+        HardDisk(const FileNameTable* file_names_) : current_process(-1), current_file(0), file_names(file_names_), queue_head(NO_SLOT), queue_tail(NO_SLOT), queue_length(0),
+            policy(DISK_FCFS), scheduler(new FcfsDiskScheduler()), next_sequence(0), head_cylinder(0), clock_ms(0),
+            current_arrival_ms(0), current_start_ms(0), current_service_ms(0), completed_requests(0), cancelled_requests(0), seek_cylinders(0),
+            state_log(nullptr), disk_number(0) {}
         
-        ~HardDisk() {}
+        ~HardDisk() {
+            delete scheduler;
+        }
 
-        // A process with the given pid requests to use the disk to read/write the file file_name.
-        void Request(const std::string & file_name, const int & pid) {
+        // Chooses the order in which waiting requests are served. Requests already waiting are kept.
+        void SetSchedulingPolicy(const DiskSchedulingPolicy policy_) {
+            DiskScheduler* new_scheduler = NewDiskScheduler(policy_, geometry);
+            for (unsigned int itr = queue_head; itr != NO_SLOT; itr = slots[itr].next) {
+                new_scheduler->Add(itr, slots[itr].cylinder, slots[itr].sequence);
+            }
+            delete scheduler;
+            scheduler = new_scheduler;
+            policy = policy_;
+        }
+
+        DiskSchedulingPolicy GetSchedulingPolicy() const {
+            return policy;
+        }
+
+        // Writes every change to this disk from now on to log, as disk number, starting with the request being served
+        // and the io queue. nullptr stops logging.
+        void SetStateLog(StateLog* log, const int number) {
+            state_log = log;
+            disk_number = number;
+            if (state_log == nullptr || DiskIsIdle()) {
+                return;
+            }
+            state_log->DiskStart(disk_number, current_process, current_file, file_names->Name(current_file));
+            for (unsigned int itr = queue_head; itr != NO_SLOT; itr = slots[itr].next) {
+                state_log->DiskQueue(disk_number, slots[itr].pid, slots[itr].file, file_names->Name(slots[itr].file));
+            }
+        }
+
+        // A process with the given pid requests to use the disk to read/write the file with id file_id.
+        // Returns the io queue slot the request was put in, or NO_SLOT if the process got the disk straight away.
+        unsigned int Request(const unsigned int file_id, const ProcessId & pid) {
+            OS_METRIC(queue_lengths.Add(queue_length));
             // If there is no process using the disk already, it can go straight to the disk
             if (DiskIsIdle()) {
-                current_process = pid;
-                current_file = file_name;
+                StartService(pid, file_id, clock_ms, DiskChoice::NO_TURN);
+                return NO_SLOT;
             }
             // Otherwise add the process to the io queue
             else {
-                io_queue.push_back(std::pair<int, std::string>(pid, file_name));
+                unsigned int slot = NewSlot();
+                QueueSlot & request = slots[slot];
+                request.pid = pid;
+                request.file = file_id;
+                request.cylinder = CylinderOfFile(file_id);
+                request.sequence = next_sequence++;
+                request.arrival_ms = clock_ms;
+                request.prev = queue_tail;
+                request.next = NO_SLOT;
+                if (queue_tail != NO_SLOT) {
+                    slots[queue_tail].next = slot;
+                }
+                else {
+                    queue_head = slot;
+                }
+                queue_tail = slot;
+                queue_length++;
+                scheduler->Add(slot, request.cylinder, request.sequence);
+                if (state_log != nullptr) {
+                    state_log->DiskQueue(disk_number, pid, file_id, file_names->Name(file_id));
+                }
+                return slot;
             }
         }
 
         // The process currently using the disk is removed and returns to the ready queue. If there is another process waiting
         // to use the disk, it can come from the io queue.
-        int RemoveProcess() {
-            int removed_process = current_process;
-            if (!DiskIsIdle()) {
-                // No process is waiting to use the disk; set idle
-                if (io_queue.empty()) {
-                    current_process = -1;
-                    current_file = "";
-                }
-
-                // Otherwise let the next process on the queue use the disk
-                else {
-                    current_process = io_queue.front().first;
-                    current_file = io_queue.front().second;
-                    io_queue.pop_front();
-                }
-            }
-            return removed_process;
+        ProcessId RemoveProcess() {
+            return FinishCurrent(true);
         }
 
-        // Removes the given process if it is found using the disk or in its io queue
-        void Remove(const int & pid) {
+        // Removes the given process, which is either using the disk or waiting in the io queue slot returned by its Request.
+        void Remove(const ProcessId & pid, const unsigned int slot) {
             // If the process is using the disk
             if (current_process == pid) {
-                RemoveProcess();
+                FinishCurrent(false);
             }
             // If the process is in the io queue
-            for (auto itr = io_queue.begin(); itr != io_queue.end(); itr++) {
-                if ((*itr).first == pid) {
-                    io_queue.erase(itr);
+            else if (slot < slots.size() && slots[slot].pid == pid) {
+                Unlink(slot);
+                if (state_log != nullptr) {
+                    state_log->DiskCancel(disk_number, pid);
                 }
             }
         }
 
         // Returns the pid of the process currently using the disk
-        int GetCurrentProcess() const {
+        ProcessId GetCurrentProcess() const {
             return current_process;
         }
 
-        // Returns the name of the file that the current process is reading or writing
-        std::string GetCurrentFile() const {
+        // Returns how long the current request takes to serve, in simulated milliseconds, by the disk's seek model
+        double GetCurrentServiceMs() const {
+            return current_service_ms;
+        }
+
+        // Returns the id of the file that the current process is reading or writing
+        unsigned int GetCurrentFileId() const {
             return current_file;
         }
 
+        // Returns the name of the file that the current process is reading or writing
+        const std::string & GetCurrentFile() const {
+            return file_names->Name(current_file);
+        }
+
         // Sets the current process to the given pid
-        void SetCurrentProcess(const int & pid) {
+        void SetCurrentProcess(const ProcessId & pid) {
             current_process = pid;
         }
 
@@ -78,18 +142,268 @@ class HardDisk {
             return current_process == -1;
         }
 
+        // Returns the number of processes waiting in the io queue
+        size_t GetQueueLength() const {
+            return queue_length;
+        }
+
         // Prints the process using the disk, the file it is reading/writing, and the items on the io queue.
         void PrintQueue() const {
-            for (auto itr = io_queue.begin(); itr != io_queue.end(); itr++) {
-                std::cout << "<- [" << (*itr).first << " " << (*itr).second << "] ";
+            for (unsigned int itr = queue_head; itr != NO_SLOT; itr = slots[itr].next) {
+                std::cout << "<- [" << slots[itr].pid << " " << file_names->Name(slots[itr].file) << "] ";
             }
             std::cout << std::endl;
         }
 
+        // Prints how requests have fared on this disk. Times are simulated milliseconds of disk activity: the disk's clock
+        // only moves while it is serving a request, and a request's queueing latency is how long it waited behind others.
+        void PrintStats() const {
+            double throughput = clock_ms > 0 ? completed_requests * 1000.0 / clock_ms : 0;
+            std::cout << "policy " << DiskSchedulingPolicyName(policy) << ", " << completed_requests << " completed, "
+                      << cancelled_requests << " cancelled, busy " << clock_ms << " ms, throughput " << throughput << " requests/s" << std::endl;
+            std::cout << "  queueing ms: mean " << queue_latency_us.Mean() / 1000 << "  p50 " << queue_latency_us.Percentile(0.5) / 1000.0
+                      << "  p95 " << queue_latency_us.Percentile(0.95) / 1000.0 << "  p99 " << queue_latency_us.Percentile(0.99) / 1000.0
+                      << "  max " << queue_latency_us.Max() / 1000.0 << std::endl;
+            std::cout << "  service ms:  mean " << service_time_us.Mean() / 1000 << "  p50 " << service_time_us.Percentile(0.5) / 1000.0
+                      << "  p95 " << service_time_us.Percentile(0.95) / 1000.0 << "  p99 " << service_time_us.Percentile(0.99) / 1000.0
+                      << "  max " << service_time_us.Max() / 1000.0 << "  seek cylinders " << seek_cylinders << std::endl;
+        }
+
+        // Writes the statistics of this disk, with every name starting with prefix.
+        void WriteMetrics(MetricsWriter & writer, const std::string & prefix) const {
+            writer.Counter(prefix + "completed", completed_requests);
+            writer.Counter(prefix + "cancelled", cancelled_requests);
+            writer.Counter(prefix + "seek_cylinders", seek_cylinders);
+            writer.Counter(prefix + "busy_us", static_cast<unsigned long long>(clock_ms * 1000));
+            writer.Distribution(prefix + "queue_latency_us", queue_latency_us);
+            writer.Distribution(prefix + "service_time_us", service_time_us);
+            OS_METRIC(writer.Distribution(prefix + "io_queue_length", queue_lengths));
+        }
+
+        // Writes the io queue, the request being served, the head position and the statistics of this disk.
+        void Save(CheckpointWriter & writer) const {
+            writer.Put(current_process);
+            writer.Put(current_file);
+            writer.PutVector(slots);
+            writer.PutVector(free_slots);
+            writer.Put(queue_head);
+            writer.Put(queue_tail);
+            writer.Put(static_cast<unsigned long long>(queue_length));
+            writer.Put(policy);
+            writer.Put(next_sequence);
+            writer.Put(head_cylinder);
+            writer.Put(clock_ms);
+            writer.Put(current_arrival_ms);
+            writer.Put(current_start_ms);
+            writer.Put(current_service_ms);
+            writer.Put(completed_requests);
+            writer.Put(cancelled_requests);
+            writer.Put(seek_cylinders);
+            queue_latency_us.Save(writer);
+            service_time_us.Save(writer);
+            scheduler->Save(writer);
+        }
+
+        // Replaces the state of this disk with one written by Save. The scheduler is rebuilt from the io queue.
+        bool Load(CheckpointReader & reader) {
+            unsigned long long length = 0;
+            if (!reader.Get(current_process) || !reader.Get(current_file) || !reader.GetVector(slots) || !reader.GetVector(free_slots)
+                || !reader.Get(queue_head) || !reader.Get(queue_tail) || !reader.Get(length) || !reader.Get(policy)
+                || !reader.Get(next_sequence) || !reader.Get(head_cylinder) || !reader.Get(clock_ms) || !reader.Get(current_arrival_ms)
+                || !reader.Get(current_start_ms) || !reader.Get(current_service_ms) || !reader.Get(completed_requests)
+                || !reader.Get(cancelled_requests) || !reader.Get(seek_cylinders)
+                || !queue_latency_us.Load(reader) || !service_time_us.Load(reader)) {
+                return false;
+            }
+            queue_length = length;
+            file_cylinders.clear();
+            if (!QueueIsValid() || (!DiskIsIdle() && current_file >= file_names->Size())) {
+                return reader.Fail();
+            }
+            SetSchedulingPolicy(policy);
+            return scheduler->Load(reader);
+        }
+
+        // Returns the histogram of queueing latencies of completed requests, in simulated microseconds
+        const Histogram & GetQueueLatencyHistogram() const {
+            return queue_latency_us;
+        }
+
+        // Returns the histogram of service times of completed requests, in simulated microseconds
+        const Histogram & GetServiceTimeHistogram() const {
+            return service_time_us;
+        }
+
     private:
-        int current_process;                                    // Pid of the process currently using the hard disk. Set to -1 when idle
-        std::string current_file;                               // The name of the file the current process is reading/writing
-        std::list<std::pair<int, std::string>> io_queue;        // The pids of processes waiting to use the CPU, and the names of the files associated with them
+        // One waiting request. The io queue is a doubly linked list of these, stored in slots and linked by index.
+        struct QueueSlot {
+            ProcessId pid;                      // Waiting process, or -1 while the slot is free
+            unsigned int file;                  // Id of the file it wants
+            unsigned int cylinder;              // Where that file is on the disk
+            unsigned long long sequence;        // Arrival order on this disk
+            double arrival_ms;                  // Disk clock when the request arrived
+            unsigned int prev;                  // Slot queued ahead of this one
+            unsigned int next;                  // Slot queued behind this one
+        };
+
+        ProcessId current_process;                              // Pid of the process currently using the hard disk. Set to -1 when idle
+        unsigned int current_file;                              // The id of the file the current process is reading/writing
+        const FileNameTable* file_names;                        // Turns file ids back into names
+        std::vector<QueueSlot> slots;                           // Storage for the io queue; freed slots are reused
+        std::vector<unsigned int> free_slots;                   // Slots not holding a request
+        unsigned int queue_head;                                // The process that has waited longest
+        unsigned int queue_tail;                                // The process that requested the disk most recently
+        size_t queue_length;
+
+        DiskSchedulingPolicy policy;
+        DiskScheduler* scheduler;                               // Picks which waiting request is served next
+        DiskGeometry geometry;
+        std::vector<unsigned int> file_cylinders;               // Cylinder of each file id, filled in as files are first used
+        unsigned long long next_sequence;
+        unsigned int head_cylinder;                             // Where the head is
+        double clock_ms;                                        // Total time the disk has spent serving requests
+        double current_arrival_ms;                              // When the current request arrived
+        double current_start_ms;                                // When the disk started serving it
+        double current_service_ms;                              // How long it takes to serve
+
+        unsigned long long completed_requests;
+        unsigned long long cancelled_requests;                  // Requests dropped because their process terminated while being served
+        unsigned long long seek_cylinders;                      // Total distance the head has moved
+        Histogram queue_latency_us;
+        Histogram service_time_us;
+#ifdef OS_METRICS
+        Histogram queue_lengths;                                // Length of the io queue seen by each arriving request
+#endif
+        StateLog* state_log;                                    // Sees every change to the disk, if set
+        int disk_number;                                        // The number of this disk in the log
+
+        HardDisk(const HardDisk &);
+        HardDisk & operator=(const HardDisk &);
+
+        unsigned int CylinderOfFile(const unsigned int file_id) {
+            while (file_cylinders.size() <= file_id) {
+                file_cylinders.push_back(geometry.CylinderOf(file_names->Name(file_cylinders.size())));
+            }
+            return file_cylinders[file_id];
+        }
+
+        // Makes the process the current one and moves the head to its file, by way of turn_cylinder if there is one.
+        void StartService(const ProcessId pid, const unsigned int file_id, const double arrival_ms, const unsigned int turn_cylinder) {
+            current_process = pid;
+            current_file = file_id;
+            current_arrival_ms = arrival_ms;
+            current_start_ms = clock_ms;
+
+            unsigned int target = CylinderOfFile(file_id);
+            unsigned long long distance;
+            if (turn_cylinder != DiskChoice::NO_TURN) {
+                distance = Distance(head_cylinder, turn_cylinder) + Distance(turn_cylinder, target);
+            }
+            else {
+                distance = Distance(head_cylinder, target);
+            }
+            seek_cylinders += distance;
+            head_cylinder = target;
+            current_service_ms = geometry.SeekMs(distance) + geometry.RotationMs() + geometry.transfer_ms;
+            if (state_log != nullptr) {
+                state_log->DiskStart(disk_number, pid, file_id, file_names->Name(file_id));
+            }
+        }
+
+        // Ends the current request, either because it completed or because its process terminated, and starts the next one.
+        ProcessId FinishCurrent(const bool completed) {
+            ProcessId removed_process = current_process;
+            if (!DiskIsIdle()) {
+                if (completed) {
+                    clock_ms += current_service_ms;
+                    completed_requests++;
+                    queue_latency_us.Add(static_cast<unsigned long long>((current_start_ms - current_arrival_ms) * 1000));
+                    service_time_us.Add(static_cast<unsigned long long>(current_service_ms * 1000));
+                }
+                else {
+                    cancelled_requests++;
+                }
+                if (state_log != nullptr) {
+                    if (completed) {
+                        state_log->DiskFinish(disk_number, removed_process);
+                    }
+                    else {
+                        state_log->DiskCancel(disk_number, removed_process);
+                    }
+                }
+
+                // No process is waiting to use the disk; set idle
+                if (queue_head == NO_SLOT) {
+                    current_process = -1;
+                    current_file = 0;
+                }
+
+                // Otherwise let the next process on the queue use the disk
+                else {
+                    DiskChoice next = scheduler->PickNext(head_cylinder, queue_head);
+                    QueueSlot request = slots[next.slot];
+                    Unlink(next.slot);
+                    StartService(request.pid, request.file, request.arrival_ms, next.turn_cylinder);
+                }
+            }
+            return removed_process;
+        }
+
+        static unsigned long long Distance(const unsigned int from, const unsigned int to) {
+            return from > to ? from - to : to - from;
+        }
+
+        // Returns true if the io queue links stay inside slots, reach queue_tail in queue_length steps and name known files.
+        bool QueueIsValid() const {
+            if (policy < DISK_FCFS || policy > DISK_C_LOOK) {
+                return false;
+            }
+            size_t steps = 0;
+            unsigned int last = NO_SLOT;
+            for (unsigned int itr = queue_head; itr != NO_SLOT; itr = slots[itr].next) {
+                if (itr >= slots.size() || steps++ >= queue_length || slots[itr].prev != last || slots[itr].file >= file_names->Size()) {
+                    return false;
+                }
+                last = itr;
+            }
+            for (unsigned int slot : free_slots) {
+                if (slot >= slots.size()) {
+                    return false;
+                }
+            }
+            return last == queue_tail && steps == queue_length;
+        }
+
+        unsigned int NewSlot() {
+            if (free_slots.empty()) {
+                slots.push_back(QueueSlot());
+                return slots.size() - 1;
+            }
+            unsigned int slot = free_slots.back();
+            free_slots.pop_back();
+            return slot;
+        }
+
+        // Takes the slot out of the io queue and frees it.
+        void Unlink(const unsigned int slot) {
+            QueueSlot & request = slots[slot];
+            scheduler->Remove(slot, request.cylinder, request.sequence);
+            if (request.prev != NO_SLOT) {
+                slots[request.prev].next = request.next;
+            }
+            else {
+                queue_head = request.next;
+            }
+            if (request.next != NO_SLOT) {
+                slots[request.next].prev = request.prev;
+            }
+            else {
+                queue_tail = request.prev;
+            }
+            request.pid = -1;
+            queue_length--;
+            free_slots.push_back(slot);
+        }
 };
 
 #endif // DISK_H
@@ -0,0 +1,245 @@
+#ifndef DISK_SCHEDULER_H
+#define DISK_SCHEDULER_H
+
+#include "checkpoint.h"
+
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+
+// The order in which a disk serves the requests waiting in its io queue.
+enum DiskSchedulingPolicy {
+    DISK_FCFS,          // First come, first served
+    DISK_SSTF,          // Shortest seek time first
+    DISK_SCAN,          // Elevator that runs to the edge of the disk before turning around
+    DISK_LOOK,          // Elevator that turns around at the last request in its direction
+    DISK_C_LOOK         // Serves upwards only, jumping back to the lowest request at the top
+};
+
+inline const char* DiskSchedulingPolicyName(const DiskSchedulingPolicy policy) {
+    switch (policy) {
+        case DISK_FCFS: return "fcfs";
+        case DISK_SSTF: return "sstf";
+        case DISK_SCAN: return "scan";
+        case DISK_LOOK: return "look";
+        case DISK_C_LOOK: return "c-look";
+    }
+    return "?";
+}
+
+// Converts a policy name as printed by DiskSchedulingPolicyName. Returns false if the name is unknown.
+inline bool ParseDiskSchedulingPolicy(const char* name, DiskSchedulingPolicy & policy) {
+    const DiskSchedulingPolicy policies[] = { DISK_FCFS, DISK_SSTF, DISK_SCAN, DISK_LOOK, DISK_C_LOOK };
+    for (DiskSchedulingPolicy candidate : policies) {
+        if (std::strcmp(name, DiskSchedulingPolicyName(candidate)) == 0) {
+            policy = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// A simple mechanical model of a disk. Each file lives at a fixed block, found by hashing its name, and the time to
+// serve a request is the seek to the file's cylinder, an average half rotation and a fixed transfer time.
+struct DiskGeometry {
+    unsigned int cylinders;
+    unsigned int blocks_per_cylinder;
+    double rpm;
+    double seek_settle_ms;              // Cost of any seek that moves the head at all
+    double seek_ms_per_cylinder;        // Added for every cylinder crossed
+    double transfer_ms;                 // Time to read or write the file once the head is over it
+
+    DiskGeometry() : cylinders(10000), blocks_per_cylinder(1024), rpm(7200), seek_settle_ms(0.5), seek_ms_per_cylinder(0.002), transfer_ms(0.1) {}
+
+    // Returns the cylinder holding the file with the given name.
+    unsigned int CylinderOf(const std::string & file_name) const {
+        // FNV-1a
+        unsigned long long hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < file_name.size(); i++) {
+            hash ^= static_cast<unsigned char>(file_name[i]);
+            hash *= 1099511628211ULL;
+        }
+        unsigned long long block = hash % (static_cast<unsigned long long>(cylinders) * blocks_per_cylinder);
+        return static_cast<unsigned int>(block / blocks_per_cylinder);
+    }
+
+    double SeekMs(const unsigned long long distance) const {
+        return distance == 0 ? 0 : seek_settle_ms + seek_ms_per_cylinder * distance;
+    }
+
+    double RotationMs() const {
+        return 0.5 * 60000.0 / rpm;
+    }
+};
+
+// The next request chosen by a scheduler.
+struct DiskChoice {
+    static const unsigned int NO_TURN = static_cast<unsigned int>(-1);
+
+    unsigned int slot;                  // io queue slot of the chosen request
+    unsigned int turn_cylinder;         // A cylinder the head has to visit on the way, or NO_TURN
+
+    DiskChoice(const unsigned int slot_, const unsigned int turn_cylinder_) : slot(slot_), turn_cylinder(turn_cylinder_) {}
+};
+
+// Decides which waiting request a disk serves next. The disk tells the scheduler about every request that joins or
+// leaves its io queue, and asks it for the next one each time the current request finishes.
+class DiskScheduler {
+    public:
+        virtual ~DiskScheduler() {}
+
+        // A request for the given cylinder joined the io queue. sequence increases with every request, so it gives arrival order.
+        virtual void Add(const unsigned int slot, const unsigned int cylinder, const unsigned long long sequence) = 0;
+
+        // A request left the io queue, either to be served or because its process terminated.
+        virtual void Remove(const unsigned int slot, const unsigned int cylinder, const unsigned long long sequence) = 0;
+
+        // Picks the request to serve next. head is the head's cylinder and oldest_slot the request that has waited longest.
+        // The io queue is not empty.
+        virtual DiskChoice PickNext(const unsigned int head, const unsigned int oldest_slot) = 0;
+
+        // Write and read the scheduler's own state, not counting the requests, which the disk adds back on restore.
+        virtual void Save(CheckpointWriter &) const {}
+
+        virtual bool Load(CheckpointReader &) {
+            return true;
+        }
+};
+
+// Serves requests in arrival order, which the disk's io queue already keeps.
+class FcfsDiskScheduler : public DiskScheduler {
+    public:
+        void Add(const unsigned int, const unsigned int, const unsigned long long) {}
+        void Remove(const unsigned int, const unsigned int, const unsigned long long) {}
+
+        DiskChoice PickNext(const unsigned int, const unsigned int oldest_slot) {
+            return DiskChoice(oldest_slot, DiskChoice::NO_TURN);
+        }
+};
+
+// Base for the schedulers that need the waiting requests sorted by cylinder. Ties go to the oldest request.
+class CylinderOrderedDiskScheduler : public DiskScheduler {
+    public:
+        void Add(const unsigned int slot, const unsigned int cylinder, const unsigned long long sequence) {
+            pending[Key(cylinder, sequence)] = slot;
+        }
+
+        void Remove(const unsigned int, const unsigned int cylinder, const unsigned long long sequence) {
+            pending.erase(Key(cylinder, sequence));
+        }
+
+    protected:
+        typedef std::pair<unsigned int, unsigned long long> Key;       // (cylinder, arrival sequence)
+        std::map<Key, unsigned int> pending;                            // Waiting requests and their slots
+
+        // Returns the first request at or above cylinder, or pending.end()
+        std::map<Key, unsigned int>::iterator AtOrAbove(const unsigned int cylinder) {
+            return pending.lower_bound(Key(cylinder, 0));
+        }
+
+        // Returns the last request strictly below cylinder, or pending.end()
+        std::map<Key, unsigned int>::iterator Below(const unsigned int cylinder) {
+            std::map<Key, unsigned int>::iterator itr = pending.lower_bound(Key(cylinder, 0));
+            if (itr == pending.begin()) {
+                return pending.end();
+            }
+            --itr;
+            // Move to the oldest request on that cylinder
+            std::map<Key, unsigned int>::iterator oldest = pending.lower_bound(Key(itr->first.first, 0));
+            return oldest;
+        }
+};
+
+// Always serves the request closest to the head.
+class SstfDiskScheduler : public CylinderOrderedDiskScheduler {
+    public:
+        DiskChoice PickNext(const unsigned int head, const unsigned int) {
+            std::map<Key, unsigned int>::iterator up = AtOrAbove(head);
+            std::map<Key, unsigned int>::iterator down = Below(head);
+            if (down == pending.end() || (up != pending.end() && up->first.first - head <= head - down->first.first)) {
+                return DiskChoice(up->second, DiskChoice::NO_TURN);
+            }
+            return DiskChoice(down->second, DiskChoice::NO_TURN);
+        }
+};
+
+// The elevator algorithms. The head keeps moving the same way while there are requests ahead of it.
+// SCAN runs on to the edge of the disk before turning around; LOOK turns at the last request.
+class ElevatorDiskScheduler : public CylinderOrderedDiskScheduler {
+    public:
+        ElevatorDiskScheduler(const unsigned int cylinders_, const bool run_to_edge_) : cylinders(cylinders_), run_to_edge(run_to_edge_), moving_up(true) {}
+
+        DiskChoice PickNext(const unsigned int head, const unsigned int) {
+            if (moving_up) {
+                std::map<Key, unsigned int>::iterator up = AtOrAbove(head);
+                if (up != pending.end()) {
+                    return DiskChoice(up->second, DiskChoice::NO_TURN);
+                }
+                moving_up = false;
+                unsigned int turn = DiskChoice::NO_TURN;
+                if (run_to_edge) {
+                    turn = cylinders - 1;
+                }
+                return DiskChoice(Below(head)->second, turn);
+            }
+            std::map<Key, unsigned int>::iterator down = AtOrBelow(head);
+            if (down != pending.end()) {
+                return DiskChoice(down->second, DiskChoice::NO_TURN);
+            }
+            moving_up = true;
+            unsigned int turn = DiskChoice::NO_TURN;
+            if (run_to_edge) {
+                turn = 0;
+            }
+            return DiskChoice(AtOrAbove(head)->second, turn);
+        }
+
+        void Save(CheckpointWriter & writer) const {
+            writer.Put(moving_up);
+        }
+
+        bool Load(CheckpointReader & reader) {
+            return reader.Get(moving_up);
+        }
+
+    private:
+        unsigned int cylinders;
+        bool run_to_edge;                   // True for SCAN, false for LOOK
+        bool moving_up;                     // Direction the head is sweeping
+
+        // Returns the oldest request on the highest cylinder at or below cylinder, or pending.end()
+        std::map<Key, unsigned int>::iterator AtOrBelow(const unsigned int cylinder) {
+            std::map<Key, unsigned int>::iterator at = AtOrAbove(cylinder);
+            if (at != pending.end() && at->first.first == cylinder) {
+                return at;
+            }
+            return Below(cylinder);
+        }
+};
+
+// Serves upwards only. When nothing is left above the head it jumps back to the lowest waiting request.
+class CLookDiskScheduler : public CylinderOrderedDiskScheduler {
+    public:
+        DiskChoice PickNext(const unsigned int head, const unsigned int) {
+            std::map<Key, unsigned int>::iterator up = AtOrAbove(head);
+            if (up == pending.end()) {
+                up = pending.begin();
+            }
+            return DiskChoice(up->second, DiskChoice::NO_TURN);
+        }
+};
+
+// Creates the scheduler for policy. The caller owns it.
+inline DiskScheduler* NewDiskScheduler(const DiskSchedulingPolicy policy, const DiskGeometry & geometry) {
+    switch (policy) {
+        case DISK_SSTF: return new SstfDiskScheduler();
+        case DISK_SCAN: return new ElevatorDiskScheduler(geometry.cylinders, true);
+        case DISK_LOOK: return new ElevatorDiskScheduler(geometry.cylinders, false);
+        case DISK_C_LOOK: return new CLookDiskScheduler();
+        case DISK_FCFS: break;
+    }
+    return new FcfsDiskScheduler();
+}
+
+#endif // DISK_SCHEDULER_H
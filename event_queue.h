@@ -0,0 +1,110 @@
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// A priority queue of events keyed by time, as a 4-ary heap in one array. Events due at the same time come out in
+// the order they were pushed, so a simulation driven by it is deterministic. A 4-ary heap is half as deep as a
+// binary one and the children of a node share a cache line, which makes Pop, the common case, cheaper.
+template <typename Event>
+class EventQueue {
+    public:
+        EventQueue() : next_sequence(0) {}
+
+        // Adds event, due at time.
+        void Push(const unsigned long long time, const Event & event) {
+            Entry entry;
+            entry.time = time;
+            entry.sequence = next_sequence++;
+            entry.event = event;
+            heap.push_back(entry);
+            SiftUp(heap.size() - 1);
+        }
+
+        bool Empty() const {
+            return heap.empty();
+        }
+
+        size_t Size() const {
+            return heap.size();
+        }
+
+        // The time of the earliest event. The queue must not be empty.
+        unsigned long long TopTime() const {
+            return heap[0].time;
+        }
+
+        // Removes the earliest event, setting time and event. The queue must not be empty.
+        void Pop(unsigned long long & time, Event & event) {
+            time = heap[0].time;
+            event = heap[0].event;
+            Entry last = heap.back();
+            heap.pop_back();
+            if (!heap.empty()) {
+                heap[0] = last;
+                SiftDown(0);
+            }
+        }
+
+        void Clear() {
+            heap.clear();
+            next_sequence = 0;
+        }
+
+    private:
+        static const size_t ARITY = 4;
+
+        struct Entry {
+            unsigned long long time;
+            unsigned long long sequence;        // Push order, to break ties in time
+            Event event;
+
+            bool Before(const Entry & other) const {
+                return time < other.time || (time == other.time && sequence < other.sequence);
+            }
+        };
+
+        std::vector<Entry> heap;
+        unsigned long long next_sequence;
+
+        void SiftUp(size_t index) {
+            Entry entry = heap[index];
+            while (index > 0) {
+                size_t parent = (index - 1) / ARITY;
+                if (!entry.Before(heap[parent])) {
+                    break;
+                }
+                heap[index] = heap[parent];
+                index = parent;
+            }
+            heap[index] = entry;
+        }
+
+        void SiftDown(size_t index) {
+            Entry entry = heap[index];
+            size_t size = heap.size();
+            while (true) {
+                size_t first_child = index * ARITY + 1;
+                if (first_child >= size) {
+                    break;
+                }
+                size_t last_child = first_child + ARITY < size ? first_child + ARITY : size;
+                size_t earliest = first_child;
+                for (size_t child = first_child + 1; child < last_child; child++) {
+                    if (heap[child].Before(heap[earliest])) {
+                        earliest = child;
+                    }
+                }
+                if (!heap[earliest].Before(entry)) {
+                    break;
+                }
+                heap[index] = heap[earliest];
+                index = earliest;
+            }
+            heap[index] = entry;
+        }
+};
+
+#endif // EVENT_QUEUE_H
@@ -0,0 +1,334 @@
+#ifndef EVENT_SIMULATION_H
+#define EVENT_SIMULATION_H
+
+#include "OS.h"
+#include "event_queue.h"
+#include "process_id.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// How a random duration is drawn
+enum DistributionKind {
+    DISTRIBUTION_CONSTANT,          // Always the mean
+    DISTRIBUTION_EXPONENTIAL,       // Exponential with the mean, as for arrivals of a Poisson process
+    DISTRIBUTION_UNIFORM,           // Uniform from 0 to twice the mean
+    DISTRIBUTION_DISK_MODEL         // Disk service only: the seek, rotation and transfer time of the disk's own model
+};
+
+// A distribution of durations, with the mean in simulated microseconds.
+struct Distribution {
+    DistributionKind kind;
+    double mean_us;
+
+    Distribution(const DistributionKind kind_ = DISTRIBUTION_CONSTANT, const double mean_us_ = 0) : kind(kind_), mean_us(mean_us_) {}
+};
+
+// Reads a distribution written as const:MEAN, exp:MEAN or uniform:MEAN, with MEAN in simulated microseconds, or as
+// model. Returns false if text is none of these.
+inline bool ParseDistribution(const char* text, Distribution & distribution) {
+    if (std::strcmp(text, "model") == 0) {
+        distribution = Distribution(DISTRIBUTION_DISK_MODEL);
+        return true;
+    }
+    static const char* const names[] = { "const:", "exp:", "uniform:" };
+    static const DistributionKind kinds[] = { DISTRIBUTION_CONSTANT, DISTRIBUTION_EXPONENTIAL, DISTRIBUTION_UNIFORM };
+    for (int i = 0; i < 3; i++) {
+        size_t length = std::strlen(names[i]);
+        if (std::strncmp(text, names[i], length) == 0) {
+            char* end = nullptr;
+            double mean_us = std::strtod(text + length, &end);
+            if (text[length] == '\0' || *end != '\0' || !(mean_us > 0)) {
+                return false;
+            }
+            distribution = Distribution(kinds[i], mean_us);
+            return true;
+        }
+    }
+    return false;
+}
+
+// What an open-loop simulation generates. Durations are drawn independently for every event.
+struct SimulationSettings {
+    double duration_s;                  // Simulated time to run for
+    Distribution arrival;               // Time between process arrivals
+    Distribution burst;                 // CPU time a process uses before each disk request, and before it exits
+    Distribution quantum;               // Time slice after which a running process is preempted
+    Distribution disk;                  // Time a disk takes to serve a request
+    double disk_requests;               // Mean number of disk requests a process makes before it exits
+    unsigned long long seed;
+
+    SimulationSettings() : duration_s(1), arrival(DISTRIBUTION_EXPONENTIAL, 20000), burst(DISTRIBUTION_EXPONENTIAL, 5000),
+        quantum(DISTRIBUTION_CONSTANT, 10000), disk(DISTRIBUTION_DISK_MODEL), disk_requests(1), seed(1) {}
+};
+
+// Drives an operating system with generated events instead of typed commands, so time advances on its own and the
+// system can be loaded open-loop. Processes arrive at random, each runs a random number of CPU bursts separated by
+// disk requests, and exits after the last one; quanta expire and disks complete requests after random durations.
+// Every event goes through the same methods the commands use: CreateProcess, CPUToReadyQueue, RequestDisk,
+// RemoveProcessFromDisk and Exit.
+//
+// Events sit in an EventQueue keyed by simulated nanoseconds. After each event the cores and the disk it touched are
+// compared with what the simulation last saw, and a process that has started running or a request that has started
+// being served gets its own event. Each core and disk counts its changes, and an event made before the latest one
+// is dropped when it comes due, so nothing is ever searched for and removed from the queue.
+template <typename Replacement>
+class EventSimulation {
+    public:
+        EventSimulation(BasicOperatingSystem<Replacement> & OS_, const SimulationSettings & settings_) : OS(OS_), settings(settings_),
+            random_state(settings_.seed), now(0), end(static_cast<unsigned long long>(settings_.duration_s * 1e9)), events_processed(0),
+            stale_events(0), arrivals(0), completions(0), quantum_expiries(0), disk_requests(0),
+            cores(OS_.GetNumberOfCores()), disks(OS_.GetNumberOfHardDisks()) {
+            for (int i = 0; i < NUMBER_OF_FILES; i++) {
+                file_names.push_back("file" + std::to_string(i));
+            }
+            // Probability that a finished burst is followed by a disk request, for the mean number of requests per process
+            another_request = disks.empty() ? 0 : settings.disk_requests / (settings.disk_requests + 1);
+        }
+
+        // Runs until the simulated duration has passed. Returns the number of events handled.
+        unsigned long long Run() {
+            Schedule(EVENT_ARRIVAL, 0, 0, Sample(settings.arrival));
+            SyncCores(NO_TARGET);
+            while (!events.Empty() && events.TopTime() <= end) {
+                Event event;
+                events.Pop(now, event);
+                switch (event.type) {
+                    case EVENT_ARRIVAL:
+                        arrivals++;
+                        OS.CreateProcess();
+                        Schedule(EVENT_ARRIVAL, 0, 0, Sample(settings.arrival));
+                        SyncCores(NO_TARGET);
+                        break;
+                    case EVENT_CPU:
+                        if (event.generation != cores[event.target].generation) {
+                            stale_events++;
+                            continue;
+                        }
+                        EndSlice(event.target);
+                        break;
+                    case EVENT_DISK:
+                        if (event.generation != disks[event.target].generation) {
+                            stale_events++;
+                            continue;
+                        }
+                        OS.RemoveProcessFromDisk(static_cast<int>(event.target));
+                        SyncDisk(event.target, true);
+                        SyncCores(NO_TARGET);
+                        break;
+                }
+                events_processed++;
+            }
+            now = end;
+            return events_processed;
+        }
+
+        // Writes how much work was done and how busy every core and disk was over the simulated time.
+        void Report(std::ostream & out) const {
+            double elapsed_ns = static_cast<double>(end > 0 ? end : 1);
+            out << "Simulated " << settings.duration_s << " s: " << arrivals << " arrivals, " << completions << " completions, "
+                << quantum_expiries << " quantum expiries, " << disk_requests << " disk requests, " << arrivals - completions << " processes in the system\n";
+            for (size_t i = 0; i < cores.size(); i++) {
+                out << "Core " << i << ": " << 100.0 * BusyNs(cores[i].busy_ns, cores[i].busy_since, cores[i].running != 1) / elapsed_ns << "% busy\n";
+            }
+            for (size_t i = 0; i < disks.size(); i++) {
+                out << "Disk " << i << ": " << 100.0 * BusyNs(disks[i].busy_ns, disks[i].busy_since, disks[i].serving != -1) / elapsed_ns
+                    << "% busy, " << disks[i].completions << " completions\n";
+            }
+            out.flush();
+        }
+
+        unsigned long long StaleEvents() const {
+            return stale_events;
+        }
+
+    private:
+        static const unsigned int NO_TARGET = static_cast<unsigned int>(-1);
+        static const int NUMBER_OF_FILES = 64;          // Distinct file names the processes request
+
+        enum EventType { EVENT_ARRIVAL, EVENT_CPU, EVENT_DISK };
+
+        struct Event {
+            EventType type;
+            unsigned int target;                // The core or disk the event is for
+            unsigned long long generation;      // The target's generation when the event was made
+        };
+
+        // What the simulation last saw on a core.
+        struct CoreState {
+            ProcessId running;                  // 1 while idle
+            unsigned long long generation;      // Changes whenever a new slice starts, making older CPU events stale
+            unsigned long long slice_ns;        // Length of the current slice
+            unsigned long long busy_since;
+            unsigned long long busy_ns;
+
+            CoreState() : running(1), generation(0), slice_ns(0), busy_since(0), busy_ns(0) {}
+        };
+
+        // What the simulation last saw on a disk.
+        struct DiskState {
+            ProcessId serving;                  // -1 while idle
+            unsigned long long generation;
+            unsigned long long busy_since;
+            unsigned long long busy_ns;
+            unsigned long long completions;
+
+            DiskState() : serving(-1), generation(0), busy_since(0), busy_ns(0), completions(0) {}
+        };
+
+        BasicOperatingSystem<Replacement> & OS;
+        SimulationSettings settings;
+        unsigned long long random_state;
+        unsigned long long now;                 // Simulated nanoseconds
+        unsigned long long end;
+        unsigned long long events_processed;
+        unsigned long long stale_events;
+        unsigned long long arrivals;
+        unsigned long long completions;
+        unsigned long long quantum_expiries;
+        unsigned long long disk_requests;
+        double another_request;
+        EventQueue<Event> events;
+        std::vector<CoreState> cores;
+        std::vector<DiskState> disks;
+        std::unordered_map<ProcessId, unsigned long long> jobs;    // CPU time left in the current burst of every process
+        std::vector<std::string> file_names;
+
+        // The running process's slice on core has ended: its quantum expired, or its burst is done and it requests a
+        // disk or exits.
+        void EndSlice(const unsigned int core) {
+            if (cores.size() > 1) {
+                OS.SelectCore(static_cast<int>(core));
+            }
+            ProcessId pid = cores[core].running;
+            unsigned long long & remaining = jobs[pid];
+            remaining -= cores[core].slice_ns;
+            if (remaining > 0) {
+                quantum_expiries++;
+                OS.CPUToReadyQueue();
+            }
+            else if (Uniform() < another_request) {
+                remaining = Sample(settings.burst);
+                unsigned int disk = static_cast<unsigned int>(Uniform() * disks.size());
+                const std::string & file = file_names[static_cast<size_t>(Uniform() * NUMBER_OF_FILES)];
+                disk_requests++;
+                OS.RequestDisk(static_cast<int>(disk), file.data(), file.size());
+                SyncDisk(disk, false);
+            }
+            else {
+                completions++;
+                jobs.erase(pid);
+                OS.Exit();
+            }
+            SyncCores(core);
+        }
+
+        // Looks at every core. A core running another process than last seen, or the core whose slice just ended,
+        // starts a new slice for the process it runs, ending at its quantum or the end of its burst if that is sooner.
+        void SyncCores(const unsigned int ended) {
+            for (unsigned int i = 0; i < cores.size(); i++) {
+                CoreState & core = cores[i];
+                ProcessId running = OS.GetRunningProcess(i);
+                if (running == core.running && i != ended) {
+                    continue;
+                }
+                if (running != core.running) {
+                    if (core.running != 1) {
+                        core.busy_ns += now - core.busy_since;
+                    }
+                    if (running != 1) {
+                        core.busy_since = now;
+                    }
+                    core.running = running;
+                }
+                core.generation++;
+                if (running == 1) {
+                    continue;
+                }
+                auto job = jobs.find(running);
+                if (job == jobs.end()) {
+                    job = jobs.insert(std::make_pair(running, Sample(settings.burst))).first;
+                }
+                unsigned long long quantum = Sample(settings.quantum);
+                core.slice_ns = quantum < job->second ? quantum : job->second;
+                Schedule(EVENT_CPU, i, core.generation, core.slice_ns);
+            }
+        }
+
+        // Looks at disk. If it serves another request than last seen, or just completed one, the request it serves
+        // now gets its completion event.
+        void SyncDisk(const unsigned int index, const bool completed) {
+            DiskState & disk = disks[index];
+            ProcessId serving = OS.GetDiskProcess(static_cast<int>(index));
+            if (completed) {
+                disk.completions++;
+            }
+            else if (serving == disk.serving) {
+                return;
+            }
+            if (disk.serving != -1) {
+                disk.busy_ns += now - disk.busy_since;
+            }
+            disk.serving = serving;
+            disk.generation++;
+            if (serving == -1) {
+                return;
+            }
+            disk.busy_since = now;
+            unsigned long long service_ns;
+            if (settings.disk.kind == DISTRIBUTION_DISK_MODEL) {
+                service_ns = static_cast<unsigned long long>(OS.GetDiskServiceMs(static_cast<int>(index)) * 1e6) + 1;
+            }
+            else {
+                service_ns = Sample(settings.disk);
+            }
+            Schedule(EVENT_DISK, index, disk.generation, service_ns);
+        }
+
+        void Schedule(const EventType type, const unsigned int target, const unsigned long long generation, const unsigned long long delay_ns) {
+            Event event;
+            event.type = type;
+            event.target = target;
+            event.generation = generation;
+            events.Push(now + delay_ns, event);
+        }
+
+        // Busy time up to now of a core or disk, counting the stretch it is still busy for
+        unsigned long long BusyNs(const unsigned long long busy_ns, const unsigned long long busy_since, const bool busy) const {
+            return busy_ns + (busy ? now - busy_since : 0);
+        }
+
+        // Draws a duration in simulated nanoseconds, at least 1.
+        unsigned long long Sample(const Distribution & distribution) {
+            double us = distribution.mean_us;
+            switch (distribution.kind) {
+                case DISTRIBUTION_EXPONENTIAL:
+                    us = -distribution.mean_us * std::log(1 - Uniform());
+                    break;
+                case DISTRIBUTION_UNIFORM:
+                    us = 2 * distribution.mean_us * Uniform();
+                    break;
+                case DISTRIBUTION_CONSTANT:
+                case DISTRIBUTION_DISK_MODEL:
+                    break;
+            }
+            unsigned long long ns = static_cast<unsigned long long>(us * 1000);
+            return ns > 0 ? ns : 1;
+        }
+
+        // Draws a number in [0, 1) with splitmix64.
+        double Uniform() {
+            unsigned long long z = (random_state += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            z ^= z >> 31;
+            return (z >> 11) * (1.0 / 9007199254740992.0);
+        }
+};
+
+#endif // EVENT_SIMULATION_H
@@ -0,0 +1,98 @@
+#ifndef FILE_NAMES_H
+#define FILE_NAMES_H
+
+#include "checkpoint.h"
+
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+// Interns the file names used by disk requests. Each distinct name is stored once and referred to by a small id,
+// so queued requests carry an id instead of their own copy of the string.
+class FileNameTable {
+    public:
+        // Returns the id of the name [data, data + size), adding it to the table the first time it is seen.
+        unsigned int Intern(const char* data, const size_t size) {
+            auto found = ids.find(Key(data, size));
+            if (found != ids.end()) {
+                return found->second;
+            }
+            unsigned int id = names.size();
+            names.push_back(std::string(data, size));
+            // The key points into the stored copy, which a deque never moves
+            ids[Key(names.back().data(), size)] = id;
+            return id;
+        }
+
+        unsigned int Intern(const std::string & name) {
+            return Intern(name.data(), name.size());
+        }
+
+        // Returns the name with the given id
+        const std::string & Name(const unsigned int id) const {
+            return names[id];
+        }
+
+        // Returns the number of distinct names
+        size_t Size() const {
+            return names.size();
+        }
+
+        // Writes every name, in id order.
+        void Save(CheckpointWriter & writer) const {
+            writer.Put(static_cast<unsigned long long>(names.size()));
+            for (const std::string & name : names) {
+                writer.PutString(name);
+            }
+        }
+
+        // Replaces the table with the names written by Save, which keep their ids.
+        bool Load(CheckpointReader & reader) {
+            names.clear();
+            ids.clear();
+            unsigned long long count = 0;
+            if (!reader.Get(count)) {
+                return false;
+            }
+            std::string name;
+            for (unsigned long long i = 0; i < count; i++) {
+                if (!reader.GetString(name)) {
+                    return false;
+                }
+                Intern(name);
+            }
+            return true;
+        }
+
+    private:
+        // A name that is not owned by the key, so lookups do not need to build a std::string.
+        struct Key {
+            const char* data;
+            size_t size;
+
+            Key(const char* data_, const size_t size_) : data(data_), size(size_) {}
+
+            bool operator==(const Key & other) const {
+                return size == other.size && (size == 0 || std::memcmp(data, other.data, size) == 0);
+            }
+        };
+
+        // FNV-1a
+        struct KeyHash {
+            size_t operator()(const Key & key) const {
+                unsigned long long hash = 14695981039346656037ULL;
+                for (size_t i = 0; i < key.size; i++) {
+                    hash ^= static_cast<unsigned char>(key.data[i]);
+                    hash *= 1099511628211ULL;
+                }
+                return static_cast<size_t>(hash);
+            }
+        };
+
+        std::deque<std::string> names;                      // Index is the id of the name
+        std::unordered_map<Key, unsigned int, KeyHash> ids;
+};
+
+#endif // FILE_NAMES_H
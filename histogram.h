@@ -0,0 +1,122 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include "checkpoint.h"
+
+#include <cstddef>
+#include <vector>
+
+// A log-linear histogram of non-negative integers. Each power of two is split into 8 buckets, so any value is
+// recorded to within 12.5%, and recording is O(1) with a fixed amount of memory no matter how many values are added.
+class Histogram {
+    public:
+        Histogram() : buckets(NUMBER_OF_BUCKETS, 0), count(0), sum(0), max(0) {}
+
+        void Add(const unsigned long long value) {
+            buckets[BucketOf(value)]++;
+            count++;
+            sum += value;
+            if (value > max) {
+                max = value;
+            }
+        }
+
+        // Returns the number of values added
+        unsigned long long Count() const {
+            return count;
+        }
+
+        // Returns the sum of the values added
+        unsigned long long Sum() const {
+            return sum;
+        }
+
+        unsigned long long Max() const {
+            return max;
+        }
+
+        double Mean() const {
+            return count > 0 ? static_cast<double>(sum) / count : 0;
+        }
+
+        // Returns the value below which the fraction p (0 to 1) of the values fall, rounded up to the end of its bucket.
+        unsigned long long Percentile(const double p) const {
+            if (count == 0) {
+                return 0;
+            }
+            unsigned long long rank = static_cast<unsigned long long>(p * count);
+            if (rank >= count) {
+                rank = count - 1;
+            }
+            unsigned long long seen = 0;
+            for (size_t i = 0; i < buckets.size(); i++) {
+                seen += buckets[i];
+                if (seen > rank) {
+                    unsigned long long upper = UpperBoundOf(i);
+                    return upper < max ? upper : max;
+                }
+            }
+            return max;
+        }
+
+        // Returns the number of buckets; bucket i holds the values from LowerBoundOf(i) to UpperBoundOf(i).
+        size_t NumberOfBuckets() const {
+            return buckets.size();
+        }
+
+        unsigned long long BucketCount(const size_t i) const {
+            return buckets[i];
+        }
+
+        void Save(CheckpointWriter & writer) const {
+            writer.PutVector(buckets);
+            writer.Put(count);
+            writer.Put(sum);
+            writer.Put(max);
+        }
+
+        bool Load(CheckpointReader & reader) {
+            if (!reader.GetVector(buckets) || buckets.size() != NUMBER_OF_BUCKETS) {
+                return reader.Fail();
+            }
+            return reader.Get(count) && reader.Get(sum) && reader.Get(max);
+        }
+
+        static unsigned long long LowerBoundOf(const size_t bucket) {
+            if (bucket < SUB_BUCKETS) {
+                return bucket;
+            }
+            unsigned int msb = bucket / SUB_BUCKETS + SUB_BITS - 1;
+            unsigned long long sub = bucket % SUB_BUCKETS;
+            return (SUB_BUCKETS + sub) << (msb - SUB_BITS);
+        }
+
+        static unsigned long long UpperBoundOf(const size_t bucket) {
+            if (bucket < SUB_BUCKETS) {
+                return bucket;
+            }
+            unsigned int msb = bucket / SUB_BUCKETS + SUB_BITS - 1;
+            return LowerBoundOf(bucket) + (1ULL << (msb - SUB_BITS)) - 1;
+        }
+
+    private:
+        static const unsigned int SUB_BITS = 3;
+        static const unsigned int SUB_BUCKETS = 1 << SUB_BITS;
+        static const size_t NUMBER_OF_BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+        std::vector<unsigned long long> buckets;
+        unsigned long long count;
+        unsigned long long sum;
+        unsigned long long max;
+
+        static size_t BucketOf(const unsigned long long value) {
+            if (value < SUB_BUCKETS) {
+                return static_cast<size_t>(value);
+            }
+            unsigned int msb = 63 - __builtin_clzll(value);
+            unsigned long long sub = (value >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1);
+            return (msb - SUB_BITS + 1) * SUB_BUCKETS + sub;
+        }
+};
+
+#endif // HISTOGRAM_H
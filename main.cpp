@@ -1,35 +1,693 @@
 #include <string>
 #include <sstream>
 #include <iostream>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <thread>
 
 #include "PCB.h"
 #include "disk.h"
 #include "OS.h"
+#include "command.h"
+#include "binary_trace.h"
+#include "checkpoint.h"
+#include "mapped_file.h"
+#include "event_simulation.h"
+#include "command_pipeline.h"
 
 using namespace std;
 
-int main() {
+// Prints how to run the program.
+void PrintUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--cpu-scheduler policy] [--disk-scheduler policy] [--replacement policy] [--metrics-out file] [--metrics-timers] [--record session.bin]" << std::endl;
+    std::cerr << "       " << program << " [--cpu-scheduler policy] [--disk-scheduler policy] [--replacement policy] [--metrics-out file] [--metrics-timers] --ram bytes --page-size bytes --disks count trace.txt" << std::endl;
+    std::cerr << "       " << program << " [--cpu-scheduler policy] [--disk-scheduler policy] [--replacement policy] [--metrics-out file] [--metrics-timers] trace.bin" << std::endl;
+    std::cerr << "       " << program << " --ram bytes --page-size bytes --disks count trace.txt --convert trace.bin" << std::endl;
+    std::cerr << "       " << program << " [options] --restore checkpoint.bin [trace.txt | trace.bin]" << std::endl;
+    std::cerr << "       " << program << " [options] --mrc curve.csv [--mrc-sample-rate rate] (trace.txt | trace.bin)" << std::endl;
+    std::cerr << "       " << program << " [options] --ram bytes --page-size bytes --disks count --simulate seconds [--sim-arrival dist] [--sim-burst dist]" << std::endl;
+    std::cerr << "       " << std::string(std::strlen(program), ' ') << " [--sim-quantum dist] [--sim-disk dist] [--sim-io-rate requests] [--sim-seed seed]" << std::endl;
+    std::cerr << "Options also include [--cores count] [--affinity policy] [--tlb-entries count] [--tlb-ways count] [--tlb-asid]" << std::endl;
+    std::cerr << "[--readahead pages] [--working-set pages] [--buffer-cache files] [--buffer-cache-policy policy] [--buffer-cache-write-back]" << std::endl;
+    std::cerr << "[--copy-on-write] [--state-log file] [--pipeline]." << std::endl;
+    std::cerr << "With no trace the simulator asks for its configuration and reads commands from the user," << std::endl;
+    std::cerr << "optionally recording the session as a binary trace. Otherwise it replays the text or binary" << std::endl;
+    std::cerr << "trace and reports how fast it ran, or converts a text trace to the binary format." << std::endl;
+    std::cerr << "The CPU is scheduled with policy rr (the default), mlfq, priority or cfs." << std::endl;
+    std::cerr << "The disks serve their queues with policy fcfs (the default), sstf, scan, look or c-look." << std::endl;
+    std::cerr << "Pages are replaced with policy lru (the default), clock, 2q or arc." << std::endl;
+    std::cerr << "--cores simulates that many cores (1 by default), each with its own run queue; idle cores steal from busy ones." << std::endl;
+    std::cerr << "New processes go to a core chosen by --affinity least-loaded (the default), parent or spread." << std::endl;
+    std::cerr << "Each core translates pages through a TLB of --tlb-entries (64 by default, 0 for none) in sets of --tlb-ways (4)," << std::endl;
+    std::cerr << "flushed on every context switch unless --tlb-asid tags its entries with their process." << std::endl;
+    std::cerr << "--readahead loads up to that many pages ahead of sequential or strided scans, and --working-set reloads" << std::endl;
+    std::cerr << "that many of a process's last pages when it gets a core back. Both are off (0) by default." << std::endl;
+    std::cerr << "--buffer-cache keeps that many recently read files in memory (0, off, by default), so a request for one completes" << std::endl;
+    std::cerr << "without the disk. --buffer-cache-policy replaces them by lru (the default), clock, 2q or arc, and" << std::endl;
+    std::cerr << "--buffer-cache-write-back writes them to disk when they leave the cache instead of on every request." << std::endl;
+    std::cerr << "--copy-on-write makes fork share the parent's pages with the child until one of them writes a page with m address w." << std::endl;
+    std::cerr << "--state-log writes every change to the ready queues, cores, frames and disks to file as it happens, in binary" << std::endl;
+    std::cerr << "if the name ends in .bin and as NDJSON (one JSON object per line) otherwise." << std::endl;
+    std::cerr << "--pipeline decodes a replayed trace on a second thread while the simulator runs the commands already decoded." << std::endl;
+    std::cerr << "--metrics-out writes every statistic to file when the run ends, as CSV if the name ends in .csv" << std::endl;
+    std::cerr << "and as JSON otherwise. --metrics-timers times every replayed command; it needs a make METRICS=1 build." << std::endl;
+    std::cerr << "--restore starts from a checkpoint written by the checkpoint command, with its configuration, policies and state," << std::endl;
+    std::cerr << "and then replays the trace or reads commands from the user." << std::endl;
+    std::cerr << "--mrc writes the LRU hit ratio of the trace for every number of frames, computed in the same single replay." << std::endl;
+    std::cerr << "--mrc-sample-rate estimates it from that fraction of the pages (0 to 1) instead, in less time and memory." << std::endl;
+    std::cerr << "The curve treats every process's pages as its own and loads them only on demand, so --mrc cannot be" << std::endl;
+    std::cerr << "combined with --copy-on-write, --readahead or --working-set." << std::endl;
+    std::cerr << "--simulate generates the commands instead for that many simulated seconds: processes arrive, run CPU bursts" << std::endl;
+    std::cerr << "separated by --sim-io-rate disk requests on average (1), and exit, and quanta expire and disks finish requests" << std::endl;
+    std::cerr << "on their own. It reports how busy every core and disk was. A dist is const:us, exp:us or uniform:us, with the mean" << std::endl;
+    std::cerr << "in simulated microseconds, or model for the disks' own seek model. The defaults are --sim-arrival exp:20000" << std::endl;
+    std::cerr << "--sim-burst exp:5000 --sim-quantum const:10000 --sim-disk model." << std::endl;
+}
 
-    unsigned int RAM = 0;
-    unsigned int page_size = 0;
-    int number_of_hard_disks = 0;
+// The command line options. A binary trace carries its own configuration, so the sizes are only needed for text traces.
+struct Options {
+    unsigned long RAM;
+    unsigned long page_size;
+    unsigned long number_of_hard_disks;
+    bool has_configuration;
+    std::string trace_path;         // Trace to replay or convert; empty for an interactive session
+    std::string record_path;        // Where to record an interactive session, if anywhere
+    std::string convert_path;       // Where to write the binary version of a text trace, if anywhere
+    CpuSchedulingPolicy cpu_policy;
+    DiskSchedulingPolicy disk_policy;
+    ReplacementPolicy replacement;
+    bool replacement_given;         // --replacement was on the command line
+    std::string metrics_path;       // Where to dump the metrics when the run ends, if anywhere
+    bool metrics_timers;            // Time every replayed command
+    std::string restore_path;       // Checkpoint to start from, if any
+    std::string mrc_path;           // Where to write the LRU miss-ratio curve of a replayed trace, if anywhere
+    double mrc_sample_rate;         // Fraction of pages the curve is computed from
+    unsigned long cores;            // Number of simulated cores
+    bool cores_given;               // --cores was on the command line
+    CoreAffinityPolicy affinity;
+    unsigned long tlb_entries;      // Entries in the TLB of each core, 0 for none
+    unsigned long tlb_ways;         // Entries in each set of the TLB
+    bool tlb_asid;                  // Tag TLB entries with their process instead of flushing on context switches
+    unsigned long readahead_pages;  // Most pages loaded ahead of a scan, 0 for none
+    unsigned long working_set_pages;    // Pages of a process reloaded when it gets a core back, 0 for none
+    unsigned long buffer_cache_files;   // Files the buffer cache holds, 0 for none
+    ReplacementPolicy buffer_cache_policy;
+    bool buffer_cache_write_back;   // Write cached files back when they leave the cache rather than through on every request
+    bool copy_on_write;             // Fork shares the parent's pages with the child until either writes them
+    std::string state_log_path;     // Where to write the changes of state as they happen, if anywhere
+    bool pipeline;                  // Decode the trace on a parser thread while the simulator runs it
+    bool simulate;                  // Generate events instead of reading commands
+    SimulationSettings simulation;
 
-    std::cout << "How much RAM is there?" << std::endl;
-    std::cin >> RAM;
+    Options() : RAM(0), page_size(0), number_of_hard_disks(0), has_configuration(false), cpu_policy(CPU_ROUND_ROBIN), disk_policy(DISK_FCFS),
+        replacement(REPLACEMENT_LRU), replacement_given(false), metrics_timers(false), mrc_sample_rate(1), cores(1), cores_given(false),
+        affinity(CORE_AFFINITY_LEAST_LOADED), tlb_entries(Tlb::DEFAULT_ENTRIES), tlb_ways(Tlb::DEFAULT_WAYS), tlb_asid(false),
+        readahead_pages(0), working_set_pages(0), buffer_cache_files(0), buffer_cache_policy(REPLACEMENT_LRU),
+        buffer_cache_write_back(false), copy_on_write(false), pipeline(false), simulate(false) {}
+};
 
-    std::cout << "What is the size of a page/frame?" << std::endl;
-    std::cin >> page_size;
+// The most cores --cores accepts
+const unsigned long MAX_CORES = 1024;
 
-    std::cout << "How many hard disks does the simulated computer have?" << std::endl;
-    std::cin >> number_of_hard_disks;
+// The most entries --tlb-entries accepts
+const unsigned long MAX_TLB_ENTRIES = 1 << 20;
 
+// The most pages --readahead and --working-set accept
+const unsigned long MAX_PREFETCH_PAGES = 1 << 20;
 
-    OperatingSystem OS(number_of_hard_disks, RAM, page_size);
+// The most files --buffer-cache accepts
+const unsigned long MAX_BUFFER_CACHE_FILES = 1 << 24;
+
+// The most simulated seconds --simulate accepts, so the simulated nanoseconds cannot overflow
+const double MAX_SIMULATED_SECONDS = 1e9;
+
+// Reads the value that follows a command line flag. Returns false if it is missing or not a number.
+bool ParseFlagValue(int argc, char* argv[], int & i, unsigned long & value) {
+    if (i + 1 >= argc) {
+        return false;
+    }
+    char* end = nullptr;
+    value = std::strtoul(argv[++i], &end, 10);
+    return *argv[i] != '\0' && *end == '\0';
+}
+
+// Reads the path that follows a command line flag. Returns false if it is missing.
+bool ParseFlagPath(int argc, char* argv[], int & i, std::string & path) {
+    if (i + 1 >= argc) {
+        return false;
+    }
+    path = argv[++i];
+    return !path.empty();
+}
+
+// Reads the fraction between 0 (excluded) and 1 that follows a command line flag. Returns false if it is missing or out of range.
+bool ParseFlagRate(int argc, char* argv[], int & i, double & rate) {
+    if (i + 1 >= argc) {
+        return false;
+    }
+    char* end = nullptr;
+    rate = std::strtod(argv[++i], &end);
+    return *argv[i] != '\0' && *end == '\0' && rate > 0 && rate <= 1;
+}
+
+// Reads the distribution that follows a command line flag. Returns false if it is missing or not valid; model is only
+// valid for the disks.
+bool ParseFlagDistribution(int argc, char* argv[], int & i, Distribution & distribution, const bool disk) {
+    return i + 1 < argc && ParseDistribution(argv[++i], distribution) && (disk || distribution.kind != DISTRIBUTION_DISK_MODEL);
+}
+
+// Reads the positive number that follows a command line flag. Returns false if it is missing or not positive.
+bool ParseFlagPositive(int argc, char* argv[], int & i, double & value) {
+    if (i + 1 >= argc) {
+        return false;
+    }
+    char* end = nullptr;
+    value = std::strtod(argv[++i], &end);
+    return *argv[i] != '\0' && *end == '\0' && value > 0;
+}
+
+// Fills options from the command line. Returns false if the command line is not valid.
+bool ParseOptions(int argc, char* argv[], Options & options) {
+    int configuration_flags = 0;
+    for (int i = 1; i < argc; i++) {
+        bool ok = true;
+        // The sizes must fit the operating system's constructor, which takes unsigned int RAM and page size and an int
+        // number of disks
+        if (std::strcmp(argv[i], "--ram") == 0) {
+            ok = ParseFlagValue(argc, argv, i, options.RAM) && options.RAM <= UINT_MAX;
+            configuration_flags++;
+        }
+        else if (std::strcmp(argv[i], "--page-size") == 0) {
+            ok = ParseFlagValue(argc, argv, i, options.page_size) && options.page_size <= UINT_MAX;
+            configuration_flags++;
+        }
+        else if (std::strcmp(argv[i], "--disks") == 0) {
+            ok = ParseFlagValue(argc, argv, i, options.number_of_hard_disks) && options.number_of_hard_disks <= INT_MAX;
+            configuration_flags++;
+        }
+        else if (std::strcmp(argv[i], "--record") == 0) {
+            ok = ParseFlagPath(argc, argv, i, options.record_path);
+        }
+        else if (std::strcmp(argv[i], "--convert") == 0) {
+            ok = ParseFlagPath(argc, argv, i, options.convert_path);
+        }
+        else if (std::strcmp(argv[i], "--cpu-scheduler") == 0) {
+            ok = i + 1 < argc && ParseCpuSchedulingPolicy(argv[++i], options.cpu_policy);
+        }
+        else if (std::strcmp(argv[i], "--disk-scheduler") == 0) {
+            ok = i + 1 < argc && ParseDiskSchedulingPolicy(argv[++i], options.disk_policy);
+        }
+        else if (std::strcmp(argv[i], "--replacement") == 0) {
+            ok = i + 1 < argc && ParseReplacementPolicy(argv[++i], options.replacement);
+            options.replacement_given = true;
+        }
+        else if (std::strcmp(argv[i], "--metrics-out") == 0) {
+            ok = ParseFlagPath(argc, argv, i, options.metrics_path);
+        }
+        else if (std::strcmp(argv[i], "--metrics-timers") == 0) {
+            options.metrics_timers = true;
+        }
+        else if (std::strcmp(argv[i], "--restore") == 0) {
+            ok = ParseFlagPath(argc, argv, i, options.restore_path);
+        }
+        else if (std::strcmp(argv[i], "--mrc") == 0) {
+            ok = ParseFlagPath(argc, argv, i, options.mrc_path);
+        }
+        else if (std::strcmp(argv[i], "--mrc-sample-rate") == 0) {
+            ok = ParseFlagRate(argc, argv, i, options.mrc_sample_rate);
+        }
+        else if (std::strcmp(argv[i], "--cores") == 0) {
+            ok = ParseFlagValue(argc, argv, i, options.cores) && options.cores > 0 && options.cores <= MAX_CORES;
+            options.cores_given = true;
+        }
+        else if (std::strcmp(argv[i], "--affinity") == 0) {
+            ok = i + 1 < argc && ParseCoreAffinityPolicy(argv[++i], options.affinity);
+        }
+        else if (std::strcmp(argv[i], "--tlb-entries") == 0) {
+            ok = ParseFlagValue(argc, argv, i, options.tlb_entries) && options.tlb_entries <= MAX_TLB_ENTRIES;
+        }
+        else if (std::strcmp(argv[i], "--tlb-ways") == 0) {
+            ok = ParseFlagValue(argc, argv, i, options.tlb_ways) && options.tlb_ways <= MAX_TLB_ENTRIES;
+        }
+        else if (std::strcmp(argv[i], "--tlb-asid") == 0) {
+            options.tlb_asid = true;
+        }
+        else if (std::strcmp(argv[i], "--readahead") == 0) {
+            ok = ParseFlagValue(argc, argv, i, options.readahead_pages) && options.readahead_pages <= MAX_PREFETCH_PAGES;
+        }
+        else if (std::strcmp(argv[i], "--working-set") == 0) {
+            ok = ParseFlagValue(argc, argv, i, options.working_set_pages) && options.working_set_pages <= MAX_PREFETCH_PAGES;
+        }
+        else if (std::strcmp(argv[i], "--buffer-cache") == 0) {
+            ok = ParseFlagValue(argc, argv, i, options.buffer_cache_files) && options.buffer_cache_files <= MAX_BUFFER_CACHE_FILES;
+        }
+        else if (std::strcmp(argv[i], "--buffer-cache-policy") == 0) {
+            ok = i + 1 < argc && ParseReplacementPolicy(argv[++i], options.buffer_cache_policy);
+        }
+        else if (std::strcmp(argv[i], "--buffer-cache-write-back") == 0) {
+            options.buffer_cache_write_back = true;
+        }
+        else if (std::strcmp(argv[i], "--copy-on-write") == 0) {
+            options.copy_on_write = true;
+        }
+        else if (std::strcmp(argv[i], "--state-log") == 0) {
+            ok = ParseFlagPath(argc, argv, i, options.state_log_path);
+        }
+        else if (std::strcmp(argv[i], "--pipeline") == 0) {
+            options.pipeline = true;
+        }
+        else if (std::strcmp(argv[i], "--simulate") == 0) {
+            ok = ParseFlagPositive(argc, argv, i, options.simulation.duration_s) && options.simulation.duration_s <= MAX_SIMULATED_SECONDS;
+            options.simulate = true;
+        }
+        else if (std::strcmp(argv[i], "--sim-arrival") == 0) {
+            ok = ParseFlagDistribution(argc, argv, i, options.simulation.arrival, false);
+        }
+        else if (std::strcmp(argv[i], "--sim-burst") == 0) {
+            ok = ParseFlagDistribution(argc, argv, i, options.simulation.burst, false);
+        }
+        else if (std::strcmp(argv[i], "--sim-quantum") == 0) {
+            ok = ParseFlagDistribution(argc, argv, i, options.simulation.quantum, false);
+        }
+        else if (std::strcmp(argv[i], "--sim-disk") == 0) {
+            ok = ParseFlagDistribution(argc, argv, i, options.simulation.disk, true);
+        }
+        else if (std::strcmp(argv[i], "--sim-io-rate") == 0) {
+            ok = ParseFlagPositive(argc, argv, i, options.simulation.disk_requests);
+        }
+        else if (std::strcmp(argv[i], "--sim-seed") == 0) {
+            unsigned long seed = 0;
+            ok = ParseFlagValue(argc, argv, i, seed);
+            options.simulation.seed = seed;
+        }
+        else if (argv[i][0] != '-' && options.trace_path.empty()) {
+            options.trace_path = argv[i];
+        }
+        else {
+            ok = false;
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    options.has_configuration = configuration_flags == 3 && options.page_size != 0;
+    if (configuration_flags != 0 && !options.has_configuration) {
+        return false;
+    }
+    if (!Tlb::ValidGeometry(options.tlb_entries, options.tlb_ways)) {
+        return false;
+    }
+    // The miss-ratio curve is computed while a trace is replayed, and models every process's pages as its own and
+    // loaded only on demand
+    if (!options.mrc_path.empty() && (options.trace_path.empty() || !options.convert_path.empty() || options.copy_on_write
+        || options.readahead_pages != 0 || options.working_set_pages != 0)) {
+        return false;
+    }
+    // Only a replayed trace has a parser to run ahead of the simulator
+    if (options.pipeline && (options.trace_path.empty() || options.simulate || !options.convert_path.empty())) {
+        return false;
+    }
+    // A simulation generates its own commands for a system it builds
+    if (options.simulate) {
+        return options.has_configuration && options.trace_path.empty() && options.restore_path.empty() && options.record_path.empty()
+            && options.convert_path.empty();
+    }
+    // A checkpoint carries its own configuration
+    if (!options.restore_path.empty() && (configuration_flags != 0 || !options.convert_path.empty())) {
+        return false;
+    }
+    if (!options.record_path.empty()) {
+        return options.trace_path.empty() && options.convert_path.empty();
+    }
+    if (!options.convert_path.empty()) {
+        return !options.trace_path.empty() && options.has_configuration;
+    }
+    return true;
+}
+
+// Reports the replay rate on stderr, so that it never mixes with the simulator's own output.
+void ReportThroughput(const unsigned long long number_of_commands, const std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cerr << "Replayed " << number_of_commands << " commands in " << elapsed.count() << " s ("
+              << (elapsed.count() > 0 ? number_of_commands / elapsed.count() : 0) << " commands/s)" << std::endl;
+}
+
+// Reports on stderr how the parser and the simulator of a pipelined replay kept up with each other. Many simulator
+// waits mean decoding is the bottleneck; many parser waits mean the simulator is.
+void ReportPipeline(const CommandPipeline & pipeline) {
+    std::cerr << "Pipelined " << pipeline.GetBatches() << " batches; the parser waited " << pipeline.GetParserWaits()
+              << " times for space and the simulator " << pipeline.GetSimulatorWaits() << " times for commands" << std::endl;
+}
+
+// Writes the metrics of OS to path when the run ends, if a path was given. Returns false if the file cannot be written.
+template <typename Replacement>
+bool WriteMetricsFile(const BasicOperatingSystem<Replacement> & OS, const std::string & path) {
+    if (path.empty()) {
+        return true;
+    }
+    std::ofstream out(path.c_str());
+    bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+    OS.DumpMetrics(out, csv ? METRICS_CSV : METRICS_JSON);
+    if (!out) {
+        std::cerr << "Could not write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Opens the state log at path, if a path was given, and attaches it to OS, which then writes its current state and every
+// change to it. Returns false if the file cannot be created.
+template <typename Replacement>
+bool AttachStateLog(BasicOperatingSystem<Replacement> & OS, StateLog & log, const std::string & path) {
+    if (path.empty()) {
+        return true;
+    }
+    bool binary = path.size() >= 4 && path.compare(path.size() - 4, 4, ".bin") == 0;
+    if (!log.Open(path, binary ? STATE_LOG_BINARY : STATE_LOG_NDJSON)) {
+        std::cerr << "Could not create " << path << std::endl;
+        return false;
+    }
+    OS.SetStateLog(&log);
+    return true;
+}
+
+// Detaches the state log from OS and closes it, if it was opened. Returns false if the file could not be written.
+template <typename Replacement>
+bool CloseStateLog(BasicOperatingSystem<Replacement> & OS, StateLog & log, const std::string & path) {
+    if (!log.IsOpen()) {
+        return true;
+    }
+    OS.SetStateLog(nullptr);
+    if (!log.Close()) {
+        std::cerr << "Could not write " << path << std::endl;
+        return false;
+    }
+    std::cerr << "Wrote " << log.GetNumberOfRecords() << " state changes to " << path << std::endl;
+    return true;
+}
+
+// Takes the configuration, page replacement policy and number of cores from the header of the checkpoint to restore.
+// Returns false if it cannot be read or conflicts with --replacement or --cores.
+bool ApplyCheckpointConfiguration(Options & options) {
+    CheckpointHeader header;
+    ReplacementPolicy replacement;
+    if (!ReadCheckpointHeader(options.restore_path, header) || !ParseReplacementPolicy(header.replacement.c_str(), replacement)) {
+        std::cerr << "Could not read checkpoint " << options.restore_path << std::endl;
+        return false;
+    }
+    if (options.replacement_given && replacement != options.replacement) {
+        std::cerr << "Checkpoint " << options.restore_path << " was taken with --replacement " << header.replacement << std::endl;
+        return false;
+    }
+    if (options.cores_given && header.number_of_cores != options.cores) {
+        std::cerr << "Checkpoint " << options.restore_path << " was taken with --cores " << header.number_of_cores << std::endl;
+        return false;
+    }
+    options.cores = header.number_of_cores;
+    options.RAM = header.RAM;
+    options.page_size = header.page_size;
+    options.number_of_hard_disks = header.number_of_hard_disks;
+    options.has_configuration = true;
+    options.replacement = replacement;
+    return true;
+}
+
+// Restores OS from the checkpoint in options, if there is one, and reports how long it took on stderr.
+// The restored system keeps the scheduling and affinity policies, the TLBs, the prefetch settings, the buffer cache and the copy-on-write setting it was checkpointed with. Returns false if the restore failed.
+template <typename Replacement>
+bool RestoreCheckpoint(BasicOperatingSystem<Replacement> & OS, const Options & options) {
+    if (options.restore_path.empty()) {
+        return true;
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (!OS.Restore(options.restore_path)) {
+        std::cerr << "Could not restore checkpoint " << options.restore_path << std::endl;
+        return false;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cerr << "Restored " << options.restore_path << " in " << elapsed.count() << " s" << std::endl;
+    return true;
+}
+
+// Writes the miss-ratio curve gathered by analyzer to path, if a path was given. Returns false if the file cannot be written.
+bool WriteMissRatioCurve(StackDistanceAnalyzer & analyzer, const std::string & path) {
+    if (path.empty()) {
+        return true;
+    }
+    std::ofstream out(path.c_str());
+    analyzer.WriteCurve(out);
+    if (!out) {
+        std::cerr << "Could not write " << path << std::endl;
+        return false;
+    }
+    std::cerr << "Wrote the LRU miss-ratio curve of " << analyzer.References() << " memory references";
+    if (analyzer.SampleRate() < 1) {
+        std::cerr << ", estimated from " << analyzer.SampleRate() * 100 << "% of the pages,";
+    }
+    std::cerr << " to " << path << std::endl;
+    return true;
+}
+
+// Calls visit on every line of a text trace, decoded in place. Returns the number of lines.
+template <typename Visitor>
+unsigned long long ForEachTextCommand(const MappedFile & trace, Visitor visit) {
+    unsigned long long number_of_commands = 0;
+    Command command;
+    const char* pos = trace.Begin();
+    const char* end = trace.End();
+    while (pos != end) {
+        const char* line_end = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+        if (line_end == nullptr) {
+            line_end = end;
+        }
+        ParseCommand(pos, line_end, command);
+        visit(command);
+        number_of_commands++;
+        pos = (line_end == end) ? end : line_end + 1;
+    }
+    return number_of_commands;
+}
+
+// Replays a text or binary trace without any prompts, with the page replacement policy Replacement.
+template <typename Replacement>
+int RunBatch(const Options & options) {
+    MappedFile trace;
+    if (!trace.Open(options.trace_path)) {
+        std::cerr << "Could not open trace file " << options.trace_path << std::endl;
+        return 1;
+    }
+
+    BinaryTraceReader binary;
+    bool is_binary = BinaryTraceReader::IsBinaryTrace(trace.Begin(), trace.End());
+    if (is_binary && !binary.Open(trace.Begin(), trace.End())) {
+        std::cerr << "Unsupported binary trace " << options.trace_path;
+        if (binary.GetVersion() > BINARY_TRACE_VERSION) {
+            std::cerr << ": it is version " << static_cast<int>(binary.GetVersion()) << " and this build reads up to version "
+                      << static_cast<int>(BINARY_TRACE_VERSION);
+        }
+        std::cerr << std::endl;
+        return 1;
+    }
+    if (!is_binary && !options.has_configuration) {
+        std::cerr << "A text trace needs --ram, --page-size and --disks" << std::endl;
+        return 1;
+    }
+
+    unsigned int RAM = is_binary ? binary.GetRAM() : options.RAM;
+    unsigned int page_size = is_binary ? binary.GetPageSize() : options.page_size;
+    int number_of_hard_disks = is_binary ? binary.GetNumberOfHardDisks() : options.number_of_hard_disks;
+
+    std::ios::sync_with_stdio(false);
+    BasicOperatingSystem<Replacement> OS(number_of_hard_disks, RAM, page_size);
+    OS.SetNumberOfCores(options.cores);
+    OS.SetCoreAffinityPolicy(options.affinity);
+    OS.SetTlb(options.tlb_entries, options.tlb_ways, options.tlb_asid);
+    OS.SetPrefetch(options.readahead_pages, options.working_set_pages);
+    OS.SetBufferCache(options.buffer_cache_files, options.buffer_cache_policy, options.buffer_cache_write_back);
+    OS.SetCopyOnWrite(options.copy_on_write);
+    OS.SetCpuSchedulingPolicy(options.cpu_policy);
+    OS.SetDiskSchedulingPolicy(options.disk_policy);
+    OS_METRIC(OS.GetMetrics().SetTimersEnabled(options.metrics_timers));
+    if (!RestoreCheckpoint(OS, options)) {
+        return 1;
+    }
+    // A checkpoint brings its own copy-on-write and prefetch settings
+    if (!options.mrc_path.empty() && OS.GetCopyOnWrite()) {
+        std::cerr << "--mrc cannot be used with copy-on-write, which " << options.restore_path << " has on" << std::endl;
+        return 1;
+    }
+    if (!options.mrc_path.empty() && OS.GetPrefetch()) {
+        std::cerr << "--mrc cannot be used with prefetching, which " << options.restore_path << " has on" << std::endl;
+        return 1;
+    }
+    StackDistanceAnalyzer analyzer(options.mrc_sample_rate);
+    if (!options.mrc_path.empty()) {
+        OS.SetStackDistanceAnalyzer(&analyzer);
+    }
+    StateLog state_log;
+    if (!AttachStateLog(OS, state_log, options.state_log_path)) {
+        return 1;
+    }
+
+    unsigned long long number_of_commands = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    if (options.pipeline) {
+        CommandPipeline pipeline;
+        std::thread parser([&pipeline, &binary, &trace, is_binary]() {
+            if (is_binary) {
+                Command command;
+                while (binary.Next(command)) {
+                    pipeline.Emit(command);
+                }
+            }
+            else {
+                ForEachTextCommand(trace, [&pipeline](const Command & command) { pipeline.Emit(command); });
+            }
+            pipeline.Finish();
+        });
+        number_of_commands = pipeline.Drain([&OS](const Command & command) { RunCommand(OS, command); });
+        parser.join();
+        std::cout.flush();
+        ReportThroughput(number_of_commands, start);
+        ReportPipeline(pipeline);
+    }
+    else {
+        if (is_binary) {
+            Command command;
+            while (binary.Next(command)) {
+                RunCommand(OS, command);
+                number_of_commands++;
+            }
+        }
+        else {
+            number_of_commands = ForEachTextCommand(trace, [&OS](const Command & command) { RunCommand(OS, command); });
+        }
+        std::cout.flush();
+        ReportThroughput(number_of_commands, start);
+    }
+    if (!WriteMetricsFile(OS, options.metrics_path) || !WriteMissRatioCurve(analyzer, options.mrc_path)
+        || !CloseStateLog(OS, state_log, options.state_log_path)) {
+        return 1;
+    }
+    if (binary.Failed()) {
+        std::cerr << "Binary trace " << options.trace_path << " is corrupt; replay stopped early" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Runs a discrete-event simulation of the configured system, with the page replacement policy Replacement, and reports
+// how busy its cores and disks were on stdout and how fast it ran on stderr.
+template <typename Replacement>
+int RunSimulation(const Options & options) {
+    std::ios::sync_with_stdio(false);
+    int number_of_hard_disks = options.number_of_hard_disks;
+    unsigned int RAM = options.RAM;
+    unsigned int page_size = options.page_size;
+    BasicOperatingSystem<Replacement> OS(number_of_hard_disks, RAM, page_size);
+    OS.SetNumberOfCores(options.cores);
+    OS.SetCoreAffinityPolicy(options.affinity);
+    OS.SetTlb(options.tlb_entries, options.tlb_ways, options.tlb_asid);
+    OS.SetPrefetch(options.readahead_pages, options.working_set_pages);
+    OS.SetBufferCache(options.buffer_cache_files, options.buffer_cache_policy, options.buffer_cache_write_back);
+    OS.SetCopyOnWrite(options.copy_on_write);
+    OS.SetCpuSchedulingPolicy(options.cpu_policy);
+    OS.SetDiskSchedulingPolicy(options.disk_policy);
+
+    StateLog state_log;
+    if (!AttachStateLog(OS, state_log, options.state_log_path)) {
+        return 1;
+    }
+
+    EventSimulation<Replacement> simulation(OS, options.simulation);
+    auto start = std::chrono::steady_clock::now();
+    unsigned long long number_of_events = simulation.Run();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    simulation.Report(std::cout);
+    std::cerr << "Simulated " << number_of_events << " events in " << elapsed.count() << " s ("
+              << (elapsed.count() > 0 ? number_of_events / elapsed.count() : 0) << " events/s)" << std::endl;
+    return WriteMetricsFile(OS, options.metrics_path) && CloseStateLog(OS, state_log, options.state_log_path) ? 0 : 1;
+}
+
+// Converts a text trace to the binary trace format.
+int RunConvert(const Options & options) {
+    MappedFile trace;
+    if (!trace.Open(options.trace_path)) {
+        std::cerr << "Could not open trace file " << options.trace_path << std::endl;
+        return 1;
+    }
+    BinaryTraceWriter writer;
+    if (!writer.Open(options.convert_path, options.RAM, options.page_size, options.number_of_hard_disks)) {
+        std::cerr << "Could not create " << options.convert_path << std::endl;
+        return 1;
+    }
+    ForEachTextCommand(trace, [&writer](const Command & command) { writer.Write(command); });
+    if (!writer.Close()) {
+        std::cerr << "Could not write " << options.convert_path << std::endl;
+        return 1;
+    }
+    std::cerr << "Wrote " << writer.GetNumberOfEvents() << " commands to " << options.convert_path << std::endl;
+    return 0;
+}
+
+// Asks the user for the configuration, unless it comes from a checkpoint, and then runs commands as they are typed.
+// If recorder is open, every command is also appended to it as the session goes.
+// The CPU and disk scheduling policies are taken from options; Replacement is the page replacement policy.
+template <typename Replacement>
+int RunInteractive(const Options & options, BinaryTraceWriter * recorder, const std::string & record_path) {
+    unsigned int RAM = options.RAM;
+    unsigned int page_size = options.page_size;
+    int number_of_hard_disks = options.number_of_hard_disks;
+
+    if (options.restore_path.empty()) {
+        std::cout << "How much RAM is there?" << std::endl;
+        std::cin >> RAM;
+
+        std::cout << "What is the size of a page/frame?" << std::endl;
+        std::cin >> page_size;
+
+        std::cout << "How many hard disks does the simulated computer have?" << std::endl;
+        std::cin >> number_of_hard_disks;
+    }
+
+
+    BasicOperatingSystem<Replacement> OS(number_of_hard_disks, RAM, page_size);
+    OS.SetNumberOfCores(options.cores);
+    OS.SetCoreAffinityPolicy(options.affinity);
+    OS.SetTlb(options.tlb_entries, options.tlb_ways, options.tlb_asid);
+    OS.SetPrefetch(options.readahead_pages, options.working_set_pages);
+    OS.SetBufferCache(options.buffer_cache_files, options.buffer_cache_policy, options.buffer_cache_write_back);
+    OS.SetCopyOnWrite(options.copy_on_write);
+    OS.SetCpuSchedulingPolicy(options.cpu_policy);
+    OS.SetDiskSchedulingPolicy(options.disk_policy);
+    if (!RestoreCheckpoint(OS, options)) {
+        return 1;
+    }
+    StateLog state_log;
+    if (!AttachStateLog(OS, state_log, options.state_log_path)) {
+        return 1;
+    }
+
+    if (recorder != nullptr && !recorder->Open(record_path, RAM, page_size, number_of_hard_disks)) {
+        std::cerr << "Could not create " << record_path << std::endl;
+        return 1;
+    }
 
     std::string input;
     std::getline(std::cin, input);
+    Command command;
 
     while (1) {
+        if (recorder != nullptr) {
+            ParseCommand(input.data(), input.data() + input.size(), command);
+            recorder->Write(command);
+            recorder->Flush();
+        }
+
          //Shows which process is currently using the CPU and which processes are waiting in the ready-queue.
         if (input == "S r") {
             OS.Snapshot();
@@ -42,6 +700,31 @@ int main() {
         else if (input == "S m") {
             OS.MemorySnapshot();
         }
+        //Shows part of memory: a range of frames, the frames in use, or how many frames each process holds.
+        else if (input.compare(0, 4, "S m ") == 0) {
+            Command variant;
+            ParseCommand(input.data(), input.data() + input.size(), variant);
+            RunCommand(OS, variant);
+        }
+        //Shows how long disk requests have waited and taken to serve.
+        else if (input == "S d") {
+            OS.DiskStatsSnapshot();
+        }
+        //Shows how long processes have waited for the CPU and taken to finish.
+        else if (input == "S c") {
+            OS.SchedulerStatsSnapshot();
+        }
+        //Shows how well the page replacement policy is doing.
+        else if (input == "S p") {
+            OS.PagingStatsSnapshot();
+        }
+        //Dumps every statistic the simulator keeps.
+        else if (input == "metrics json") {
+            OS.DumpMetrics(std::cout, METRICS_JSON);
+        }
+        else if (input == "metrics csv") {
+            OS.DumpMetrics(std::cout, METRICS_CSV);
+        }
         // Creates a new pcb and places it at end of ready queue, or in the CPU if the ready queue is empty.
         else if (input == "A") {
             OS.CreateProcess();
@@ -68,7 +751,7 @@ int main() {
         string first_word;
         in_stream >> first_word;
 
-        if (first_word == "d" || first_word == "D" || first_word == "m") {
+        if (first_word == "d" || first_word == "D" || first_word == "m" || first_word == "nice" || first_word == "core") {
             int second_word;
             in_stream >> second_word;
             //The process that currently uses the CPU requests the hard disk #number. 
@@ -83,12 +766,74 @@ int main() {
                 OS.RemoveProcessFromDisk(second_word);
             }
             //The process that is currently using the CPU requests a memory operation for the logical address.
-            else if (first_word == "m") { // == "m address") {
-                OS.RequestMemoryOperation(second_word);
+            else if (first_word == "m") { // == "m address [w]") {
+                string access;
+                in_stream >> access;
+                OS.RequestMemoryOperation(second_word, access == "w");
+            }
+            //The process that is currently using the CPU changes its nice value.
+            else if (first_word == "nice") {
+                OS.SetNice(second_word);
             }
+            //Later commands act on the process using this core.
+            else if (first_word == "core") {
+                OS.SelectCore(second_word);
+            }
+        }
+        //Writes the whole state of the simulated system to a file, to be started from later with --restore.
+        else if (first_word == "checkpoint") {
+            Command checkpoint;
+            ParseCommand(input.data(), input.data() + input.size(), checkpoint);
+            RunCommand(OS, checkpoint);
         }       
         // Get next line of input from user
         std::cout << endl;
         std::getline(std::cin, input);
+        // Stop at the end of the input
+        if (!std::cin) {
+            break;
+        }
+    }
+    return WriteMetricsFile(OS, options.metrics_path) && CloseStateLog(OS, state_log, options.state_log_path) ? 0 : 1;
+}
+
+// Replays the trace, runs a simulation or runs an interactive session, with the page replacement policy Replacement.
+template <typename Replacement>
+int Run(const Options & options) {
+    if (options.simulate) {
+        return RunSimulation<Replacement>(options);
+    }
+    if (!options.trace_path.empty()) {
+        return RunBatch<Replacement>(options);
+    }
+    if (!options.record_path.empty()) {
+        BinaryTraceWriter recorder;
+        return RunInteractive<Replacement>(options, &recorder, options.record_path);
+    }
+    return RunInteractive<Replacement>(options, nullptr, "");
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    if (options.metrics_timers && !MetricsCompiledIn()) {
+        std::cerr << "--metrics-timers needs the metrics compiled in; rebuild with make METRICS=1" << std::endl;
+        return 1;
+    }
+    if (!options.convert_path.empty()) {
+        return RunConvert(options);
+    }
+    if (!options.restore_path.empty() && !ApplyCheckpointConfiguration(options)) {
+        return 1;
+    }
+    switch (options.replacement) {
+        case REPLACEMENT_CLOCK: return Run<ClockReplacement>(options);
+        case REPLACEMENT_2Q: return Run<TwoQueueReplacement>(options);
+        case REPLACEMENT_ARC: return Run<ArcReplacement>(options);
+        case REPLACEMENT_LRU: break;
     }
+    return Run<LruReplacement>(options);
 }
\ No newline at end of file
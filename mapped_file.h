@@ -0,0 +1,81 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A read-only memory mapping of a whole file. The mapping is released when the object is destroyed.
+class MappedFile {
+    public:
+        MappedFile() : data(nullptr), size(0) {}
+
+        ~MappedFile() {
+            Close();
+        }
+
+        // Maps the file at path. Returns false if the file cannot be opened or mapped.
+        bool Open(const std::string & path) {
+            Close();
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat info;
+            if (fstat(fd, &info) != 0) {
+                close(fd);
+                return false;
+            }
+            size = static_cast<size_t>(info.st_size);
+            // An empty file has nothing to map, but is still a valid (empty) input
+            if (size > 0) {
+                void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapping == MAP_FAILED) {
+                    close(fd);
+                    size = 0;
+                    return false;
+                }
+                madvise(mapping, size, MADV_SEQUENTIAL);
+                data = static_cast<const char*>(mapping);
+            }
+            close(fd);
+            return true;
+        }
+
+        // Unmaps the file, if one is mapped.
+        void Close() {
+            if (data != nullptr) {
+                munmap(const_cast<char*>(data), size);
+            }
+            data = nullptr;
+            size = 0;
+        }
+
+        // Returns a pointer to the first byte of the file
+        const char* Begin() const {
+            return data;
+        }
+
+        // Returns a pointer one past the last byte of the file
+        const char* End() const {
+            return data + size;
+        }
+
+        // Returns the size of the file in bytes
+        size_t Size() const {
+            return size;
+        }
+
+    private:
+        MappedFile(const MappedFile &);
+        MappedFile & operator=(const MappedFile &);
+
+        const char* data;           // Start of the mapping, or nullptr if nothing is mapped
+        size_t size;                // Length of the mapping in bytes
+};
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,196 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "histogram.h"
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Instrumentation of the simulator itself. It is compiled in only when OS_METRICS is defined (make METRICS=1);
+// otherwise OS_METRIC(...) expands to nothing and the instrumented code is exactly what it would be without it.
+// Write instrumentation as OS_METRIC(metrics.Increment(METRIC_FORKS));
+#ifdef OS_METRICS
+#define OS_METRIC(statement) statement
+#else
+#define OS_METRIC(statement)
+#endif
+
+// True if the instrumentation is compiled in
+inline bool MetricsCompiledIn() {
+#ifdef OS_METRICS
+    return true;
+#else
+    return false;
+#endif
+}
+
+// The counters kept by Metrics.
+enum MetricCounterId {
+    METRIC_PROCESSES_CREATED,           // A
+    METRIC_FORKS,                       // fork that created a child
+    METRIC_EXITS,                       // exit
+    METRIC_ZOMBIES,                     // exit that left a zombie behind
+    METRIC_ZOMBIE_REAPS,                // wait that found a zombie child
+    METRIC_WAITS_BLOCKED,               // wait that had to block
+    METRIC_CASCADE_TERMINATIONS,        // Descendants terminated along with an exiting process
+    METRIC_QUANTA,                      // Q
+    METRIC_DISK_REQUESTS,               // d that reached a disk
+    METRIC_DISK_COMPLETIONS,            // D that returned a process
+    NUMBER_OF_METRIC_COUNTERS
+};
+
+inline const char* MetricCounterName(const MetricCounterId id) {
+    static const char* const names[NUMBER_OF_METRIC_COUNTERS] = {
+        "processes_created", "forks", "exits", "zombies", "zombie_reaps", "waits_blocked",
+        "cascade_terminations", "quanta", "disk_requests", "disk_completions"
+    };
+    return names[id];
+}
+
+// A counter alone on its cache line, so that counters updated from different places never share a line.
+struct alignas(64) MetricCounter {
+    unsigned long long value;
+
+    MetricCounter() : value(0) {}
+};
+
+// The counters and distributions that are only kept when the instrumentation is compiled in.
+class Metrics {
+    public:
+        Metrics() : timers_enabled(false) {}
+
+        void Increment(const MetricCounterId id) {
+            counters[id].value++;
+        }
+
+        unsigned long long Get(const MetricCounterId id) const {
+            return counters[id].value;
+        }
+
+        // Records the length of the ready queue just after a process joined it
+        void SampleReadyQueueLength(const size_t length) {
+            ready_queue_length.Add(length);
+        }
+
+        const Histogram & GetReadyQueueLengths() const {
+            return ready_queue_length;
+        }
+
+        // Per-command latency timers cost two clock reads per command, so they are off unless asked for.
+        void SetTimersEnabled(const bool enabled) {
+            timers_enabled = enabled;
+        }
+
+        bool TimersEnabled() const {
+            return timers_enabled;
+        }
+
+        // Records how long one command of the given kind took. slot is any small number that identifies the kind.
+        void RecordCommandLatency(const size_t slot, const char* name, const unsigned long long ns) {
+            if (slot >= command_latency_ns.size()) {
+                command_latency_ns.resize(slot + 1);
+            }
+            command_latency_ns[slot].name = name;
+            command_latency_ns[slot].ns.Add(ns);
+        }
+
+        // Calls visit(name, histogram) for every kind of command that has been timed
+        template <typename Visitor>
+        void ForEachCommandLatency(Visitor visit) const {
+            for (size_t i = 0; i < command_latency_ns.size(); i++) {
+                if (command_latency_ns[i].ns.Count() > 0) {
+                    visit(command_latency_ns[i].name, command_latency_ns[i].ns);
+                }
+            }
+        }
+
+    private:
+        struct CommandLatency {
+            const char* name;
+            Histogram ns;
+
+            CommandLatency() : name("") {}
+        };
+
+        MetricCounter counters[NUMBER_OF_METRIC_COUNTERS];
+        Histogram ready_queue_length;
+        bool timers_enabled;
+        std::vector<CommandLatency> command_latency_ns;        // Index is the slot passed to RecordCommandLatency
+};
+
+// How a metrics dump is written.
+enum MetricsFormat {
+    METRICS_JSON,
+    METRICS_CSV
+};
+
+// Writes named counters and histograms as one JSON object or as CSV with the header
+//   metric,count,sum,mean,p50,p95,p99,max
+// where a counter's value is in the count column. Call Finish once everything has been written.
+class MetricsWriter {
+    public:
+        MetricsWriter(std::ostream & out_, const MetricsFormat format_) : out(out_), format(format_), first(true) {
+            if (format == METRICS_JSON) {
+                out << "{";
+            }
+            else {
+                out << "metric,count,sum,mean,p50,p95,p99,max\n";
+            }
+        }
+
+        void Counter(const std::string & name, const unsigned long long value) {
+            if (format == METRICS_JSON) {
+                Separator();
+                out << "\"" << name << "\": " << value;
+            }
+            else {
+                out << name << "," << value << ",,,,,,\n";
+            }
+        }
+
+        void Flag(const std::string & name, const bool value) {
+            if (format == METRICS_JSON) {
+                Separator();
+                out << "\"" << name << "\": " << (value ? "true" : "false");
+            }
+            else {
+                out << name << "," << (value ? 1 : 0) << ",,,,,,\n";
+            }
+        }
+
+        void Distribution(const std::string & name, const Histogram & histogram) {
+            if (format == METRICS_JSON) {
+                Separator();
+                out << "\"" << name << "\": {\"count\": " << histogram.Count() << ", \"sum\": " << histogram.Sum()
+                    << ", \"mean\": " << histogram.Mean() << ", \"p50\": " << histogram.Percentile(0.5)
+                    << ", \"p95\": " << histogram.Percentile(0.95) << ", \"p99\": " << histogram.Percentile(0.99)
+                    << ", \"max\": " << histogram.Max() << "}";
+            }
+            else {
+                out << name << "," << histogram.Count() << "," << histogram.Sum() << "," << histogram.Mean() << ","
+                    << histogram.Percentile(0.5) << "," << histogram.Percentile(0.95) << "," << histogram.Percentile(0.99) << ","
+                    << histogram.Max() << "\n";
+            }
+        }
+
+        void Finish() {
+            if (format == METRICS_JSON) {
+                out << "\n}\n";
+            }
+            out.flush();
+        }
+
+    private:
+        std::ostream & out;
+        MetricsFormat format;
+        bool first;                     // No JSON member written yet
+
+        void Separator() {
+            out << (first ? "\n  " : ",\n  ");
+            first = false;
+        }
+};
+
+#endif // METRICS_H
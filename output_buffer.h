@@ -0,0 +1,92 @@
+#ifndef OUTPUT_BUFFER_H
+#define OUTPUT_BUFFER_H
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+// Collects output in memory and hands it to the stream in large blocks, so that printing millions of short lines
+// costs a few writes instead of a flush per line. Numbers are formatted by hand, without going through the stream.
+// Everything is written and the stream flushed when the buffer is destroyed.
+class OutputBuffer {
+    public:
+        explicit OutputBuffer(std::ostream & out_) : out(out_) {
+            buffer.reserve(FLUSH_THRESHOLD + 64);
+        }
+
+        ~OutputBuffer() {
+            Flush();
+            out.flush();
+        }
+
+        OutputBuffer & operator<<(const char* text) {
+            buffer += text;
+            return MaybeFlush();
+        }
+
+        OutputBuffer & operator<<(const std::string & text) {
+            buffer += text;
+            return MaybeFlush();
+        }
+
+        OutputBuffer & operator<<(const char c) {
+            buffer += c;
+            return MaybeFlush();
+        }
+
+        OutputBuffer & operator<<(const unsigned long long value) {
+            char digits[20];
+            size_t length = 0;
+            unsigned long long rest = value;
+            do {
+                digits[length++] = static_cast<char>('0' + rest % 10);
+                rest /= 10;
+            } while (rest != 0);
+            while (length > 0) {
+                buffer += digits[--length];
+            }
+            return MaybeFlush();
+        }
+
+        OutputBuffer & operator<<(const long long value) {
+            if (value < 0) {
+                buffer += '-';
+                return *this << (0ULL - static_cast<unsigned long long>(value));
+            }
+            return *this << static_cast<unsigned long long>(value);
+        }
+
+        OutputBuffer & operator<<(const unsigned int value) {
+            return *this << static_cast<unsigned long long>(value);
+        }
+
+        OutputBuffer & operator<<(const int value) {
+            return *this << static_cast<long long>(value);
+        }
+
+        // Writes everything collected so far to the stream
+        void Flush() {
+            if (!buffer.empty()) {
+                out.write(buffer.data(), buffer.size());
+                buffer.clear();
+            }
+        }
+
+    private:
+        static const size_t FLUSH_THRESHOLD = 1 << 16;
+
+        std::ostream & out;
+        std::string buffer;
+
+        OutputBuffer & MaybeFlush() {
+            if (buffer.size() >= FLUSH_THRESHOLD) {
+                Flush();
+            }
+            return *this;
+        }
+
+        OutputBuffer(const OutputBuffer &);
+        OutputBuffer & operator=(const OutputBuffer &);
+};
+
+#endif // OUTPUT_BUFFER_H
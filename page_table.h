@@ -0,0 +1,164 @@
+#ifndef PAGE_TABLE_H
+#define PAGE_TABLE_H
+
+#include "process_id.h"
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+// The page tables of every process: a radix tree per process, LEVELS tables deep, mapping a page number to the
+// frame holding it. Each table has 2^BITS_PER_LEVEL entries indexed by one slice of the page number, most
+// significant slice first, so looking a page up (a page walk) visits at most LEVELS tables. Tables are allocated
+// when a page under them is first mapped and freed when their last entry is unmapped, and they all live in one
+// pool, so a process that touches a few pages holds a few tables.
+class PageTables {
+    public:
+        static const unsigned int LEVELS = 4;
+        static const unsigned int BITS_PER_LEVEL = 8;
+        static const unsigned int NOT_MAPPED = static_cast<unsigned int>(-1);
+
+        PageTables() : mapped_pages(0), cached_pid(0), cached_root(NOT_MAPPED) {}
+
+        // Returns the frame holding page of pid, or NOT_MAPPED. Adds the number of tables visited to levels.
+        unsigned int Walk(const ProcessId pid, const int page, unsigned long long & levels) {
+            unsigned int table = Root(pid);
+            unsigned int index = static_cast<unsigned int>(page);
+            for (unsigned int level = 0; table != NOT_MAPPED; level++) {
+                levels++;
+                unsigned int entry = tables[table].entries[Slot(index, level)];
+                if (level == LEVELS - 1) {
+                    return entry;
+                }
+                table = entry;
+            }
+            return NOT_MAPPED;
+        }
+
+        // Maps page of pid to frame. The page must not be mapped already.
+        void Map(const ProcessId pid, const int page, const unsigned int frame) {
+            unsigned int table = Root(pid);
+            if (table == NOT_MAPPED) {
+                table = NewTable();
+                roots[pid] = table;
+                cached_pid = pid;
+                cached_root = table;
+            }
+            unsigned int index = static_cast<unsigned int>(page);
+            for (unsigned int level = 0; level < LEVELS - 1; level++) {
+                unsigned int & entry = tables[table].entries[Slot(index, level)];
+                if (entry == NOT_MAPPED) {
+                    // NewTable may move the tables, so the entry is looked up again
+                    unsigned int child = NewTable();
+                    tables[table].entries[Slot(index, level)] = child;
+                    tables[table].used++;
+                    table = child;
+                }
+                else {
+                    table = entry;
+                }
+            }
+            tables[table].entries[Slot(index, LEVELS - 1)] = frame;
+            tables[table].used++;
+            mapped_pages++;
+        }
+
+        // Removes the mapping of page of pid, if there is one, and frees the tables it leaves empty.
+        void Unmap(const ProcessId pid, const int page) {
+            unsigned int path[LEVELS];
+            unsigned int table = Root(pid);
+            unsigned int index = static_cast<unsigned int>(page);
+            for (unsigned int level = 0; level < LEVELS; level++) {
+                if (table == NOT_MAPPED) {
+                    return;
+                }
+                path[level] = table;
+                table = tables[table].entries[Slot(index, level)];
+            }
+            if (table == NOT_MAPPED) {
+                return;
+            }
+            mapped_pages--;
+            for (unsigned int level = LEVELS; level-- > 0;) {
+                Table & current = tables[path[level]];
+                current.entries[Slot(index, level)] = NOT_MAPPED;
+                if (--current.used > 0) {
+                    return;
+                }
+                free_tables.push_back(path[level]);
+            }
+            // The root itself was freed
+            roots.erase(pid);
+            if (cached_pid == pid) {
+                cached_root = NOT_MAPPED;
+            }
+        }
+
+        // Forgets every mapping.
+        void Clear() {
+            tables.clear();
+            free_tables.clear();
+            roots.clear();
+            mapped_pages = 0;
+            cached_pid = 0;
+            cached_root = NOT_MAPPED;
+        }
+
+        // The number of pages mapped, over all processes
+        size_t MappedPages() const {
+            return mapped_pages;
+        }
+
+        // The number of tables in use, over all processes
+        size_t Tables() const {
+            return tables.size() - free_tables.size();
+        }
+
+    private:
+        static const unsigned int ENTRIES = 1u << BITS_PER_LEVEL;
+
+        struct Table {
+            unsigned int entries[ENTRIES];      // A table of the next level, or a frame in the last level, or NOT_MAPPED
+            unsigned int used;                  // Entries that are not NOT_MAPPED
+        };
+
+        std::vector<Table> tables;              // Every table of every process; index is the table number
+        std::vector<unsigned int> free_tables;  // Tables freed for reuse
+        std::unordered_map<ProcessId, unsigned int> roots;    // Top-level table of every process with a page mapped
+        size_t mapped_pages;
+        ProcessId cached_pid;                   // The last process looked up, usually the one running, and its root
+        unsigned int cached_root;
+
+        static unsigned int Slot(const unsigned int index, const unsigned int level) {
+            return (index >> ((LEVELS - 1 - level) * BITS_PER_LEVEL)) & (ENTRIES - 1);
+        }
+
+        // Returns the top-level table of pid, or NOT_MAPPED if it has no page mapped.
+        unsigned int Root(const ProcessId pid) {
+            if (pid != cached_pid) {
+                auto found = roots.find(pid);
+                cached_pid = pid;
+                cached_root = found != roots.end() ? found->second : NOT_MAPPED;
+            }
+            return cached_root;
+        }
+
+        // Returns an empty table, reusing a freed one if there is one. A table is only freed once every entry is
+        // NOT_MAPPED again, so a reused one needs no clearing.
+        unsigned int NewTable() {
+            if (!free_tables.empty()) {
+                unsigned int table = free_tables.back();
+                free_tables.pop_back();
+                return table;
+            }
+            unsigned int table = static_cast<unsigned int>(tables.size());
+            tables.push_back(Table());
+            for (unsigned int i = 0; i < ENTRIES; i++) {
+                tables[table].entries[i] = NOT_MAPPED;
+            }
+            tables[table].used = 0;
+            return table;
+        }
+};
+
+#endif // PAGE_TABLE_H
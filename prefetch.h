@@ -0,0 +1,257 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include "checkpoint.h"
+#include "process_id.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+// Decides which pages to load before they are asked for. The operating system reports every memory access and
+// every time a process gets a core back, and loads the pages this hands to its fetch callback, skipping those
+// already in memory.
+//
+// Readahead follows the stream of pages each process touches. Once two steps in a row have the same stride, the
+// stream is taken to be a sequential or strided scan, and the pages it will reach next are fetched ahead of it: a
+// few at first, then twice as many each time the stream catches up with half of what was fetched, up to the
+// readahead limit. A change of stride starts over.
+//
+// The working set mode remembers the last distinct pages each process touched, and when the process gets a core
+// back fetches them all at once instead of taking a fault for each.
+class Prefetcher {
+    public:
+        Prefetcher() : readahead_pages(0), working_set_pages(0), issued(0), used(0), wasted(0) {}
+
+        // Fetches up to readahead_pages ahead of a detected stream, and working_set_pages of a process's recent
+        // pages when it resumes. 0 turns either off. Forgets every process's history.
+        void Configure(const unsigned int readahead_pages_, const unsigned int working_set_pages_) {
+            readahead_pages = readahead_pages_;
+            working_set_pages = working_set_pages_;
+            histories.clear();
+        }
+
+        bool Enabled() const {
+            return readahead_pages > 0 || working_set_pages > 0;
+        }
+
+        unsigned int ReadaheadPages() const {
+            return readahead_pages;
+        }
+
+        unsigned int WorkingSetPages() const {
+            return working_set_pages;
+        }
+
+        // The process pid accessed page. Calls fetch(page) for every page readahead wants loaded now.
+        template <typename Fetch>
+        void Access(const ProcessId pid, const int page, Fetch fetch) {
+            History & history = histories[pid];
+            if (working_set_pages > 0) {
+                Remember(history, page);
+            }
+            if (!history.seen) {
+                history.seen = true;
+                history.last_page = page;
+                return;
+            }
+            long long stride = static_cast<long long>(page) - history.last_page;
+            if (stride == 0) {
+                return;
+            }
+            history.last_page = page;
+            if (stride != history.stride) {
+                history.stride = stride;
+                history.run = 1;
+                history.next = page + stride;
+                history.window = readahead_pages < INITIAL_WINDOW ? readahead_pages : INITIAL_WINDOW;
+                return;
+            }
+            history.run++;
+            if (readahead_pages == 0 || history.run < MIN_RUN || stride > MAX_STRIDE || stride < -MAX_STRIDE) {
+                return;
+            }
+            // The stream may have overtaken what was fetched for it
+            long long ahead = (history.next - page) / stride - 1;
+            if (ahead < 0) {
+                history.next = page + stride;
+                ahead = 0;
+            }
+            if (2 * ahead > history.window) {
+                return;
+            }
+            for (long long i = ahead; i < history.window && history.next >= 0 && history.next <= INT_MAX; i++) {
+                fetch(static_cast<int>(history.next));
+                history.next += stride;
+            }
+            history.window = 2 * history.window < readahead_pages ? 2 * history.window : readahead_pages;
+        }
+
+        // The process pid got a core back. Calls fetch(page) for each page of its working set, oldest first.
+        template <typename Fetch>
+        void Resume(const ProcessId pid, Fetch fetch) {
+            if (working_set_pages == 0) {
+                return;
+            }
+            auto found = histories.find(pid);
+            if (found == histories.end()) {
+                return;
+            }
+            const History & history = found->second;
+            size_t count = history.recent.size();
+            for (size_t i = 0; i < count; i++) {
+                fetch(history.recent[(history.recent_next + i) % count]);
+            }
+        }
+
+        // The process terminated.
+        void Release(const ProcessId pid) {
+            histories.erase(pid);
+        }
+
+        // A page was loaded ahead of its use
+        void CountIssued() {
+            issued++;
+        }
+
+        // A page loaded ahead of its use was then used
+        void CountUsed() {
+            used++;
+        }
+
+        // A page loaded ahead of its use left memory without being used
+        void CountWasted() {
+            wasted++;
+        }
+
+        unsigned long long Issued() const {
+            return issued;
+        }
+
+        unsigned long long Used() const {
+            return used;
+        }
+
+        unsigned long long Wasted() const {
+            return wasted;
+        }
+
+        void Save(CheckpointWriter & writer) const {
+            writer.Put(readahead_pages);
+            writer.Put(working_set_pages);
+            writer.Put(issued);
+            writer.Put(used);
+            writer.Put(wasted);
+            std::vector<HistoryRecord> records;
+            std::vector<int> recent_pages;
+            records.reserve(histories.size());
+            for (auto & entry : histories) {
+                const History & history = entry.second;
+                HistoryRecord record = HistoryRecord();
+                record.pid = entry.first;
+                record.last_page = history.last_page;
+                record.stride = history.stride;
+                record.next = history.next;
+                record.window = history.window;
+                record.run = history.run;
+                record.seen = history.seen;
+                record.recent_count = history.recent.size();
+                record.recent_next = history.recent_next;
+                records.push_back(record);
+                recent_pages.insert(recent_pages.end(), history.recent.begin(), history.recent.end());
+            }
+            writer.PutVector(records);
+            writer.PutVector(recent_pages);
+        }
+
+        // Replaces the configuration, statistics and histories with those written by Save.
+        bool Load(CheckpointReader & reader) {
+            histories.clear();
+            size_t count = 0;
+            size_t number_of_recent_pages = 0;
+            if (!reader.Get(readahead_pages) || !reader.Get(working_set_pages) || !reader.Get(issued) || !reader.Get(used)
+                || !reader.Get(wasted)) {
+                return false;
+            }
+            const HistoryRecord* records = reader.GetArray<HistoryRecord>(count);
+            const int* recent_pages = reader.GetArray<int>(number_of_recent_pages);
+            if (reader.Failed()) {
+                return false;
+            }
+            size_t consumed = 0;
+            for (size_t i = 0; i < count; i++) {
+                const HistoryRecord & record = records[i];
+                if (record.recent_count > working_set_pages || record.recent_count > number_of_recent_pages - consumed
+                    || (record.recent_count > 0 && record.recent_next >= record.recent_count)) {
+                    return reader.Fail();
+                }
+                History & history = histories[record.pid];
+                history.last_page = record.last_page;
+                history.stride = record.stride;
+                history.next = record.next;
+                history.window = record.window;
+                history.run = record.run;
+                history.seen = record.seen;
+                history.recent.assign(recent_pages + consumed, recent_pages + consumed + record.recent_count);
+                history.recent_next = record.recent_next;
+                consumed += record.recent_count;
+            }
+            return consumed == number_of_recent_pages || reader.Fail();
+        }
+
+    private:
+        static const long long INITIAL_WINDOW = 4;      // Pages fetched when a stream is first detected
+        static const unsigned int MIN_RUN = 2;          // Steps in a row at the same stride that make a stream
+        static const long long MAX_STRIDE = 64;         // Pages between accesses beyond which nothing is fetched
+
+        // What is known about the pages one process touched.
+        struct History {
+            bool seen;                          // last_page is set
+            int last_page;
+            long long stride;                   // Pages from the access before last_page to last_page
+            unsigned int run;                   // Steps in a row at stride
+            long long next;                     // The next page readahead fetches on this stream
+            long long window;                   // Pages readahead keeps ahead of the stream
+            std::vector<int> recent;            // The last distinct pages touched, a ring of up to working_set_pages
+            size_t recent_next;                 // Where the next page goes in recent once it is full; the oldest page
+
+            History() : seen(false), last_page(0), stride(0), run(0), next(0), window(0), recent_next(0) {}
+        };
+
+        // A history as stored in a checkpoint, with its recent pages stored after all the records.
+        struct HistoryRecord {
+            ProcessId pid;
+            long long stride;
+            long long next;
+            long long window;
+            unsigned long long recent_count;
+            unsigned long long recent_next;
+            int last_page;
+            unsigned int run;
+            bool seen;
+        };
+
+        unsigned int readahead_pages;
+        unsigned int working_set_pages;
+        unsigned long long issued;              // Pages loaded ahead of their use
+        unsigned long long used;                // Of those, the pages used before they left memory
+        unsigned long long wasted;              // Of those, the pages that left memory unused
+        std::unordered_map<ProcessId, History> histories;
+
+        void Remember(History & history, const int page) {
+            if (std::find(history.recent.begin(), history.recent.end(), page) != history.recent.end()) {
+                return;
+            }
+            if (history.recent.size() < working_set_pages) {
+                history.recent.push_back(page);
+            }
+            else {
+                history.recent[history.recent_next] = page;
+                history.recent_next = (history.recent_next + 1) % history.recent.size();
+            }
+        }
+};
+
+#endif // PREFETCH_H
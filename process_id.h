@@ -0,0 +1,7 @@
+#ifndef PROCESS_ID_H
+#define PROCESS_ID_H
+
+// Process ids are handed out in increasing order and never reused, so they are 64 bits wide to survive long runs.
+typedef long long ProcessId;
+
+#endif // PROCESS_ID_H
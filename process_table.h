@@ -0,0 +1,273 @@
+#ifndef PROCESS_TABLE_H
+#define PROCESS_TABLE_H
+
+#include "PCB.h"
+#include "checkpoint.h"
+#include "process_id.h"
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Owns every PCB, stored in place in fixed-size chunks indexed directly by pid.
+// Pids are handed out in increasing order, so chunk pid / CHUNK_SIZE holds the PCB for pid at slot pid % CHUNK_SIZE,
+// and a lookup is one load of the chunk pointer plus an offset. Once every process in a chunk has terminated and no
+// new pid can land in it, the chunk is released and kept for reuse, so long runs do not keep growing.
+class ProcessTable {
+    public:
+        ProcessTable() : next_pid(0), live_processes(0) {}
+
+        ~ProcessTable() {
+            Clear();
+            for (auto chunk : spare_chunks) {
+                delete chunk;
+            }
+        }
+
+        // Destroys every PCB.
+        void Clear() {
+            for (size_t i = 0; i < chunks.size(); i++) {
+                if (chunks[i] != nullptr) {
+                    for (size_t slot = 0; slot < CHUNK_SIZE; slot++) {
+                        if (chunks[i]->alive[slot]) {
+                            chunks[i]->At(slot)->~PCB();
+                        }
+                    }
+                    delete chunks[i];
+                }
+            }
+            chunks.clear();
+            next_pid = 0;
+            live_processes = 0;
+        }
+
+        // Creates the PCB for pid, which must be larger than every pid created before it.
+        PCB* Create(const ProcessId pid) {
+            size_t chunk_index = static_cast<size_t>(pid / CHUNK_SIZE);
+            if (chunk_index >= chunks.size()) {
+                chunks.resize(chunk_index + 1, nullptr);
+            }
+            if (chunks[chunk_index] == nullptr) {
+                chunks[chunk_index] = NewChunk();
+            }
+            Chunk* chunk = chunks[chunk_index];
+            size_t slot = static_cast<size_t>(pid % CHUNK_SIZE);
+            PCB* pcb = new (chunk->At(slot)) PCB(pid);
+            chunk->alive[slot] = true;
+            chunk->live_count++;
+            live_processes++;
+            next_pid = pid + 1;
+            return pcb;
+        }
+
+        // Returns the PCB for pid, or nullptr if there is no such process.
+        PCB* Find(const ProcessId pid) const {
+            size_t chunk_index = static_cast<size_t>(pid / CHUNK_SIZE);
+            if (pid < 0 || chunk_index >= chunks.size() || chunks[chunk_index] == nullptr) {
+                return nullptr;
+            }
+            size_t slot = static_cast<size_t>(pid % CHUNK_SIZE);
+            return chunks[chunk_index]->alive[slot] ? chunks[chunk_index]->At(slot) : nullptr;
+        }
+
+        // Returns the PCB for a pid that is known to exist.
+        PCB* operator[](const ProcessId pid) const {
+            return chunks[static_cast<size_t>(pid / CHUNK_SIZE)]->At(static_cast<size_t>(pid % CHUNK_SIZE));
+        }
+
+        // Destroys the PCB for pid, if there is one.
+        void Destroy(const ProcessId pid) {
+            PCB* pcb = Find(pid);
+            if (pcb == nullptr) {
+                return;
+            }
+            size_t chunk_index = static_cast<size_t>(pid / CHUNK_SIZE);
+            Chunk* chunk = chunks[chunk_index];
+            pcb->~PCB();
+            chunk->alive[pid % CHUNK_SIZE] = false;
+            chunk->live_count--;
+            live_processes--;
+
+            // A chunk that is empty and full of used pids will never be touched again
+            if (chunk->live_count == 0 && static_cast<ProcessId>((chunk_index + 1) * CHUNK_SIZE) <= next_pid) {
+                chunks[chunk_index] = nullptr;
+                ReleaseChunk(chunk);
+            }
+        }
+
+        // Calls visit on every live PCB, in increasing pid order.
+        template <typename Visitor>
+        void ForEach(Visitor visit) const {
+            for (size_t i = 0; i < chunks.size(); i++) {
+                if (chunks[i] == nullptr) {
+                    continue;
+                }
+                for (size_t slot = 0; slot < CHUNK_SIZE; slot++) {
+                    if (chunks[i]->alive[slot]) {
+                        visit(chunks[i]->At(slot));
+                    }
+                }
+            }
+        }
+
+        // Returns the number of live processes
+        size_t Size() const {
+            return live_processes;
+        }
+
+        // Writes every live PCB as one array, with the links between processes stored as pids. The ready queue
+        // links are left out: the CPU scheduler that owns them queues the processes again on restore.
+        void Save(CheckpointWriter & writer) const {
+            std::vector<ProcessRecord> records;
+            records.reserve(live_processes);
+            ForEach([&records](const PCB* pcb) {
+                ProcessRecord record = ProcessRecord();
+                record.pid = pcb->pid;
+                record.parent = pcb->parent_process;
+                record.first_child = PidOf(pcb->first_child);
+                record.last_child = PidOf(pcb->last_child);
+                record.prev_sibling = PidOf(pcb->prev_sibling);
+                record.next_sibling = PidOf(pcb->next_sibling);
+                record.first_zombie = PidOf(pcb->first_zombie);
+                record.last_zombie = PidOf(pcb->last_zombie);
+                record.prev_zombie = PidOf(pcb->prev_zombie);
+                record.next_zombie = PidOf(pcb->next_zombie);
+                record.number_of_children = pcb->number_of_children;
+                record.disk_number = pcb->disk_number;
+                record.disk_slot = pcb->disk_slot;
+                record.zombie = pcb->process_is_zombie;
+                record.waiting = pcb->waiting;
+                record.scheduling = pcb->scheduling;
+                records.push_back(record);
+            });
+            writer.PutVector(records);
+            writer.Put(next_pid);
+        }
+
+        // Replaces every PCB with those written by Save. The PCBs are built straight from the mapped array in one pass
+        // and linked up in a second, so no process is replayed. No process is on the ready queue afterwards.
+        bool Load(CheckpointReader & reader) {
+            Clear();
+            size_t count = 0;
+            const ProcessRecord* records = reader.GetArray<ProcessRecord>(count);
+            if (reader.Failed()) {
+                return false;
+            }
+            ProcessId previous = 0;
+            for (size_t i = 0; i < count; i++) {
+                if (records[i].pid <= previous) {
+                    return reader.Fail();
+                }
+                previous = records[i].pid;
+                PCB* pcb = Create(records[i].pid);
+                pcb->parent_process = records[i].parent;
+                pcb->number_of_children = records[i].number_of_children;
+                pcb->disk_number = records[i].disk_number;
+                pcb->disk_slot = records[i].disk_slot;
+                pcb->process_is_zombie = records[i].zombie;
+                pcb->waiting = records[i].waiting;
+                pcb->scheduling = records[i].scheduling;
+                pcb->scheduling.heap_index = SchedulingInfo::NOT_IN_HEAP;
+            }
+            bool linked = true;
+            for (size_t i = 0; i < count; i++) {
+                PCB* pcb = (*this)[records[i].pid];
+                pcb->first_child = Link(records[i].first_child, linked);
+                pcb->last_child = Link(records[i].last_child, linked);
+                pcb->prev_sibling = Link(records[i].prev_sibling, linked);
+                pcb->next_sibling = Link(records[i].next_sibling, linked);
+                pcb->first_zombie = Link(records[i].first_zombie, linked);
+                pcb->last_zombie = Link(records[i].last_zombie, linked);
+                pcb->prev_zombie = Link(records[i].prev_zombie, linked);
+                pcb->next_zombie = Link(records[i].next_zombie, linked);
+            }
+            ProcessId saved_next_pid = 0;
+            if (!linked || !reader.Get(saved_next_pid) || saved_next_pid < next_pid) {
+                return reader.Fail();
+            }
+            next_pid = saved_next_pid;
+            return true;
+        }
+
+    private:
+        static const size_t CHUNK_SIZE = 1024;      // PCBs per chunk
+        static const size_t MAX_SPARE_CHUNKS = 4;   // Released chunks kept around for reuse
+
+        struct Chunk {
+            std::aligned_storage<sizeof(PCB), alignof(PCB)>::type slots[CHUNK_SIZE];
+            bool alive[CHUNK_SIZE];                 // True if the slot holds a constructed PCB
+            size_t live_count;                      // Number of constructed PCBs in the chunk
+
+            Chunk() : live_count(0) {
+                for (size_t i = 0; i < CHUNK_SIZE; i++) {
+                    alive[i] = false;
+                }
+            }
+
+            PCB* At(const size_t slot) {
+                return reinterpret_cast<PCB*>(&slots[slot]);
+            }
+        };
+
+        // A PCB as stored in a checkpoint. Links are pids, 0 for none.
+        struct ProcessRecord {
+            ProcessId pid;
+            ProcessId parent;
+            ProcessId first_child;
+            ProcessId last_child;
+            ProcessId prev_sibling;
+            ProcessId next_sibling;
+            ProcessId first_zombie;
+            ProcessId last_zombie;
+            ProcessId prev_zombie;
+            ProcessId next_zombie;
+            unsigned long long number_of_children;
+            int disk_number;
+            unsigned int disk_slot;
+            bool zombie;
+            bool waiting;
+            SchedulingInfo scheduling;
+        };
+
+        std::vector<Chunk*> chunks;                 // Index is pid / CHUNK_SIZE; nullptr once the chunk has been released
+        std::vector<Chunk*> spare_chunks;           // Released chunks waiting to be reused
+        ProcessId next_pid;                         // One past the largest pid created
+        size_t live_processes;
+
+        Chunk* NewChunk() {
+            if (spare_chunks.empty()) {
+                return new Chunk{};
+            }
+            Chunk* chunk = spare_chunks.back();
+            spare_chunks.pop_back();
+            return chunk;
+        }
+
+        static ProcessId PidOf(const PCB* pcb) {
+            return pcb != nullptr ? pcb->pid : 0;
+        }
+
+        // Returns the PCB a stored link points to. Clears linked if there is no such process.
+        PCB* Link(const ProcessId pid, bool & linked) const {
+            if (pid == 0) {
+                return nullptr;
+            }
+            PCB* pcb = Find(pid);
+            if (pcb == nullptr) {
+                linked = false;
+            }
+            return pcb;
+        }
+
+        void ReleaseChunk(Chunk* chunk) {
+            if (spare_chunks.size() < MAX_SPARE_CHUNKS) {
+                spare_chunks.push_back(chunk);
+            }
+            else {
+                delete chunk;
+            }
+        }
+};
+
+#endif // PROCESS_TABLE_H
@@ -0,0 +1,107 @@
+#ifndef READY_QUEUE_H
+#define READY_QUEUE_H
+
+#include "PCB.h"
+
+#include <cstddef>
+
+// The round-robin ready queue. It is an intrusive doubly linked list: the links live in each PCB, so adding,
+// taking the front and removing an arbitrary process are all O(1) and never allocate.
+class ReadyQueue {
+    public:
+        ReadyQueue() : head(nullptr), tail(nullptr), size(0) {}
+
+        // Adds the process to the back of the queue. A process that is already queued is left where it is.
+        void PushBack(PCB* pcb) {
+            if (pcb->in_ready_queue) {
+                return;
+            }
+            pcb->in_ready_queue = true;
+            pcb->ready_prev = tail;
+            pcb->ready_next = nullptr;
+            if (tail != nullptr) {
+                tail->ready_next = pcb;
+            }
+            else {
+                head = pcb;
+            }
+            tail = pcb;
+            size++;
+        }
+
+        // Removes and returns the process at the front of the queue, or nullptr if the queue is empty.
+        PCB* PopFront() {
+            PCB* front = head;
+            if (front != nullptr) {
+                Remove(front);
+            }
+            return front;
+        }
+
+        // Removes the process from the queue, if it is queued.
+        void Remove(PCB* pcb) {
+            if (!pcb->in_ready_queue) {
+                return;
+            }
+            if (pcb->ready_prev != nullptr) {
+                pcb->ready_prev->ready_next = pcb->ready_next;
+            }
+            else {
+                head = pcb->ready_next;
+            }
+            if (pcb->ready_next != nullptr) {
+                pcb->ready_next->ready_prev = pcb->ready_prev;
+            }
+            else {
+                tail = pcb->ready_prev;
+            }
+            pcb->ready_prev = nullptr;
+            pcb->ready_next = nullptr;
+            pcb->in_ready_queue = false;
+            size--;
+        }
+
+        // Moves every process in other to the back of this queue, keeping their order. O(1).
+        void Splice(ReadyQueue & other) {
+            if (other.head == nullptr) {
+                return;
+            }
+            if (tail != nullptr) {
+                tail->ready_next = other.head;
+                other.head->ready_prev = tail;
+            }
+            else {
+                head = other.head;
+            }
+            tail = other.tail;
+            size += other.size;
+            other.head = nullptr;
+            other.tail = nullptr;
+            other.size = 0;
+        }
+
+        // Returns the process at the front of the queue, or nullptr if it is empty
+        PCB* Front() const {
+            return head;
+        }
+
+        // Returns the process queued behind pcb, or nullptr if pcb is last
+        static PCB* Next(const PCB* pcb) {
+            return pcb->ready_next;
+        }
+
+        bool Empty() const {
+            return head == nullptr;
+        }
+
+        size_t Size() const {
+            return size;
+        }
+
+    private:
+        PCB* head;                  // Next process to get the CPU
+        PCB* tail;                  // Most recently queued process
+        size_t size;                // Number of queued processes
+};
+
+#endif // READY_QUEUE_H
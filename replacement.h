@@ -0,0 +1,569 @@
+#ifndef REPLACEMENT_H
+#define REPLACEMENT_H
+
+#include "checkpoint.h"
+#include "clock_sweep.h"
+#include "process_id.h"
+
+#include <cstddef>
+#include <cstring>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+// Page replacement policies. The operating system owns the frames and the page table; a policy only decides which
+// occupied frame to give up when a page fault finds every frame in use. The policy is a template parameter of
+// BasicOperatingSystem, so the calls on the memory access path are resolved at compile time.
+//
+// Every policy provides:
+//   static const char* Name()
+//   unsigned int PickVictim(const PageKey & incoming)   Called only when every frame is occupied. The frame returned
+//                                                       is forgotten by the policy; incoming is the page that will replace it.
+//   void Insert(unsigned int frame, const PageKey & key) A page fault has loaded key into frame.
+//   void Touch(unsigned int frame)                       The page in frame was accessed again.
+//   void Release(unsigned int frame)                     The frame was freed because its process terminated.
+//   void Save(CheckpointWriter & writer) const           Write the policy's state to a checkpoint.
+//   bool Load(CheckpointReader & reader)                 Replace the policy's state with one written by Save.
+
+// Identifies one page of one process.
+struct PageKey {
+    ProcessId pid;
+    int page;
+
+    PageKey() : pid(0), page(0) {}
+    PageKey(const ProcessId pid_, const int page_) : pid(pid_), page(page_) {}
+
+    bool operator==(const PageKey & other) const {
+        return pid == other.pid && page == other.page;
+    }
+};
+
+struct PageKeyHash {
+    size_t operator()(const PageKey & key) const {
+        unsigned long long mixed = static_cast<unsigned long long>(key.pid) * 0x9E3779B97F4A7C15ULL ^ static_cast<unsigned int>(key.page);
+        return static_cast<size_t>(mixed ^ (mixed >> 29));
+    }
+};
+
+// A fixed number of doubly linked lists of frame indexes. The links are stored per frame, so a frame is in at most
+// one of the lists, and every operation is O(1).
+class FrameLists {
+    public:
+        static const unsigned int NONE = static_cast<unsigned int>(-1);
+
+        explicit FrameLists(const unsigned int number_of_lists) : heads(number_of_lists, +NONE), tails(number_of_lists, +NONE), sizes(number_of_lists, 0) {}
+
+        // Adds frame at the back (most recent end) of list
+        void PushBack(const unsigned int list, const unsigned int frame) {
+            Reserve(frame);
+            links[frame].list = list;
+            links[frame].prev = tails[list];
+            links[frame].next = NONE;
+            if (tails[list] != NONE) {
+                links[tails[list]].next = frame;
+            }
+            else {
+                heads[list] = frame;
+            }
+            tails[list] = frame;
+            sizes[list]++;
+        }
+
+        // Takes frame out of whichever list holds it, if any
+        void Remove(const unsigned int frame) {
+            if (frame >= links.size() || links[frame].list == NONE) {
+                return;
+            }
+            Link & link = links[frame];
+            if (link.prev != NONE) {
+                links[link.prev].next = link.next;
+            }
+            else {
+                heads[link.list] = link.next;
+            }
+            if (link.next != NONE) {
+                links[link.next].prev = link.prev;
+            }
+            else {
+                tails[link.list] = link.prev;
+            }
+            sizes[link.list]--;
+            link.list = NONE;
+        }
+
+        // Moves frame to the back of list
+        void MoveToBack(const unsigned int list, const unsigned int frame) {
+            if (tails[list] != frame) {
+                Remove(frame);
+                PushBack(list, frame);
+            }
+        }
+
+        // Returns the list holding frame, or NONE
+        unsigned int ListOf(const unsigned int frame) const {
+            return frame < links.size() ? links[frame].list : NONE;
+        }
+
+        // Returns the frame at the front (least recent end) of list, or NONE
+        unsigned int Front(const unsigned int list) const {
+            return heads[list];
+        }
+
+        size_t Size(const unsigned int list) const {
+            return sizes[list];
+        }
+
+        void Save(CheckpointWriter & writer) const {
+            writer.PutVector(links);
+            writer.PutVector(heads);
+            writer.PutVector(tails);
+            writer.PutVector(sizes);
+        }
+
+        // Loads lists written by Save from a FrameLists with the same number of lists.
+        bool Load(CheckpointReader & reader) {
+            size_t number_of_lists = heads.size();
+            if (!reader.GetVector(links) || !reader.GetVector(heads) || !reader.GetVector(tails) || !reader.GetVector(sizes)) {
+                return false;
+            }
+            if (heads.size() != number_of_lists || tails.size() != number_of_lists || sizes.size() != number_of_lists) {
+                return reader.Fail();
+            }
+            for (size_t list = 0; list < number_of_lists; list++) {
+                if ((heads[list] != NONE && heads[list] >= links.size()) || (tails[list] != NONE && tails[list] >= links.size())) {
+                    return reader.Fail();
+                }
+            }
+            for (const Link & link : links) {
+                if ((link.list != NONE && link.list >= number_of_lists) || (link.prev != NONE && link.prev >= links.size())
+                    || (link.next != NONE && link.next >= links.size())) {
+                    return reader.Fail();
+                }
+            }
+            return true;
+        }
+
+    private:
+        struct Link {
+            unsigned int list;
+            unsigned int prev;
+            unsigned int next;
+
+            Link() : list(NONE), prev(NONE), next(NONE) {}
+        };
+
+        std::vector<Link> links;                // Index is the frame index; grows as frames are created
+        std::vector<unsigned int> heads;
+        std::vector<unsigned int> tails;
+        std::vector<size_t> sizes;
+
+        void Reserve(const unsigned int frame) {
+            if (frame >= links.size()) {
+                links.resize(frame + 1);
+            }
+        }
+};
+
+// A FIFO of pages that have been evicted, remembered only by their key.
+class GhostList {
+    public:
+        bool Contains(const PageKey & key) const {
+            return positions.count(key) != 0;
+        }
+
+        void PushBack(const PageKey & key) {
+            order.push_back(key);
+            positions[key] = --order.end();
+        }
+
+        void PopFront() {
+            positions.erase(order.front());
+            order.pop_front();
+        }
+
+        void Erase(const PageKey & key) {
+            auto found = positions.find(key);
+            if (found != positions.end()) {
+                order.erase(found->second);
+                positions.erase(found);
+            }
+        }
+
+        size_t Size() const {
+            return positions.size();
+        }
+
+        // Writes the remembered pages, oldest first.
+        void Save(CheckpointWriter & writer) const {
+            std::vector<PageKey> keys(order.begin(), order.end());
+            writer.PutVector(keys);
+        }
+
+        bool Load(CheckpointReader & reader) {
+            order.clear();
+            positions.clear();
+            size_t count = 0;
+            const PageKey* keys = reader.GetArray<PageKey>(count);
+            if (reader.Failed()) {
+                return false;
+            }
+            positions.reserve(count);
+            for (size_t i = 0; i < count; i++) {
+                PushBack(keys[i]);
+            }
+            return true;
+        }
+
+    private:
+        std::list<PageKey> order;                                                   // Oldest first
+        std::unordered_map<PageKey, std::list<PageKey>::iterator, PageKeyHash> positions;
+};
+
+// Exact least recently used. Every access moves the frame to the back of a recency list, and the victim is the front.
+class LruReplacement {
+    public:
+        LruReplacement() : recency(1) {}
+
+        static const char* Name() {
+            return "lru";
+        }
+
+        unsigned int PickVictim(const PageKey &) {
+            unsigned int victim = recency.Front(0);
+            recency.Remove(victim);
+            return victim;
+        }
+
+        void Insert(const unsigned int frame, const PageKey &) {
+            recency.PushBack(0, frame);
+        }
+
+        void Touch(const unsigned int frame) {
+            recency.MoveToBack(0, frame);
+        }
+
+        void Release(const unsigned int frame) {
+            recency.Remove(frame);
+        }
+
+        void Save(CheckpointWriter & writer) const {
+            recency.Save(writer);
+        }
+
+        bool Load(CheckpointReader & reader) {
+            return recency.Load(reader);
+        }
+
+    private:
+        FrameLists recency;                     // Least recently used frame at the front
+};
+
+// CLOCK, or second chance. An access only sets the frame's reference bit. To find a victim, the hand sweeps the
+// frames in index order, clearing set bits, and stops at the first frame whose bit is already clear. The bits and the
+// occupied flags are kept as parallel byte arrays so that the sweep can test many frames per instruction.
+class ClockReplacement {
+    public:
+        ClockReplacement() : hand(0) {}
+
+        static const char* Name() {
+            return "clock";
+        }
+
+        unsigned int PickVictim(const PageKey &) {
+            ClockSweepKernel sweep = ClockSweepFunction();
+            while (true) {
+                if (hand >= referenced.size()) {
+                    hand = 0;
+                }
+                size_t frame = sweep(referenced.data(), occupied.data(), hand, referenced.size());
+                if (frame == referenced.size()) {
+                    // Every bit from the hand on was set and is now clear, so the next lap finds a victim
+                    hand = frame;
+                    continue;
+                }
+                occupied[frame] = 0;
+                hand = frame + 1;
+                return frame;
+            }
+        }
+
+        void Insert(const unsigned int frame, const PageKey &) {
+            if (frame >= referenced.size()) {
+                referenced.resize(frame + 1, 0);
+                occupied.resize(frame + 1, 0);
+            }
+            referenced[frame] = 1;
+            occupied[frame] = 1;
+        }
+
+        void Touch(const unsigned int frame) {
+            referenced[frame] = 1;
+        }
+
+        void Release(const unsigned int frame) {
+            referenced[frame] = 0;
+            occupied[frame] = 0;
+        }
+
+        void Save(CheckpointWriter & writer) const {
+            writer.PutVector(referenced);
+            writer.PutVector(occupied);
+            writer.Put(hand);
+        }
+
+        bool Load(CheckpointReader & reader) {
+            if (!reader.GetVector(referenced) || !reader.GetVector(occupied) || !reader.Get(hand)) {
+                return false;
+            }
+            return occupied.size() == referenced.size() || reader.Fail();
+        }
+
+    private:
+        std::vector<unsigned char> referenced;  // Reference bit of each frame
+        std::vector<unsigned char> occupied;    // True while the frame holds a page
+        unsigned int hand;                      // Next frame the sweep looks at
+};
+
+// 2Q (Johnson and Shasha). A page seen for the first time goes to the FIFO a1in and is not promoted by hits there,
+// so a scan cannot flush the main LRU list am. Pages evicted from a1in are remembered in the ghost FIFO a1out, and a
+// fault on a remembered page puts it straight into am. a1in is kept to about a quarter of the frames and a1out
+// remembers about half as many pages as there are frames.
+class TwoQueueReplacement {
+    public:
+        TwoQueueReplacement() : lists(2), number_of_frames(0) {}
+
+        static const char* Name() {
+            return "2q";
+        }
+
+        unsigned int PickVictim(const PageKey &) {
+            unsigned int victim;
+            if (lists.Size(A1IN) > number_of_frames / 4 || lists.Size(AM) == 0) {
+                victim = lists.Front(A1IN);
+                a1out.PushBack(keys[victim]);
+                if (a1out.Size() > number_of_frames / 2 + 1) {
+                    a1out.PopFront();
+                }
+            }
+            else {
+                victim = lists.Front(AM);
+            }
+            lists.Remove(victim);
+            return victim;
+        }
+
+        void Insert(const unsigned int frame, const PageKey & key) {
+            if (frame >= keys.size()) {
+                keys.resize(frame + 1);
+                number_of_frames = keys.size();
+            }
+            keys[frame] = key;
+            if (a1out.Contains(key)) {
+                a1out.Erase(key);
+                lists.PushBack(AM, frame);
+            }
+            else {
+                lists.PushBack(A1IN, frame);
+            }
+        }
+
+        void Touch(const unsigned int frame) {
+            if (lists.ListOf(frame) == AM) {
+                lists.MoveToBack(AM, frame);
+            }
+        }
+
+        void Release(const unsigned int frame) {
+            lists.Remove(frame);
+        }
+
+        void Save(CheckpointWriter & writer) const {
+            lists.Save(writer);
+            a1out.Save(writer);
+            writer.PutVector(keys);
+        }
+
+        bool Load(CheckpointReader & reader) {
+            if (!lists.Load(reader) || !a1out.Load(reader) || !reader.GetVector(keys)) {
+                return false;
+            }
+            number_of_frames = keys.size();
+            return true;
+        }
+
+    private:
+        static const unsigned int A1IN = 0;     // Pages seen once recently, oldest at the front
+        static const unsigned int AM = 1;       // Pages seen again, least recently used at the front
+
+        FrameLists lists;
+        GhostList a1out;
+        std::vector<PageKey> keys;              // Page held by each frame
+        size_t number_of_frames;                // Frames created so far; every frame exists before the first eviction
+};
+
+// ARC (Megiddo and Modha). t1 holds pages seen once recently and t2 pages seen at least twice; the ghost lists b1 and
+// b2 remember pages recently evicted from each. A fault on a page in b1 means t1 was too small, so the target size p
+// of t1 grows; a fault on a page in b2 shrinks it. The victim is taken from t1 while t1 is larger than p.
+class ArcReplacement {
+    public:
+        ArcReplacement() : lists(2), number_of_frames(0), target_t1(0), pending(false), pending_destination(T1) {}
+
+        static const char* Name() {
+            return "arc";
+        }
+
+        unsigned int PickVictim(const PageKey & incoming) {
+            size_t c = number_of_frames;
+            bool in_b2 = b2.Contains(incoming);
+            pending = true;
+            pending_key = incoming;
+            if (b1.Contains(incoming)) {
+                size_t step = b2.Size() > b1.Size() ? b2.Size() / b1.Size() : 1;
+                target_t1 = target_t1 + step < c ? target_t1 + step : c;
+                b1.Erase(incoming);
+                pending_destination = T2;
+            }
+            else if (in_b2) {
+                size_t step = b1.Size() > b2.Size() ? b1.Size() / b2.Size() : 1;
+                target_t1 = target_t1 > step ? target_t1 - step : 0;
+                b2.Erase(incoming);
+                pending_destination = T2;
+            }
+            else {
+                pending_destination = T1;
+                // The directory of resident and ghost pages is kept to 2c entries, with at most c of them in t1 and b1
+                if (lists.Size(T1) + b1.Size() >= c) {
+                    if (lists.Size(T1) < c) {
+                        if (b1.Size() > 0) {
+                            b1.PopFront();
+                        }
+                    }
+                    else {
+                        // t1 holds every frame: evict its oldest page without remembering it
+                        unsigned int victim = lists.Front(T1);
+                        lists.Remove(victim);
+                        return victim;
+                    }
+                }
+                else if (lists.Size(T1) + lists.Size(T2) + b1.Size() + b2.Size() >= 2 * c && b2.Size() > 0) {
+                    b2.PopFront();
+                }
+            }
+            return Replace(in_b2);
+        }
+
+        void Insert(const unsigned int frame, const PageKey & key) {
+            if (frame >= keys.size()) {
+                keys.resize(frame + 1);
+                number_of_frames = keys.size();
+            }
+            keys[frame] = key;
+            unsigned int destination = T1;
+            if (pending && pending_key == key) {
+                destination = pending_destination;
+            }
+            // A free frame was used, so PickVictim did not see this page; it can still be a ghost
+            else if (b1.Contains(key)) {
+                b1.Erase(key);
+                destination = T2;
+            }
+            else if (b2.Contains(key)) {
+                b2.Erase(key);
+                destination = T2;
+            }
+            pending = false;
+            lists.PushBack(destination, frame);
+        }
+
+        void Touch(const unsigned int frame) {
+            lists.MoveToBack(T2, frame);
+        }
+
+        void Release(const unsigned int frame) {
+            lists.Remove(frame);
+        }
+
+        void Save(CheckpointWriter & writer) const {
+            lists.Save(writer);
+            b1.Save(writer);
+            b2.Save(writer);
+            writer.PutVector(keys);
+            writer.Put(static_cast<unsigned long long>(target_t1));
+        }
+
+        bool Load(CheckpointReader & reader) {
+            unsigned long long target = 0;
+            if (!lists.Load(reader) || !b1.Load(reader) || !b2.Load(reader) || !reader.GetVector(keys) || !reader.Get(target)) {
+                return false;
+            }
+            number_of_frames = keys.size();
+            target_t1 = target;
+            pending = false;
+            return true;
+        }
+
+        // Returns the current target size of t1
+        size_t TargetT1() const {
+            return target_t1;
+        }
+
+    private:
+        static const unsigned int T1 = 0;       // Resident pages seen once, oldest at the front
+        static const unsigned int T2 = 1;       // Resident pages seen more than once, least recently used at the front
+
+        FrameLists lists;
+        GhostList b1;                           // Pages evicted from t1
+        GhostList b2;                           // Pages evicted from t2
+        std::vector<PageKey> keys;              // Page held by each frame
+        size_t number_of_frames;
+        size_t target_t1;                       // p in the paper
+        bool pending;                           // PickVictim already decided where the incoming page goes
+        PageKey pending_key;
+        unsigned int pending_destination;
+
+        // Evicts from t1 or t2 depending on p, remembering the page in the matching ghost list.
+        unsigned int Replace(const bool incoming_in_b2) {
+            unsigned int victim;
+            size_t t1 = lists.Size(T1);
+            if (t1 > 0 && (t1 > target_t1 || (incoming_in_b2 && t1 == target_t1) || lists.Size(T2) == 0)) {
+                victim = lists.Front(T1);
+                b1.PushBack(keys[victim]);
+            }
+            else {
+                victim = lists.Front(T2);
+                b2.PushBack(keys[victim]);
+            }
+            lists.Remove(victim);
+            return victim;
+        }
+};
+
+// The replacement policies that can be chosen when the simulator starts.
+enum ReplacementPolicy {
+    REPLACEMENT_LRU,
+    REPLACEMENT_CLOCK,
+    REPLACEMENT_2Q,
+    REPLACEMENT_ARC
+};
+
+// Converts a policy name as returned by the policies' Name(). Returns false if the name is unknown.
+inline bool ParseReplacementPolicy(const char* name, ReplacementPolicy & policy) {
+    if (std::strcmp(name, LruReplacement::Name()) == 0) {
+        policy = REPLACEMENT_LRU;
+    }
+    else if (std::strcmp(name, ClockReplacement::Name()) == 0) {
+        policy = REPLACEMENT_CLOCK;
+    }
+    else if (std::strcmp(name, TwoQueueReplacement::Name()) == 0) {
+        policy = REPLACEMENT_2Q;
+    }
+    else if (std::strcmp(name, ArcReplacement::Name()) == 0) {
+        policy = REPLACEMENT_ARC;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+#endif // REPLACEMENT_H
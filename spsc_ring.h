@@ -0,0 +1,100 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+// A bounded ring buffer for exactly one producer thread and one consumer thread. Neither takes a lock: the producer
+// only writes tail and the consumer only writes head, each publishing the slots it filled or emptied with a release
+// store that the other side reads with acquire. Each side keeps its last view of the other's index and only reloads it
+// when the ring looks full or empty, so in the steady state a batch costs one shared load and one store per side.
+// head and tail sit on separate cache lines so the two threads do not invalidate each other's line on every batch.
+//
+// T must be trivially copyable, since values are copied into and out of the slots as plain memory.
+template <typename T>
+class SpscRing {
+    public:
+        explicit SpscRing(const size_t capacity) : slots(RoundUp(capacity)), mask(slots.size() - 1), head(0), cached_tail(0),
+            tail(0), cached_head(0), closed(false) {}
+
+        size_t Capacity() const {
+            return slots.size();
+        }
+
+        // Copies as many of the count values as fit, in order. Producer only. Returns how many were copied, 0 if the
+        // ring is full.
+        size_t TryPush(const T* values, const size_t count) {
+            size_t t = tail.load(std::memory_order_relaxed);
+            size_t free_slots = slots.size() - (t - cached_head);
+            if (free_slots < count) {
+                cached_head = head.load(std::memory_order_acquire);
+                free_slots = slots.size() - (t - cached_head);
+            }
+            size_t pushed = count < free_slots ? count : free_slots;
+            for (size_t i = 0; i < pushed; i++) {
+                slots[(t + i) & mask] = values[i];
+            }
+            if (pushed > 0) {
+                tail.store(t + pushed, std::memory_order_release);
+            }
+            return pushed;
+        }
+
+        // Copies up to max values out of the ring, oldest first. Consumer only. Returns how many were copied, 0 if
+        // the ring is empty.
+        size_t TryPop(T* values, const size_t max) {
+            size_t h = head.load(std::memory_order_relaxed);
+            size_t available = cached_tail - h;
+            if (available == 0) {
+                cached_tail = tail.load(std::memory_order_acquire);
+                available = cached_tail - h;
+            }
+            size_t popped = max < available ? max : available;
+            for (size_t i = 0; i < popped; i++) {
+                values[i] = slots[(h + i) & mask];
+            }
+            if (popped > 0) {
+                head.store(h + popped, std::memory_order_release);
+            }
+            return popped;
+        }
+
+        // The producer will push nothing more. Producer only.
+        void Close() {
+            closed.store(true, std::memory_order_release);
+        }
+
+        // Returns true once the producer has closed the ring. Everything it pushed before closing can still be popped,
+        // so the consumer is done when the ring is closed and a pop after seeing that finds nothing.
+        bool Closed() const {
+            return closed.load(std::memory_order_acquire);
+        }
+
+    private:
+        static_assert(std::is_trivially_copyable<T>::value, "ring slots are copied as plain values");
+
+        static const size_t CACHE_LINE = 64;
+
+        std::vector<T> slots;                   // A power of two of them, indexed by the ever-growing head and tail
+        const size_t mask;
+        alignas(CACHE_LINE) std::atomic<size_t> head;   // Index of the oldest value; written by the consumer
+        size_t cached_tail;                     // The consumer's last view of tail
+        alignas(CACHE_LINE) std::atomic<size_t> tail;   // Index one past the newest value; written by the producer
+        size_t cached_head;                     // The producer's last view of head
+        alignas(CACHE_LINE) std::atomic<bool> closed;
+
+        static size_t RoundUp(const size_t capacity) {
+            size_t rounded = 1;
+            while (rounded < capacity) {
+                rounded *= 2;
+            }
+            return rounded;
+        }
+
+        SpscRing(const SpscRing &);
+        SpscRing & operator=(const SpscRing &);
+};
+
+#endif // SPSC_RING_H
@@ -0,0 +1,257 @@
+#ifndef STACK_DISTANCE_H
+#define STACK_DISTANCE_H
+
+#include "process_id.h"
+#include "replacement.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <ostream>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+// Counts over positions 0, 1, 2, ... that can be changed and summed over a prefix in O(log n), and grow at the end.
+class FenwickTree {
+    public:
+        FenwickTree() : total(0) {}
+
+        // Adds a position at the end holding value, and returns it.
+        size_t Append(const long long value) {
+            size_t position = tree.size();
+            size_t i = position + 1;
+            // Node i covers (i - lowbit(i), i]; the positions before this one are already in place
+            long long covered = value + Prefix(position) - Prefix(i - (i & (~i + 1)));
+            tree.push_back(covered);
+            total += value;
+            return position;
+        }
+
+        void Add(const size_t position, const long long delta) {
+            for (size_t i = position + 1; i <= tree.size(); i += i & (~i + 1)) {
+                tree[i - 1] += delta;
+            }
+            total += delta;
+        }
+
+        // Returns the sum of positions [0, end)
+        long long Prefix(const size_t end) const {
+            long long sum = 0;
+            for (size_t i = end; i > 0; i -= i & (~i + 1)) {
+                sum += tree[i - 1];
+            }
+            return sum;
+        }
+
+        long long Total() const {
+            return total;
+        }
+
+        size_t Size() const {
+            return tree.size();
+        }
+
+        // Replaces the contents with values, in O(n)
+        void Assign(const std::vector<long long> & values) {
+            tree = values;
+            total = 0;
+            for (size_t i = 1; i <= tree.size(); i++) {
+                total += values[i - 1];
+                size_t parent = i + (i & (~i + 1));
+                if (parent <= tree.size()) {
+                    tree[parent - 1] += tree[i - 1];
+                }
+            }
+        }
+
+    private:
+        std::vector<long long> tree;           // tree[i - 1] is the sum of positions (i - lowbit(i), i]
+        long long total;
+};
+
+// Computes, in one pass over the memory references of a run, how many of them would have hit under global LRU
+// replacement for every number of frames at once (Mattson's stack algorithm).
+//
+// Every referenced page has a slot, ordered by when it was last used. A page's stack distance is one more than the
+// number of slots used after it, so a reference hits in any memory of at least that many frames. When a process
+// terminates, its pages leave holes in the stack: a hole is a frame freed in every memory deep enough to hold it.
+// A reference moves its page to the top and fills the topmost hole, which is where the pages above it move down to,
+// and its old slot becomes a hole. This keeps the stack exact for the simulator, which fills freed frames before
+// evicting anything. Slots are counted in a Fenwick tree, so each reference costs O(log n).
+//
+// With a sample rate below 1 only the pages whose hash falls under the rate are tracked (SHARDS), their distances
+// are scaled up by 1 / rate, and the curve is an estimate for a fraction of the memory and time.
+class StackDistanceAnalyzer {
+    public:
+        explicit StackDistanceAnalyzer(const double sample_rate_ = 1) : sample_rate(sample_rate_), threshold(0), references(0),
+            sampled_references(0), cold_misses(0) {
+            if (sample_rate <= 0 || sample_rate > 1) {
+                sample_rate = 1;
+            }
+            threshold = static_cast<unsigned long long>(sample_rate * SAMPLE_MODULUS);
+        }
+
+        // The page key was referenced
+        void Reference(const PageKey & key) {
+            references++;
+            if (!Sampled(key)) {
+                return;
+            }
+            sampled_references++;
+            auto found = slots.find(key);
+            if (found == slots.end()) {
+                cold_misses++;
+                FillTopHole();
+                slots[key] = Push();
+                pages[key.pid].push_back(key.page);
+            }
+            else {
+                size_t slot = found->second;
+                size_t distance = static_cast<size_t>(used.Total() - used.Prefix(slot + 1)) + 1;
+                CountDistance(distance);
+                holes.push(slot);
+                FillTopHole();
+                found->second = Push();
+            }
+            if (used.Size() > 2 * static_cast<size_t>(used.Total()) + MIN_COMPACT_SLOTS) {
+                Compact();
+            }
+        }
+
+        // The process terminated, so its pages left memory
+        void Release(const ProcessId pid) {
+            auto found = pages.find(pid);
+            if (found == pages.end()) {
+                return;
+            }
+            for (int page : found->second) {
+                auto slot = slots.find(PageKey(pid, page));
+                holes.push(slot->second);
+                slots.erase(slot);
+            }
+            pages.erase(found);
+        }
+
+        // Writes the curve as CSV with the header frames,hits,misses,hit_ratio, one row for every number of frames
+        // from 1 to the largest stack distance seen. More frames than that give the same result as the last row.
+        void WriteCurve(std::ostream & out) {
+            Accumulate();
+            out << "frames,hits,misses,hit_ratio\n";
+            for (size_t frames = 1; frames < cumulative_hits.size(); frames++) {
+                unsigned long long hits = cumulative_hits[frames];
+                out << frames << ',' << hits << ',' << references - hits << ',' << (references > 0 ? static_cast<double>(hits) / references : 0) << '\n';
+            }
+            out.flush();
+        }
+
+        unsigned long long References() const {
+            return references;
+        }
+
+        double SampleRate() const {
+            return sample_rate;
+        }
+
+    private:
+        static const unsigned long long SAMPLE_MODULUS = 1 << 24;
+        static const size_t MIN_COMPACT_SLOTS = 1 << 16;
+
+        double sample_rate;
+        unsigned long long threshold;                       // A page is sampled if its hash modulo SAMPLE_MODULUS is below this
+        unsigned long long references;                      // Every reference, sampled or not
+        unsigned long long sampled_references;
+        unsigned long long cold_misses;                     // First references to a sampled page
+        FenwickTree used;                                   // 1 for every slot holding a page or a hole
+        std::priority_queue<size_t> holes;                  // Slots of the holes, topmost first
+        std::unordered_map<PageKey, size_t, PageKeyHash> slots;     // Slot of every page in the stack
+        std::unordered_map<ProcessId, std::vector<int> > pages;     // Pages in the stack of each process
+        std::vector<double> distance_counts;                // Index is the (scaled) stack distance
+        std::vector<unsigned long long> cumulative_hits;    // Index is the number of frames; filled by Accumulate
+
+        bool Sampled(const PageKey & key) const {
+            if (threshold >= SAMPLE_MODULUS) {
+                return true;
+            }
+            // splitmix64 finalizer, so that neighbouring pages are sampled independently
+            unsigned long long hash = PageKeyHash()(key);
+            hash ^= hash >> 30;
+            hash *= 0xBF58476D1CE4E5B9ULL;
+            hash ^= hash >> 27;
+            hash *= 0x94D049BB133111EBULL;
+            hash ^= hash >> 31;
+            return (hash % SAMPLE_MODULUS) < threshold;
+        }
+
+        // Puts a new slot on top of the stack and returns it
+        size_t Push() {
+            return used.Append(1);
+        }
+
+        // The page moving to the top fills the topmost hole, if there is one
+        void FillTopHole() {
+            if (!holes.empty()) {
+                used.Add(holes.top(), -1);
+                holes.pop();
+            }
+        }
+
+        void CountDistance(const size_t distance) {
+            size_t scaled = distance;
+            double weight = 1;
+            if (sample_rate < 1) {
+                scaled = static_cast<size_t>(std::ceil(distance / sample_rate));
+                weight = 1 / sample_rate;
+            }
+            if (scaled >= distance_counts.size()) {
+                distance_counts.resize(scaled + 1, 0);
+            }
+            distance_counts[scaled] += weight;
+        }
+
+        // Turns the distance counts into hits for every number of frames. When sampling, the difference between
+        // the expected and actual number of sampled references is credited to the smallest distance (SHARDS-adj).
+        void Accumulate() {
+            std::vector<double> counts = distance_counts;
+            if (sample_rate < 1 && counts.size() > 1) {
+                double expected = references * sample_rate;
+                counts[1] = std::max(0.0, counts[1] + (expected - sampled_references) / sample_rate);
+            }
+            cumulative_hits.assign(counts.size(), 0);
+            double sum = 0;
+            for (size_t frames = 1; frames < counts.size(); frames++) {
+                sum += counts[frames];
+                cumulative_hits[frames] = std::min(references, static_cast<unsigned long long>(sum + 0.5));
+            }
+        }
+
+        // Renumbers the slots in use from 0, once most slots are neither a page nor a hole.
+        void Compact() {
+            std::vector<long long> occupied(used.Size(), 0);
+            for (auto & entry : slots) {
+                occupied[entry.second] = 1;
+            }
+            std::vector<size_t> hole_slots;
+            hole_slots.reserve(holes.size());
+            while (!holes.empty()) {
+                occupied[holes.top()] = 1;
+                hole_slots.push_back(holes.top());
+                holes.pop();
+            }
+            std::vector<size_t> renumbered(occupied.size());
+            size_t next = 0;
+            for (size_t slot = 0; slot < occupied.size(); slot++) {
+                renumbered[slot] = next;
+                next += static_cast<size_t>(occupied[slot]);
+            }
+            for (auto & entry : slots) {
+                entry.second = renumbered[entry.second];
+            }
+            for (size_t slot : hole_slots) {
+                holes.push(renumbered[slot]);
+            }
+            used.Assign(std::vector<long long>(next, 1));
+        }
+};
+
+#endif // STACK_DISTANCE_H
@@ -0,0 +1,355 @@
+#ifndef STATE_LOG_H
+#define STATE_LOG_H
+
+#include "process_id.h"
+#include "varint.h"
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+
+// State log layout, in either format:
+//   NDJSON:  one JSON object per line. The first has "e":"begin" and the configuration; every other one has the
+//            clock "t", the change "e" and its fields, e.g. {"t":12,"e":"frame_load","frame":3,"pid":5,"page":7}
+//   binary:  the 4 bytes "OSSL", a version byte, then RAM, page size, number of hard disks, number of cores and the
+//            clock as varints; then records of a one byte StateChange followed by its operands
+//
+// Operands are LEB128 varints, with pages zigzag encoded first. The clock is not repeated in every binary record:
+// STATE_CLOCK carries how far it advanced since the last record. File names are stored once: STATE_DEFINE_FILE
+// carries the length and bytes of the next file id (starting at 0), before the first record that names it.
+
+const char STATE_LOG_MAGIC[4] = { 'O', 'S', 'S', 'L' };
+const unsigned char STATE_LOG_VERSION = 1;
+
+enum StateLogFormat {
+    STATE_LOG_NDJSON,
+    STATE_LOG_BINARY
+};
+
+// The changes written to the log. These values are part of the binary format and must never be renumbered.
+enum StateChange {
+    STATE_CLOCK = 1,                // ticks since the last record
+    STATE_READY_ADD = 2,            // core, pid: the process joins the run queue of core
+    STATE_READY_REMOVE = 3,         // core, pid: the process leaves it, to run or to terminate
+    STATE_RUN = 4,                  // core, pid: the process now runs on core; pid 1 leaves it idle
+    STATE_FRAME_LOAD = 5,           // frame, pid, page
+    STATE_FRAME_EVICT = 6,          // frame, pid, page: the page leaves the frame to make room for another
+    STATE_FRAME_FREE = 7,           // frame, pid, page: the page leaves the frame because its process terminated
+    STATE_FRAME_OWNER = 8,          // frame, pid: a process that shared the frame copy-on-write now owns it
+    STATE_DISK_QUEUE = 9,           // disk, pid, file: the request joins the io queue of disk
+    STATE_DISK_START = 10,          // disk, pid, file: the disk serves the request, taking it off the io queue
+    STATE_DISK_FINISH = 11,         // disk, pid: the disk has finished it
+    STATE_DISK_CANCEL = 12,         // disk, pid: the request is dropped, served or queued, because its process terminated
+    STATE_DEFINE_FILE = 13          // length, bytes (binary only)
+};
+
+// Writes every change to the ready queues, the cores, the frames and the disks as it happens, so a viewer can follow
+// the simulated system at the cost of the changes rather than by reprinting snapshots. Records are collected in
+// memory and written to the file in large blocks. When it is attached to a system, the log first writes the state
+// the system is in, as the records that would have built it, so it can be followed from a restored checkpoint too.
+class StateLog {
+    public:
+        StateLog() : format(STATE_LOG_NDJSON), clock(0), logged_clock(0), defined_files(0), number_of_records(0) {}
+
+        ~StateLog() {
+            Close();
+        }
+
+        // Creates the file at path, to be written in format. Returns false if the file cannot be created.
+        bool Open(const std::string & path, const StateLogFormat format_) {
+            format = format_;
+            out.open(path.c_str(), std::ios::binary | std::ios::trunc);
+            return static_cast<bool>(out);
+        }
+
+        bool IsOpen() const {
+            return out.is_open();
+        }
+
+        // Writes the configuration of the system the log is attached to, at clock.
+        void Begin(const unsigned int RAM, const unsigned int page_size, const int number_of_hard_disks, const size_t number_of_cores,
+                   const unsigned long long clock_) {
+            clock = clock_;
+            logged_clock = clock_;
+            if (format == STATE_LOG_BINARY) {
+                buffer.append(STATE_LOG_MAGIC, sizeof(STATE_LOG_MAGIC));
+                buffer.push_back(static_cast<char>(STATE_LOG_VERSION));
+                AppendVarint(buffer, RAM);
+                AppendVarint(buffer, page_size);
+                AppendVarint(buffer, static_cast<unsigned long long>(number_of_hard_disks));
+                AppendVarint(buffer, number_of_cores);
+                AppendVarint(buffer, clock);
+            }
+            else {
+                buffer += "{\"t\":";
+                AppendDecimal(clock);
+                buffer += ",\"e\":\"begin\",\"ram\":";
+                AppendDecimal(RAM);
+                buffer += ",\"page_size\":";
+                AppendDecimal(page_size);
+                buffer += ",\"disks\":";
+                AppendDecimal(static_cast<unsigned long long>(number_of_hard_disks));
+                buffer += ",\"cores\":";
+                AppendDecimal(number_of_cores);
+                buffer += "}\n";
+            }
+        }
+
+        // The clock of the system has moved on; records from now on are stamped with it.
+        void SetClock(const unsigned long long clock_) {
+            clock = clock_;
+        }
+
+        void ReadyAdd(const unsigned int core, const ProcessId pid) {
+            Record(STATE_READY_ADD);
+            Field("core", core);
+            Field("pid", pid);
+            EndRecord();
+        }
+
+        void ReadyRemove(const unsigned int core, const ProcessId pid) {
+            Record(STATE_READY_REMOVE);
+            Field("core", core);
+            Field("pid", pid);
+            EndRecord();
+        }
+
+        void Run(const unsigned int core, const ProcessId pid) {
+            Record(STATE_RUN);
+            Field("core", core);
+            Field("pid", pid);
+            EndRecord();
+        }
+
+        void FrameLoad(const unsigned int frame, const ProcessId pid, const int page) {
+            FrameRecord(STATE_FRAME_LOAD, frame, pid, page);
+        }
+
+        void FrameEvict(const unsigned int frame, const ProcessId pid, const int page) {
+            FrameRecord(STATE_FRAME_EVICT, frame, pid, page);
+        }
+
+        void FrameFree(const unsigned int frame, const ProcessId pid, const int page) {
+            FrameRecord(STATE_FRAME_FREE, frame, pid, page);
+        }
+
+        void FrameOwner(const unsigned int frame, const ProcessId pid) {
+            Record(STATE_FRAME_OWNER);
+            Field("frame", frame);
+            Field("pid", pid);
+            EndRecord();
+        }
+
+        // A request of pid for the file with id file and name file_name joins the io queue of disk.
+        void DiskQueue(const int disk, const ProcessId pid, const unsigned int file, const std::string & file_name) {
+            DiskRecord(STATE_DISK_QUEUE, disk, pid, file, file_name);
+        }
+
+        void DiskStart(const int disk, const ProcessId pid, const unsigned int file, const std::string & file_name) {
+            DiskRecord(STATE_DISK_START, disk, pid, file, file_name);
+        }
+
+        void DiskFinish(const int disk, const ProcessId pid) {
+            Record(STATE_DISK_FINISH);
+            Field("disk", static_cast<unsigned int>(disk));
+            Field("pid", pid);
+            EndRecord();
+        }
+
+        void DiskCancel(const int disk, const ProcessId pid) {
+            Record(STATE_DISK_CANCEL);
+            Field("disk", static_cast<unsigned int>(disk));
+            Field("pid", pid);
+            EndRecord();
+        }
+
+        // Writes what is still buffered and closes the file. Returns false if anything could not be written.
+        bool Close() {
+            if (!out.is_open()) {
+                return true;
+            }
+            bool written = Flush();
+            out.close();
+            return written && !out.fail();
+        }
+
+        unsigned long long GetNumberOfRecords() const {
+            return number_of_records;
+        }
+
+    private:
+        static const size_t FLUSH_THRESHOLD = 1 << 16;
+
+        std::ofstream out;
+        std::string buffer;
+        StateLogFormat format;
+        unsigned long long clock;               // The clock of the system
+        unsigned long long logged_clock;        // The clock of the last binary record
+        unsigned int defined_files;             // File ids below this have been named in the binary log
+        unsigned long long number_of_records;
+
+        // Starts a record of the given change, preceded in the binary log by how far the clock has moved.
+        void Record(const StateChange change) {
+            number_of_records++;
+            if (format == STATE_LOG_BINARY) {
+                AppendClock();
+                buffer.push_back(static_cast<char>(change));
+                return;
+            }
+            buffer += "{\"t\":";
+            AppendDecimal(clock);
+            buffer += ",\"e\":\"";
+            buffer += ChangeName(change);
+            buffer += '"';
+        }
+
+        void EndRecord() {
+            if (format == STATE_LOG_NDJSON) {
+                buffer += "}\n";
+            }
+            if (buffer.size() >= FLUSH_THRESHOLD) {
+                Flush();
+            }
+        }
+
+        void Field(const char* name, const unsigned long long value) {
+            if (format == STATE_LOG_BINARY) {
+                AppendVarint(buffer, value);
+                return;
+            }
+            buffer += ",\"";
+            buffer += name;
+            buffer += "\":";
+            AppendDecimal(value);
+        }
+
+        void Field(const char* name, const unsigned int value) {
+            Field(name, static_cast<unsigned long long>(value));
+        }
+
+        void Field(const char* name, const ProcessId value) {
+            Field(name, static_cast<unsigned long long>(value));
+        }
+
+        void Field(const char* name, const int value) {
+            if (format == STATE_LOG_BINARY) {
+                AppendVarint(buffer, ZigZagEncode(value));
+                return;
+            }
+            buffer += ",\"";
+            buffer += name;
+            buffer += "\":";
+            if (value < 0) {
+                buffer += '-';
+            }
+            AppendDecimal(value < 0 ? 0ULL - static_cast<unsigned long long>(value) : static_cast<unsigned long long>(value));
+        }
+
+        void FrameRecord(const StateChange change, const unsigned int frame, const ProcessId pid, const int page) {
+            Record(change);
+            Field("frame", frame);
+            Field("pid", pid);
+            Field("page", page);
+            EndRecord();
+        }
+
+        // Disk records name their file by id in the binary log, defining the name the first time, and by name in NDJSON.
+        void DiskRecord(const StateChange change, const int disk, const ProcessId pid, const unsigned int file, const std::string & file_name) {
+            if (format == STATE_LOG_BINARY) {
+                // File ids are handed out in order, so a new one is always the next to define
+                if (file >= defined_files) {
+                    AppendClock();
+                    buffer.push_back(static_cast<char>(STATE_DEFINE_FILE));
+                    AppendVarint(buffer, file_name.size());
+                    buffer += file_name;
+                    defined_files = file + 1;
+                }
+                Record(change);
+                Field("disk", static_cast<unsigned int>(disk));
+                Field("pid", pid);
+                Field("file", file);
+                EndRecord();
+                return;
+            }
+            Record(change);
+            Field("disk", static_cast<unsigned int>(disk));
+            Field("pid", pid);
+            buffer += ",\"file\":\"";
+            AppendEscaped(file_name);
+            buffer += '"';
+            EndRecord();
+        }
+
+        void AppendClock() {
+            if (clock != logged_clock) {
+                buffer.push_back(static_cast<char>(STATE_CLOCK));
+                AppendVarint(buffer, clock - logged_clock);
+                logged_clock = clock;
+            }
+        }
+
+        void AppendDecimal(unsigned long long value) {
+            char digits[20];
+            size_t length = 0;
+            do {
+                digits[length++] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            } while (value != 0);
+            while (length > 0) {
+                buffer += digits[--length];
+            }
+        }
+
+        // Appends text as the inside of a JSON string.
+        void AppendEscaped(const std::string & text) {
+            static const char HEX[] = "0123456789abcdef";
+            for (char c : text) {
+                unsigned char byte = static_cast<unsigned char>(c);
+                if (c == '"' || c == '\\') {
+                    buffer += '\\';
+                    buffer += c;
+                }
+                else if (byte < 0x20) {
+                    buffer += "\\u00";
+                    buffer += HEX[byte >> 4];
+                    buffer += HEX[byte & 0xf];
+                }
+                else {
+                    buffer += c;
+                }
+            }
+        }
+
+        static const char* ChangeName(const StateChange change) {
+            switch (change) {
+                case STATE_READY_ADD: return "ready_add";
+                case STATE_READY_REMOVE: return "ready_remove";
+                case STATE_RUN: return "run";
+                case STATE_FRAME_LOAD: return "frame_load";
+                case STATE_FRAME_EVICT: return "frame_evict";
+                case STATE_FRAME_FREE: return "frame_free";
+                case STATE_FRAME_OWNER: return "frame_owner";
+                case STATE_DISK_QUEUE: return "disk_queue";
+                case STATE_DISK_START: return "disk_start";
+                case STATE_DISK_FINISH: return "disk_finish";
+                case STATE_DISK_CANCEL: return "disk_cancel";
+                case STATE_CLOCK:
+                case STATE_DEFINE_FILE:
+                    break;
+            }
+            return "";
+        }
+
+        bool Flush() {
+            if (!buffer.empty()) {
+                out.write(buffer.data(), buffer.size());
+                buffer.clear();
+            }
+            return static_cast<bool>(out);
+        }
+
+        StateLog(const StateLog &);
+        StateLog & operator=(const StateLog &);
+};
+
+#endif // STATE_LOG_H
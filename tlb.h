@@ -0,0 +1,196 @@
+#ifndef TLB_H
+#define TLB_H
+
+#include "checkpoint.h"
+#include "process_id.h"
+
+#include <cstddef>
+#include <vector>
+
+// A set-associative translation lookaside buffer: a small cache of the frames holding recently used pages, in front
+// of the page tables. A page can only be cached in the set its low bits select, and when the set is full the way
+// used longest ago is replaced.
+//
+// Every entry is tagged with the pid it belongs to. Without address space ids the core still flushes the whole TLB
+// whenever it switches to another process, as hardware without them must; with them the entries of several
+// processes live side by side and survive the switch.
+class Tlb {
+    public:
+        static const unsigned int DEFAULT_ENTRIES = 64;
+        static const unsigned int DEFAULT_WAYS = 4;
+
+        Tlb() : number_of_sets(0), ways(0), asid(false), now(0), hits(0), misses(0), flushes(0) {
+            Configure(DEFAULT_ENTRIES, DEFAULT_WAYS, false);
+        }
+
+        // Returns true if entries and ways describe a TLB: 0 entries for none, or a power of two number of sets of ways each.
+        static bool ValidGeometry(const unsigned int entries, const unsigned int ways) {
+            if (entries == 0) {
+                return true;
+            }
+            if (ways == 0 || entries % ways != 0) {
+                return false;
+            }
+            unsigned int sets = entries / ways;
+            return (sets & (sets - 1)) == 0;
+        }
+
+        // Empties the TLB and gives it entries entries in sets of ways, which must pass ValidGeometry. 0 entries
+        // turn it off, so every access walks the page tables.
+        void Configure(const unsigned int entries, const unsigned int ways_, const bool asid_) {
+            number_of_sets = entries == 0 ? 0 : entries / ways_;
+            ways = entries == 0 ? 0 : ways_;
+            asid = asid_;
+            slots.assign(static_cast<size_t>(number_of_sets) * ways, Entry());
+        }
+
+        bool Enabled() const {
+            return number_of_sets > 0;
+        }
+
+        unsigned int Entries() const {
+            return number_of_sets * ways;
+        }
+
+        unsigned int Ways() const {
+            return ways;
+        }
+
+        bool TagsAddressSpaces() const {
+            return asid;
+        }
+
+        // Looks up page of pid. Returns true, and sets frame, if it is cached.
+        bool Lookup(const ProcessId pid, const int page, unsigned int & frame) {
+            if (!Enabled()) {
+                return false;
+            }
+            Entry* set = Set(page);
+            for (unsigned int way = 0; way < ways; way++) {
+                if (set[way].pid == pid && set[way].page == page) {
+                    set[way].last_used = ++now;
+                    frame = set[way].frame;
+                    hits++;
+                    return true;
+                }
+            }
+            misses++;
+            return false;
+        }
+
+        // Caches the frame of page of pid after a page walk, in place of an empty way or the least recently used one.
+        void Insert(const ProcessId pid, const int page, const unsigned int frame) {
+            if (!Enabled()) {
+                return;
+            }
+            Entry* set = Set(page);
+            Entry* victim = &set[0];
+            for (unsigned int way = 0; way < ways; way++) {
+                if (set[way].pid == 0) {
+                    victim = &set[way];
+                    break;
+                }
+                if (set[way].last_used < victim->last_used) {
+                    victim = &set[way];
+                }
+            }
+            victim->pid = pid;
+            victim->page = page;
+            victim->frame = frame;
+            victim->last_used = ++now;
+        }
+
+        // Drops page of pid, whose frame was evicted or released.
+        void Invalidate(const ProcessId pid, const int page) {
+            if (!Enabled()) {
+                return;
+            }
+            Entry* set = Set(page);
+            for (unsigned int way = 0; way < ways; way++) {
+                if (set[way].pid == pid && set[way].page == page) {
+                    set[way] = Entry();
+                    return;
+                }
+            }
+        }
+
+        // The core is switching to another process. Without address space ids every entry is dropped.
+        void SwitchAddressSpace() {
+            if (!Enabled() || asid) {
+                return;
+            }
+            slots.assign(slots.size(), Entry());
+            flushes++;
+        }
+
+        unsigned long long Hits() const {
+            return hits;
+        }
+
+        unsigned long long Misses() const {
+            return misses;
+        }
+
+        unsigned long long Flushes() const {
+            return flushes;
+        }
+
+        // Returns true if check(pid, page, frame) holds for every cached page.
+        template <typename Check>
+        bool AllEntries(Check check) const {
+            for (const Entry & entry : slots) {
+                if (entry.pid != 0 && !check(entry.pid, entry.page, entry.frame)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void Save(CheckpointWriter & writer) const {
+            writer.Put(number_of_sets);
+            writer.Put(ways);
+            writer.Put(asid);
+            writer.Put(now);
+            writer.Put(hits);
+            writer.Put(misses);
+            writer.Put(flushes);
+            writer.PutVector(slots);
+        }
+
+        // Replaces the TLB, including its size and whether it tags address spaces, with one written by Save.
+        bool Load(CheckpointReader & reader) {
+            if (!reader.Get(number_of_sets) || !reader.Get(ways) || !reader.Get(asid) || !reader.Get(now) || !reader.Get(hits)
+                || !reader.Get(misses) || !reader.Get(flushes) || !reader.GetVector(slots)) {
+                return false;
+            }
+            if ((number_of_sets & (number_of_sets - 1)) != 0 || slots.size() != static_cast<size_t>(number_of_sets) * ways) {
+                return reader.Fail();
+            }
+            return true;
+        }
+
+    private:
+        struct Entry {
+            ProcessId pid;                      // 0 for an empty way
+            int page;
+            unsigned int frame;
+            unsigned long long last_used;       // Value of now when the entry was last looked up or filled
+
+            Entry() : pid(0), page(0), frame(0), last_used(0) {}
+        };
+
+        unsigned int number_of_sets;            // A power of two, or 0 when the TLB is off
+        unsigned int ways;
+        bool asid;                              // Entries survive a switch to another process
+        unsigned long long now;                 // Counts lookups that hit and fills, to order the ways of a set
+        unsigned long long hits;
+        unsigned long long misses;
+        unsigned long long flushes;
+        std::vector<Entry> slots;               // Set s is slots[s * ways] to slots[s * ways + ways - 1]
+
+        Entry* Set(const int page) {
+            return &slots[(static_cast<unsigned int>(page) & (number_of_sets - 1)) * ways];
+        }
+};
+
+#endif // TLB_H
@@ -0,0 +1,37 @@
+#ifndef VARINT_H
+#define VARINT_H
+
+#include <string>
+
+// Maps a signed value onto an unsigned one so that values near zero encode in few bytes.
+inline unsigned long long ZigZagEncode(const long long value) {
+    return (static_cast<unsigned long long>(value) << 1) ^ static_cast<unsigned long long>(value >> 63);
+}
+
+inline long long ZigZagDecode(const unsigned long long value) {
+    return static_cast<long long>(value >> 1) ^ -static_cast<long long>(value & 1);
+}
+
+// Appends value to out as a LEB128 varint.
+inline void AppendVarint(std::string & out, unsigned long long value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+// Reads a LEB128 varint from [pos, end) and advances pos. Returns false if the input ends early or is too long.
+inline bool ReadVarint(const char* & pos, const char* end, unsigned long long & value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && pos != end; shift += 7) {
+        unsigned char byte = static_cast<unsigned char>(*pos++);
+        value |= static_cast<unsigned long long>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif // VARINT_H
@@ -0,0 +1,152 @@
+#ifndef WORK_STEALING_DEQUE_H
+#define WORK_STEALING_DEQUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+// A Chase-Lev work-stealing deque (Lê, Pop, Cohen and Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak
+// Memory Models", 2013). One thread owns the deque and pushes and pops at the bottom; any thread may steal from the
+// top. Nothing takes a lock: the owner and thieves only contend, through a compare-and-swap on top, for the last
+// element. The ring of slots doubles when full; the rings it outgrows are kept until the deque is destroyed, because
+// a thief may still be reading one.
+//
+// T must be a small trivially copyable value, such as a pid, so each slot can be read and written atomically.
+template <typename T>
+class WorkStealingDeque {
+    public:
+        explicit WorkStealingDeque(const size_t capacity = 64) : top(0), bottom(0), ring(new Ring(RoundUp(capacity))) {}
+
+        ~WorkStealingDeque() {
+            delete ring.load(std::memory_order_relaxed);
+            for (Ring* old : retired) {
+                delete old;
+            }
+        }
+
+        // Adds value at the bottom. Owner only.
+        void Push(const T value) {
+            long long b = bottom.load(std::memory_order_relaxed);
+            long long t = top.load(std::memory_order_acquire);
+            Ring* r = ring.load(std::memory_order_relaxed);
+            if (b - t > static_cast<long long>(r->Capacity()) - 1) {
+                r = Grow(r, t, b);
+            }
+            r->Put(b, value);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+
+        // Takes the value at the bottom, the one pushed last. Owner only. Returns false if the deque is empty.
+        bool Pop(T & value) {
+            long long b = bottom.load(std::memory_order_relaxed) - 1;
+            Ring* r = ring.load(std::memory_order_relaxed);
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            long long t = top.load(std::memory_order_relaxed);
+            if (t > b) {
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return false;
+            }
+            value = r->Get(b);
+            if (t == b) {
+                // The last element: race the thieves for it
+                bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return won;
+            }
+            return true;
+        }
+
+        // Takes the value at the top, the oldest one. Any thread. Returns false if the deque is empty or another
+        // thread took the value first.
+        bool Steal(T & value) {
+            long long t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            long long b = bottom.load(std::memory_order_acquire);
+            if (t >= b) {
+                return false;
+            }
+            Ring* r = ring.load(std::memory_order_acquire);
+            value = r->Get(t);
+            return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        }
+
+        // The number of values, exact when no other thread is using the deque.
+        size_t Size() const {
+            long long b = bottom.load(std::memory_order_relaxed);
+            long long t = top.load(std::memory_order_relaxed);
+            return b > t ? static_cast<size_t>(b - t) : 0;
+        }
+
+        // Appends the values to out from top to bottom. Only valid while no other thread is using the deque.
+        void Collect(std::vector<T> & out) const {
+            Ring* r = ring.load(std::memory_order_relaxed);
+            long long b = bottom.load(std::memory_order_relaxed);
+            for (long long i = top.load(std::memory_order_relaxed); i < b; i++) {
+                out.push_back(r->Get(i));
+            }
+        }
+
+    private:
+        static_assert(std::is_trivially_copyable<T>::value, "deque slots are copied as plain values");
+
+        // A circular array of capacity slots, a power of two, indexed by the ever-growing top and bottom.
+        class Ring {
+            public:
+                explicit Ring(const size_t capacity_) : capacity(capacity_), slots(new std::atomic<T>[capacity_]) {}
+
+                ~Ring() {
+                    delete[] slots;
+                }
+
+                size_t Capacity() const {
+                    return capacity;
+                }
+
+                T Get(const long long index) const {
+                    return slots[static_cast<size_t>(index) & (capacity - 1)].load(std::memory_order_relaxed);
+                }
+
+                void Put(const long long index, const T value) {
+                    slots[static_cast<size_t>(index) & (capacity - 1)].store(value, std::memory_order_relaxed);
+                }
+
+            private:
+                size_t capacity;
+                std::atomic<T>* slots;
+
+                Ring(const Ring &);
+                Ring & operator=(const Ring &);
+        };
+
+        std::atomic<long long> top;             // Index of the oldest value; only ever increases
+        std::atomic<long long> bottom;          // Index one past the newest value
+        std::atomic<Ring*> ring;
+        std::vector<Ring*> retired;             // Outgrown rings, freed with the deque; touched by the owner only
+
+        static size_t RoundUp(const size_t capacity) {
+            size_t rounded = 1;
+            while (rounded < capacity) {
+                rounded *= 2;
+            }
+            return rounded;
+        }
+
+        // Copies [t, b) into a ring twice the size and publishes it.
+        Ring* Grow(Ring* old, const long long t, const long long b) {
+            Ring* bigger = new Ring(old->Capacity() * 2);
+            for (long long i = t; i < b; i++) {
+                bigger->Put(i, old->Get(i));
+            }
+            retired.push_back(old);
+            ring.store(bigger, std::memory_order_release);
+            return bigger;
+        }
+
+        WorkStealingDeque(const WorkStealingDeque &);
+        WorkStealingDeque & operator=(const WorkStealingDeque &);
+};
+
+#endif // WORK_STEALING_DEQUE_H